@@ -108,7 +108,7 @@ func handleConnect(w http.ResponseWriter, r *http.Request) {
 		MicMuted:         false,
 		AdminMuted:       false,
 		SocketConnection: conn,
-		PeerConnection:   &webrtc.PeerConnection{},
+		PeerConnection:   nil,
 		DataChannels:     make(map[string]*webrtc.DataChannel),
 		Room:             nil,
 	}
@@ -148,6 +148,8 @@ func handleConnect(w http.ResponseWriter, r *http.Request) {
 			handleSdpOffer(&connectedClient, message)
 		} else if message.Type == "iceCandidate" {
 			handleIceCandidate(&connectedClient, message)
+		} else if message.Type == "loopback" {
+			handleLoopback(&connectedClient, message)
 		}
 	}
 }
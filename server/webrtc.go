@@ -4,6 +4,9 @@ import (
 	"encoding/json"
 	"fmt"
 	"log"
+	"sync"
+	"sync/atomic"
+	"time"
 
 	"github.com/gorilla/websocket"
 	"github.com/pion/webrtc/v3"
@@ -34,6 +37,19 @@ type ConnectedClient struct {
 	PeerConnection   *webrtc.PeerConnection
 	DataChannels     map[string]*webrtc.DataChannel
 	Room             *Room
+	// Send the client's own voice back to it, for measuring the round trip. Set from the websocket
+	// goroutine and read on the data channel's.
+	Loopback atomic.Bool
+	// Candidates that arrived before the offer; only touched from the websocket goroutine.
+	PendingCandidates []webrtc.ICECandidateInit
+	// gorilla/websocket allows one writer at a time, and candidates are sent from pion's goroutines.
+	WriteMutex sync.Mutex
+}
+
+func writeMessage(client *ConnectedClient, data []byte) error {
+	client.WriteMutex.Lock()
+	defer client.WriteMutex.Unlock()
+	return client.SocketConnection.WriteMessage(websocket.TextMessage, data)
 }
 
 type SdpOffer struct {
@@ -65,6 +81,7 @@ func handleSdpOffer(client *ConnectedClient, message WebSocketMessage) {
 	}
 
 	client.PeerConnection = peerConnection
+	setupStarted := time.Now()
 
 	remoteOffer := webrtc.SessionDescription{
 		Type: webrtc.SDPTypeOffer,
@@ -77,12 +94,31 @@ func handleSdpOffer(client *ConnectedClient, message WebSocketMessage) {
 		return
 	}
 
+	for _, candidate := range client.PendingCandidates {
+		if err := peerConnection.AddICECandidate(candidate); err != nil {
+			log.Println("Error adding queued ice candidate", err)
+		}
+	}
+	client.PendingCandidates = nil
+
 	answer, err := peerConnection.CreateAnswer(nil)
 	if err != nil {
 		log.Println("Error creating answer", err)
 		return
 	}
 
+	// Registered before SetLocalDescription starts gathering, so no candidate is missed. Candidates may reach
+	// the client ahead of the answer; it holds them until the answer is applied.
+	peerConnection.OnICECandidate(func(candidate *webrtc.ICECandidate) {
+		if candidate == nil {
+			log.Println("ICE candidate gathering complete after", time.Since(setupStarted))
+			sendEndOfCandidates(client)
+			return
+		}
+
+		sendICECandidate(client, candidate)
+	})
+
 	err = peerConnection.SetLocalDescription(answer)
 	if err != nil {
 		log.Println("Error setting local description", err)
@@ -98,7 +134,7 @@ func handleSdpOffer(client *ConnectedClient, message WebSocketMessage) {
 		return
 	}
 
-	err = client.SocketConnection.WriteMessage(websocket.TextMessage, jsonData)
+	err = writeMessage(client, jsonData)
 	if err != nil {
 		log.Println("Error sending SDP answer", err)
 		return
@@ -106,6 +142,9 @@ func handleSdpOffer(client *ConnectedClient, message WebSocketMessage) {
 
 	peerConnection.OnConnectionStateChange(func(state webrtc.PeerConnectionState) {
 		log.Println("Connection state changed", state)
+		if state == webrtc.PeerConnectionStateConnected {
+			log.Println("Connection setup for client", client.Id, "took", time.Since(setupStarted))
+		}
 		if state == webrtc.PeerConnectionStateDisconnected {
 			onClientDisconnect(client)
 		}
@@ -121,14 +160,18 @@ func handleSdpOffer(client *ConnectedClient, message WebSocketMessage) {
 			dataChannel.OnMessage(func(msg webrtc.DataChannelMessage) {
 				//log.Println(fmt.Sprintf("Message received on voip data channel of size %d", len(msg.Data)))
 
-				for _, client := range client.Room.ConnectedClients {
-					channel := client.DataChannels["voip"]
+				for _, peer := range client.Room.ConnectedClients {
+					if peer == client && !client.Loopback.Load() {
+						continue
+					}
+
+					channel := peer.DataChannels["voip"]
 
 					if channel == nil {
 						continue
 					}
 
-					err := client.DataChannels["voip"].Send(msg.Data)
+					err := channel.Send(msg.Data)
 					if err != nil {
 						log.Println("Error sending voice packet", err)
 						return
@@ -137,15 +180,12 @@ func handleSdpOffer(client *ConnectedClient, message WebSocketMessage) {
 			})
 		}
 	})
+}
 
-	peerConnection.OnICECandidate(func(candidate *webrtc.ICECandidate) {
-		if candidate == nil {
-			log.Println("ICE candidate gathering complete")
-			return
-		}
-
-		sendICECandidate(client, candidate)
-	})
+func handleLoopback(client *ConnectedClient, message WebSocketMessage) {
+	enabled := message.Data == "on"
+	client.Loopback.Store(enabled)
+	log.Println("Loopback for client", client.Id, "set to", enabled)
 }
 
 func onClientDisconnect(client *ConnectedClient) {
@@ -158,7 +198,7 @@ func onClientDisconnect(client *ConnectedClient) {
 
 	for _, peerClient := range client.Room.ConnectedClients {
 		if peerClient.SocketConnection != nil {
-			peerClient.SocketConnection.WriteMessage(websocket.TextMessage, []byte(fmt.Sprintf("{\"type\": \"clientDisconnected\", \"data\": \"%s\"}", client.Id)))
+			writeMessage(peerClient, []byte(fmt.Sprintf("{\"type\": \"clientDisconnected\", \"data\": \"%s\"}", client.Id)))
 		}
 	}
 
@@ -214,7 +254,24 @@ func sendICECandidate(client *ConnectedClient, candidate *webrtc.ICECandidate) {
 		return
 	}
 
-	client.SocketConnection.WriteMessage(websocket.TextMessage, iceCandidateJson)
+	writeMessage(client, iceCandidateJson)
+}
+
+// An empty candidate tells the client no more candidates are coming.
+func sendEndOfCandidates(client *ConnectedClient) {
+	endOfCandidates, err := json.Marshal(webrtc.ICECandidateInit{Candidate: ""})
+	if err != nil {
+		log.Println("Error marshalling end of candidates", err)
+		return
+	}
+
+	message, err := json.Marshal(map[string]string{"type": "iceCandidate", "data": string(endOfCandidates)})
+	if err != nil {
+		log.Println("Error marshalling end of candidates", err)
+		return
+	}
+
+	writeMessage(client, message)
 }
 
 func handleIceCandidate(client *ConnectedClient, message WebSocketMessage) {
@@ -226,9 +283,10 @@ func handleIceCandidate(client *ConnectedClient, message WebSocketMessage) {
 		return
 	}
 
+	// Trickled candidates can overtake the offer; keep them until it is applied.
 	peerConnection := client.PeerConnection
-	if peerConnection == nil {
-		log.Println("No peer connection found for client", client.Id)
+	if peerConnection == nil || peerConnection.RemoteDescription() == nil {
+		client.PendingCandidates = append(client.PendingCandidates, iceCandidate)
 		return
 	}
 
@@ -1,115 +1,1045 @@
-//#include <rnnoise.h>
 #include <portaudio.h>
 #include <opus/opus.h>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <random>
+#include <cmath>
 
 #include "audio_capture.h"
 #include "common.h"
+#include "spsc_ring.h"
+#include "speaker_mixer.h"
+#include "voip_packet.h"
+#include "echo_canceller.h"
+#include "device_switch.h"
+#include "listener_set.h"
+#include "echo_reference.h"
+#include "resampler.h"
+#include "reblocker.h"
+#include "latency_tracker.h"
+#include "level_meter.h"
+#include "metrics.h"
 #include "plugins/audio_processor.h"
 #include "plugins/noise_gate_plugin.h"
 #include "plugins/high_pass_plugin.h"
+#include "plugins/static_audio_chain.h"
+#include "plugins/agc_plugin.h"
+#include "plugins/rnnoise_plugin.h"
 
 namespace audio_capture {
-	PaStream* input_stream;
-	PaStream* output_stream;
-	OpusEncoder* encoder;
-	OpusDecoder* decoder;
-//	DenoiseState* rnnoise;
-//	RNNModel* rnnoise_model;
+	OpusEncoder* encoder = nullptr;
+#if defined(SPEAKLY_WITH_RNNOISE)
+	std::shared_ptr<RnnoisePlugin> denoiser;
+	constexpr auto RNNOISE_MODEL_PATH = "./rnnoise_model.rnnn";
+	// Share of a 10ms frame the denoiser may take before it bypasses itself.
+	constexpr double RNNOISE_BUDGET_US = 3000.0;
+#endif
 
 	std::shared_ptr<AudioProcessor> audio_processor;
+	using CaptureChain = StaticAudioChain<HighPassPlugin, NoiseGatePlugin, AgcPlugin>;
+	std::shared_ptr<CaptureChain> capture_chain;
+	// The microphone as captured, before echo cancellation and the gate; the AGC meters what the gate lets through.
+	std::atomic<float> raw_peak_db{ -120.0f };
+	std::atomic<float> raw_rms_db{ -120.0f };
+	// Below the voice band; removes handling noise, desk thumps and DC.
+	constexpr float HIGH_PASS_CUTOFF_HZ = 80.0f;
 
-	std::vector<std::shared_ptr<RawListener>> raw_listeners;
-	std::vector<std::shared_ptr<RawListener>> processed_listeners;
-	std::vector<std::shared_ptr<EncodedListener>> encoded_listeners;
+	// Notified from whichever thread runs the send path; attaching never blocks it.
+	ListenerSet<RawListener> raw_listeners;
+	ListenerSet<ProcessedListener> processed_listeners;
+	ListenerSet<EncodedListener> encoded_listeners;
 
-	int encode_audio(float* input_buffer, unsigned char* output_buffer) {
-		return opus_encode_float(encoder, input_buffer, FRAME_SIZE, output_buffer, MAX_ENCODED_BUFFER_SIZE);
+	// Roughly 170ms of mono audio at 48kHz, enough to ride out a stalled encoder thread.
+	constexpr size_t CAPTURE_RING_SIZE = 8192;
+
+	// Only changes while no input stream is open, so the callback never sees it flip mid-stream.
+	std::atomic<CaptureMode> capture_mode{ CaptureMode::ENCODER_THREAD };
+	SpscRing<float> capture_ring(CAPTURE_RING_SIZE);
+	// Turn capture delivered in arbitrary block sizes into FRAME_SIZE frames, with the echo reference in lockstep.
+	Reblocker capture_reblocker(FRAME_SIZE);
+	Reblocker reference_reblocker(FRAME_SIZE);
+	// When each block handed to the send path was captured, keyed by its first sample, so frames can be timed
+	// from the ADC onwards. Written by the active input callback, read wherever frames are processed.
+	struct CaptureStamp {
+		uint64_t first_sample;
+		int64_t capture_ns;
+	};
+	SpscRing<CaptureStamp> capture_stamps(256);
+	uint64_t captured_samples = 0;
+	uint64_t processed_samples = 0;
+	CaptureStamp current_capture_stamp{ 0, 0 };
+	CaptureStamp next_capture_stamp{ 0, 0 };
+	bool have_next_capture_stamp = false;
+	// Capture time of the first frame in the packet being accumulated, and when that frame was processed.
+	int64_t packet_capture_ns = 0;
+	int64_t packet_processed_ns = 0;
+	std::thread encoder_thread;
+	std::atomic<bool> encoder_running{ false };
+	std::mutex encoder_mutex;
+	std::condition_variable encoder_cv;
+
+	std::unique_ptr<SpeakerMixer> speaker_mixer;
+	std::thread playout_thread;
+	std::atomic<bool> playout_running{ false };
+	std::mutex playout_mutex;
+	std::condition_variable playout_cv;
+
+	// The playout thread keeps this many mixed samples queued ahead of the output callback, counted at SAMPLE_RATE.
+	constexpr size_t PLAYBACK_TARGET_DEPTH = 2 * BUFFER_SIZE;
+	constexpr size_t PLAYBACK_RING_SIZE = 4096;
+	// Largest request the output callback has made, converted to SAMPLE_RATE. A host that pulls more than the
+	// target depth at once would otherwise underrun every time, so the playout thread keeps at least this much
+	// plus a frame queued.
+	std::atomic<size_t> playback_callback_samples{ 0 };
+	constexpr size_t REFERENCE_CHUNK_SIZE = 1024;
+
+	// Streams run at the devices' native rates; everything between the callbacks runs at SAMPLE_RATE.
+	// During a device switch the old and new streams run side by side, so everything tied to one device lives
+	// in its own stream object and is handed to the callback as user data. A resampler only exists when the
+	// device rate differs.
+	struct InputDeviceStream {
+		PaStream* stream = NULL;
+		PaDeviceIndex device = paNoDevice;
+		int rate = SAMPLE_RATE;
+		std::unique_ptr<Resampler> resampler;
+		// Largest device-rate callback that fits resampled once converted.
+		size_t max_frames = CAPTURE_RING_SIZE;
+		float resampled[CAPTURE_RING_SIZE];
+		float faded[CAPTURE_RING_SIZE];
+		// Filled while the stream waits to take over; the outgoing stream cross-fades into it.
+		SpscRing<float> staging{ CAPTURE_RING_SIZE };
+	};
+
+	struct OutputDeviceStream {
+		PaStream* stream = NULL;
+		PaDeviceIndex device = paNoDevice;
+		int rate = SAMPLE_RATE;
+		std::unique_ptr<Resampler> resampler;
+		// Brings what the device played back to SAMPLE_RATE for the echo canceller.
+		std::unique_ptr<Resampler> reference_resampler;
+		// Resampled output left over from the last callback.
+		std::vector<float> pending;
+		size_t pending_offset = 0;
+		size_t pending_count = 0;
+		std::vector<float> reference_resampled;
+		// Set by the callback once the device is pulling audio; the outgoing stream waits for it.
+		std::atomic<bool> running{ false };
+		bool fade_in = false;
+	};
+
+	// Owned by whoever holds device_mutex. The callbacks only see the raw pointers below: the active stream
+	// feeds the capture path or drains the playback ring, a pending one is warming up to replace it.
+	std::mutex device_mutex;
+	std::unique_ptr<InputDeviceStream> input_device;
+	std::unique_ptr<OutputDeviceStream> output_device;
+	std::atomic<InputDeviceStream*> active_input{ nullptr };
+	std::atomic<InputDeviceStream*> pending_input{ nullptr };
+	std::atomic<OutputDeviceStream*> active_output{ nullptr };
+	std::atomic<OutputDeviceStream*> pending_output{ nullptr };
+
+	SpscRing<float> playback_ring(PLAYBACK_RING_SIZE);
+	// When each mixed frame entered the playback ring, keyed by ring position, so the output callback can time
+	// it to the DAC. capture_ns is set for our own looped-back audio.
+	struct PlayoutStamp {
+		uint64_t position;
+		int64_t mixed_ns;
+		int64_t capture_ns;
+	};
+	SpscRing<PlayoutStamp> playout_stamps(64);
+	uint64_t playback_written = 0;
+	uint64_t playback_consumed = 0;
+	PlayoutStamp next_playout_stamp{ 0, 0, 0 };
+	bool have_next_playout_stamp = false;
+	metrics::Counter& playback_underruns = metrics::counter("playback.underruns");
+	metrics::Counter& playback_underrun_samples = metrics::counter("playback.underrun_samples");
+	// Reported by the host when a callback ran too late to keep up with the device.
+	metrics::Counter& input_overflows = metrics::counter("portaudio.input_overflows");
+	metrics::Counter& output_underflows = metrics::counter("portaudio.output_underflows");
+	std::atomic<int64_t> playback_callback_worst_ns{ 0 };
+	std::atomic<int64_t> playback_callback_last_ns{ 0 };
+
+	// Longest speaker-to-microphone path the echo canceller models.
+	constexpr int ECHO_TAIL_MS = 200;
+	std::unique_ptr<EchoCanceller> echo_canceller;
+	std::atomic<bool> echo_cancellation_enabled{ true };
+	// Rendered output, handed from the output callback to the input callback aligned to capture time.
+	EchoReference echo_reference(SAMPLE_RATE, CAPTURE_RING_SIZE);
+	// Far-end samples matching capture_ring sample for sample; both are written and read in lockstep.
+	SpscRing<float> reference_ring(CAPTURE_RING_SIZE);
+	float callback_reference[CAPTURE_RING_SIZE];
+
+	// Starting point for the expected loss; without it Opus leaves in-band FEC out of the packets entirely.
+	constexpr int DEFAULT_PACKET_LOSS_PERCENT = 10;
+	constexpr int DEFAULT_COMPLEXITY = 10;
+	constexpr int DEFAULT_FRAME_DURATION_MS = FRAME_SIZE * 1000 / SAMPLE_RATE;
+	// Longest frame the encoder may be asked for (60ms); packets are built from this many processed blocks at most.
+	constexpr int MAX_ENCODE_FRAME_SAMPLES = SAMPLE_RATE * 60 / 1000;
+
+	// Requested settings may be changed from any thread; the applied copies belong to the encoding thread.
+	std::atomic<int> requested_bitrate{ BITRATE };
+	std::atomic<int> requested_complexity{ DEFAULT_COMPLEXITY };
+	std::atomic<int> requested_packet_loss_percent{ DEFAULT_PACKET_LOSS_PERCENT };
+	std::atomic<int> requested_frame_duration_ms{ DEFAULT_FRAME_DURATION_MS };
+	int applied_bitrate = BITRATE;
+	int applied_complexity = DEFAULT_COMPLEXITY;
+	int applied_packet_loss_percent = -1;
+	int encode_frame_samples = FRAME_SIZE;
+
+	float encode_accumulator[MAX_ENCODE_FRAME_SAMPLES * CHANNELS];
+	int accumulated_samples = 0;
+	bool accumulated_speech = false;
+
+	// Opus emits packets this small while in DTX; they carry nothing worth sending.
+	constexpr int DTX_PACKET_SIZE = 2;
+	// While silent, one packet still goes out this often so receivers and the SFU know the stream is alive.
+	constexpr int KEEPALIVE_SAMPLES = SAMPLE_RATE * 400 / 1000;
+
+	std::atomic<bool> voice_active{ false };
+	std::atomic<uint64_t> packets_suppressed{ 0 };
+	int samples_since_sent = KEEPALIVE_SAMPLES;
+
+	// Owned by whichever thread encodes. Packets are handed to the data channel synchronously, which copies them
+	// into its own message, so one buffer is all the send path ever needs.
+	unsigned char encode_buffer[MAX_ENCODED_BUFFER_SIZE];
+	LatencyHistogram& encode_time_us = metrics::histogram("audio.encode_us");
+	metrics::Counter& packets_received = metrics::counter("voip.packets_received");
+	metrics::Counter& bytes_received = metrics::counter("voip.bytes_received");
+	std::atomic<uint64_t> packets_encoded{ 0 };
+	std::atomic<int64_t> average_encode_ns{ 0 };
+	int samples_in_window = 0;
+	int packets_in_window = 0;
+	std::chrono::steady_clock::duration encode_time_in_window{ 0 };
+
+	uint32_t local_speaker_id = 0;
+	uint16_t send_sequence = 0;
+	uint32_t send_timestamp = 0;
+
+	// Encoder controls are applied between packets on the encoding thread, so they never race an encode and a
+	// frame-duration change never splits a packet. Nothing is restarted.
+	void apply_encoder_settings() {
+		int bitrate = requested_bitrate.load(std::memory_order_relaxed);
+		if (bitrate != applied_bitrate) {
+			opus_encoder_ctl(encoder, OPUS_SET_BITRATE(bitrate));
+			applied_bitrate = bitrate;
+		}
+
+		int complexity = requested_complexity.load(std::memory_order_relaxed);
+		if (complexity != applied_complexity) {
+			opus_encoder_ctl(encoder, OPUS_SET_COMPLEXITY(complexity));
+			applied_complexity = complexity;
+		}
+
+		int packet_loss_percent = requested_packet_loss_percent.load(std::memory_order_relaxed);
+		if (packet_loss_percent != applied_packet_loss_percent) {
+			opus_encoder_ctl(encoder, OPUS_SET_PACKET_LOSS_PERC(packet_loss_percent));
+			applied_packet_loss_percent = packet_loss_percent;
+		}
+
+		encode_frame_samples = SAMPLE_RATE / 1000 * requested_frame_duration_ms.load(std::memory_order_relaxed);
+	}
+
+	int encode_audio(const float* input_buffer, int frame_samples, unsigned char* output_buffer) {
+		return opus_encode_float(encoder, input_buffer, frame_samples, output_buffer, MAX_ENCODED_BUFFER_SIZE - VOIP_HEADER_SIZE);
+	}
+
+	void set_encoder_settings(const EncoderSettings& settings) {
+		int frame_duration_ms = settings.frame_duration_ms;
+		if (frame_duration_ms != 10 && frame_duration_ms != 20 && frame_duration_ms != 40 && frame_duration_ms != 60) {
+			frame_duration_ms = DEFAULT_FRAME_DURATION_MS;
+		}
+
+		requested_bitrate.store(settings.bitrate, std::memory_order_relaxed);
+		requested_complexity.store(std::clamp(settings.complexity, 0, 10), std::memory_order_relaxed);
+		requested_packet_loss_percent.store(std::clamp(settings.packet_loss_percent, 0, 100), std::memory_order_relaxed);
+		requested_frame_duration_ms.store(frame_duration_ms, std::memory_order_relaxed);
+	}
+
+	EncoderSettings get_encoder_settings() {
+		return EncoderSettings{
+			requested_bitrate.load(std::memory_order_relaxed),
+			requested_complexity.load(std::memory_order_relaxed),
+			requested_packet_loss_percent.load(std::memory_order_relaxed),
+			requested_frame_duration_ms.load(std::memory_order_relaxed)
+		};
 	}
 
-	int decode_audio(const unsigned char* input_buffer, int input_buffer_size, float* output_buffer) {
-		return opus_decode_float(decoder, input_buffer, input_buffer_size, output_buffer, FRAME_SIZE, 0);
+	int queue_output_audio(const std::vector<std::byte>& data) {
+		return queue_output_audio(reinterpret_cast<const unsigned char*>(data.data()), data.size());
 	}
 
-	float input_buffer[MAX_ENCODED_BUFFER_SIZE];
-	int decode_output_audio(const std::vector<std::byte>& data) {
-		if (decoder == nullptr || output_stream == nullptr) {
+	int queue_output_audio(const unsigned char data[], size_t data_size) {
+		if (speaker_mixer == nullptr) {
 			return -1;
 		}
 
-		auto* data_ptr = reinterpret_cast<const unsigned char*>(data.data());
-		size_t data_size = data.size();
+		VoipPacketView view;
+		if (!parse_voip_packet(data, data_size, view)) {
+			return -1;
+		}
 
-		//logger::Logger::get_instance().log(logger::LogLevel::L_INFO, "Received audio of size: " + std::to_string(data_size));
+		packets_received.add();
+		bytes_received.add(data_size);
 
-		int decoded_data = decode_audio(data_ptr, data_size, input_buffer);
+		const VoipPacketHeader& header = view.header;
+		const auto arrival = std::chrono::steady_clock::now();
+		// Our own packet, sent back by the server in loopback mode.
+		if (header.speaker_id == local_speaker_id) {
+			latency::loopback_arrived(header.sequence, std::chrono::duration_cast<std::chrono::nanoseconds>(arrival.time_since_epoch()).count());
+		}
 
-		PaError paError = Pa_WriteStream(output_stream, input_buffer, FRAME_SIZE);
-		if (paError != paNoError) {
-			logger::Logger::get_instance().log(logger::LogLevel::L_ERROR, std::string("Error: Pa_WriteStream() failed with ") + Pa_GetErrorText(paError));
+		if (!speaker_mixer->queue_packet(header.speaker_id, header.sequence, header.timestamp, header.flags, view.payload, view.payload_size, arrival)) {
 			return -1;
 		}
 
 		return 1;
 	}
 
-	int decode_output_audio(unsigned char data[], size_t data_size) {
-		int decoded_data = decode_audio(data, data_size, input_buffer);
+	void set_packet_loss_percent(int percent) {
+		requested_packet_loss_percent.store(std::clamp(percent, 0, 100), std::memory_order_relaxed);
+	}
 
-		PaError paError = Pa_WriteStream(output_stream, input_buffer, FRAME_SIZE);
-		if (paError != paNoError) {
-			logger::Logger::get_instance().log(logger::LogLevel::L_ERROR, std::string("Error: Pa_WriteStream() failed with ") + Pa_GetErrorText(paError));
-			return -1;
+	std::vector<SpeakerStats> get_speaker_stats() {
+		if (speaker_mixer == nullptr) {
+			return {};
 		}
+		return speaker_mixer->get_stats();
+	}
 
-		return 1;
+	size_t playout_target_depth() {
+		const size_t callback_depth = playback_callback_samples.load(std::memory_order_relaxed) + BUFFER_SIZE;
+		// Leave room for one more frame so the final write always fits.
+		return std::min(std::max(PLAYBACK_TARGET_DEPTH, callback_depth), playback_ring.capacity() - BUFFER_SIZE);
 	}
 
-	void compute_audio(float* buffer, long frame_count) {
-		unsigned char packet[MAX_ENCODED_BUFFER_SIZE];
-		//logger::Logger::get_instance().log(logger::LogLevel::L_INFO, "Audio callback called: " + std::to_string(frame_count));
+	void playout_loop() {
+		float output[BUFFER_SIZE];
 
-		float frame_in[FRAME_SIZE];
-		float frame_out[FRAME_SIZE];
-		for (int i = 0; i < frame_count / FRAME_SIZE; ++i) {
-			std::memcpy(frame_in, buffer + (i * FRAME_SIZE), FRAME_SIZE * sizeof(float));
-            std::memcpy(frame_out, frame_in, FRAME_SIZE * sizeof(float));
-			for (const auto& listener : raw_listeners) {
-				if (*listener) {
-					(*listener)(frame_in, FRAME_SIZE);
+		while (playout_running.load(std::memory_order_acquire)) {
+			// The output callback drains the ring at the device rate and wakes us, so mixing follows the device clock.
+			while (playback_ring.size() < playout_target_depth()) {
+				speaker_mixer->mix(output);
+
+				PlayoutStamp stamp{ playback_written, latency::now_ns(), 0 };
+				uint16_t sequence;
+				int64_t sent_ns;
+				if (speaker_mixer->take_tracked_packet(sequence)) {
+					latency::find_sent(sequence, stamp.capture_ns, sent_ns);
 				}
+				playout_stamps.write(&stamp, 1);
+				playback_written += playback_ring.write(output, BUFFER_SIZE);
 			}
 
-//			rnnoise_process_frame(rnnoise, frame_out, frame_in);
-			audio_processor->process_audio(frame_out, FRAME_SIZE);
+			std::unique_lock<std::mutex> lock(playout_mutex);
+			playout_cv.wait_for(lock, std::chrono::milliseconds(10), []() {
+				return !playout_running.load(std::memory_order_acquire) || playback_ring.size() < playout_target_depth();
+			});
+		}
+	}
+
+	// Fills out with sample_count device-rate samples from the playback ring and returns how many were available.
+	size_t read_playback(OutputDeviceStream& device, float* out, size_t sample_count) {
+		if (!device.resampler) {
+			const size_t read = playback_ring.read(out, sample_count);
+			playback_consumed += read;
+			return read;
+		}
 
-			for (const auto& listener : processed_listeners) {
-				if (*listener) {
-					(*listener)(frame_out, FRAME_SIZE);
+		size_t filled = 0;
+		while (filled < sample_count) {
+			if (device.pending_offset == device.pending_count) {
+				float block[BUFFER_SIZE];
+				const size_t read = playback_ring.read(block, BUFFER_SIZE);
+				if (read == 0) {
+					break;
 				}
+				playback_consumed += read;
+				device.pending_count = device.resampler->process(block, read, device.pending.data());
+				device.pending_offset = 0;
 			}
 
-			int packet_size = encode_audio(frame_out, packet);
+			const size_t count = std::min(sample_count - filled, device.pending_count - device.pending_offset);
+			std::copy(device.pending.data() + device.pending_offset, device.pending.data() + device.pending_offset + count, out + filled);
+			device.pending_offset += count;
+			filled += count;
+		}
+		return filled;
+	}
 
-			for (const auto& listener : encoded_listeners) {
-				if (*listener) {
-					(*listener)(packet, packet_size);
+	// Times every mixed frame that started playing in this callback. dac_ns is when the callback's first
+	// sample is heard; consumed_before is the ring position it came from.
+	void record_playout(int64_t dac_ns, uint64_t consumed_before) {
+		for (;;) {
+			if (!have_next_playout_stamp) {
+				if (playout_stamps.read(&next_playout_stamp, 1) == 0) {
+					return;
 				}
+				have_next_playout_stamp = true;
+			}
+			if (next_playout_stamp.position >= playback_consumed) {
+				return;
+			}
+
+			const uint64_t offset = next_playout_stamp.position > consumed_before ? next_playout_stamp.position - consumed_before : 0;
+			const int64_t heard_ns = dac_ns + static_cast<int64_t>(offset * 1000000000ull / SAMPLE_RATE);
+			latency::record(latency::Stage::PLAYOUT, heard_ns - next_playout_stamp.mixed_ns);
+			if (next_playout_stamp.capture_ns != 0) {
+				latency::record(latency::Stage::MOUTH_TO_EAR, heard_ns - next_playout_stamp.capture_ns);
 			}
+			have_next_playout_stamp = false;
 		}
 	}
 
+	// Maps a PortAudio stream time onto the steady clock, given the callback's current stream time.
+	// Some host APIs leave the stream times at zero.
+	bool has_stream_time(double stream_time, double current_time) {
+		return stream_time > 0.0 && current_time > 0.0;
+	}
+
+	int64_t stream_time_to_ns(double stream_time, double current_time, int64_t now) {
+		if (!has_stream_time(stream_time, current_time)) {
+			return now;
+		}
+		return now + static_cast<int64_t>((stream_time - current_time) * 1e9);
+	}
+
+	PaError pa_output_callback(const void* in_buffer,
+		void* output_buffer,
+		unsigned long frame_count,
+		const PaStreamCallbackTimeInfo* time_info,
+		PaStreamCallbackFlags status_flags,
+		void* user_data) {
+		auto start = std::chrono::steady_clock::now();
+		if (status_flags & paOutputUnderflow) {
+			output_underflows.add();
+		}
+
+		OutputDeviceStream* device = static_cast<OutputDeviceStream*>(user_data);
+		float* out = (float*)output_buffer;
+		const size_t sample_count = frame_count * CHANNELS;
+
+		// A stream waiting to take over plays silence and leaves the ring and the echo reference alone; one that
+		// has been replaced stops itself.
+		bool keep_running;
+		if (!device_switch::output_is_active(device, out, sample_count, active_output, pending_output, keep_running)) {
+			return keep_running ? paContinue : paComplete;
+		}
+
+		const uint64_t consumed_before = playback_consumed;
+		const size_t codec_samples = sample_count * SAMPLE_RATE / static_cast<size_t>(device->rate);
+		if (codec_samples > playback_callback_samples.load(std::memory_order_relaxed)) {
+			playback_callback_samples.store(codec_samples, std::memory_order_relaxed);
+			playout_cv.notify_one();
+		}
+		const size_t read = read_playback(*device, out, sample_count);
+		const int64_t heard_ns = stream_time_to_ns(time_info->outputBufferDacTime, time_info->currentTime, latency::now_ns());
+		int64_t dac_ns = heard_ns;
+		if (device->resampler) {
+			dac_ns += static_cast<int64_t>(device->resampler->latency_seconds() * 1e9);
+		}
+		record_playout(dac_ns, consumed_before);
+
+		// Never wait on the playout thread: whatever is missing is played as silence.
+		if (read < sample_count) {
+			std::fill(out + read, out + sample_count, 0.0f);
+			playback_underruns.add();
+			playback_underrun_samples.add(sample_count - read);
+		}
+
+		// The first block after a switch fades in; the last one before handing over fades out.
+		OutputDeviceStream* next = device_switch::fade_output(device, out, sample_count, pending_output);
+
+		// The echo canceller needs exactly what was played, silence included, stamped with when it is heard.
+		// Unstamped when the host API does not report the DAC time, so the reference is not realigned on a guess.
+		const int64_t reference_ns = has_stream_time(time_info->outputBufferDacTime, time_info->currentTime) ? heard_ns : 0;
+		if (device->reference_resampler) {
+			// Resampled output lags its input by the filter delay, so it was heard that much earlier than stamped.
+			const int64_t filter_ns = static_cast<int64_t>(device->reference_resampler->latency_seconds() * 1e9);
+			for (size_t offset = 0; offset < sample_count; offset += REFERENCE_CHUNK_SIZE) {
+				const size_t count = std::min(REFERENCE_CHUNK_SIZE, sample_count - offset);
+				const size_t resampled = device->reference_resampler->process(out + offset, count, device->reference_resampled.data());
+				int64_t chunk_ns = reference_ns;
+				if (chunk_ns != 0) {
+					chunk_ns += static_cast<int64_t>(offset * 1000000000ull / static_cast<size_t>(device->rate)) - filter_ns;
+				}
+				echo_reference.push(device->reference_resampled.data(), resampled, chunk_ns);
+			}
+		}
+		else {
+			echo_reference.push(out, sample_count, reference_ns);
+		}
+
+		playout_cv.notify_one();
+
+		int64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		playback_callback_last_ns.store(elapsed, std::memory_order_relaxed);
+		if (elapsed > playback_callback_worst_ns.load(std::memory_order_relaxed)) {
+			playback_callback_worst_ns.store(elapsed, std::memory_order_relaxed);
+		}
+
+		if (next != nullptr) {
+			device_switch::complete_output_hand_over(next, active_output);
+			return paComplete;
+		}
+		return paContinue;
+	}
+
+	PlaybackStats get_playback_stats() {
+		return PlaybackStats{
+			playback_ring.size(),
+			playback_ring.high_water_mark(),
+			playback_underruns.value(),
+			playback_underrun_samples.value(),
+			playback_callback_last_ns.load(std::memory_order_relaxed) / 1000.0,
+			playback_callback_worst_ns.load(std::memory_order_relaxed) / 1000.0
+		};
+	}
+
+	void reset_playback_worst_case() {
+		playback_callback_worst_ns.store(0, std::memory_order_relaxed);
+		playback_ring.reset_high_water_mark();
+	}
+
+	void start_playout_thread() {
+		if (playout_running.exchange(true)) {
+			return;
+		}
+
+		playback_ring.clear();
+		playout_thread = std::thread(playout_loop);
+	}
+
+	void stop_playout_thread() {
+		if (!playout_running.exchange(false)) {
+			return;
+		}
+
+		playout_cv.notify_one();
+		if (playout_thread.joinable()) {
+			playout_thread.join();
+		}
+	}
+
+	void update_send_path_stats(int frame_samples) {
+		// Once a second of audio has been encoded, publish the encode cost.
+		packets_in_window++;
+		samples_in_window += frame_samples;
+		if (samples_in_window < SAMPLE_RATE) {
+			return;
+		}
+
+		auto encode_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(encode_time_in_window).count();
+		average_encode_ns.store(encode_ns / packets_in_window, std::memory_order_relaxed);
+		encode_time_in_window = std::chrono::steady_clock::duration::zero();
+
+		samples_in_window = 0;
+		packets_in_window = 0;
+	}
+
+	void encode_and_dispatch(const float* pcm, int frame_samples, bool speech) {
+		// The encoder writes the payload after the header space, then the header is filled in front of it, so
+		// the packet is never copied on our side.
+		unsigned char* packet = encode_buffer;
+
+		auto encode_start = std::chrono::steady_clock::now();
+		int payload_size = encode_audio(pcm, frame_samples, packet + VOIP_HEADER_SIZE);
+		const auto encode_end = std::chrono::steady_clock::now();
+		encode_time_in_window += encode_end - encode_start;
+		encode_time_us.record(std::chrono::duration_cast<std::chrono::microseconds>(encode_end - encode_start).count());
+		const int64_t encoded_ns = latency::now_ns();
+
+		uint32_t timestamp = send_timestamp;
+		send_timestamp += frame_samples;
+
+		if (payload_size <= 0) {
+			update_send_path_stats(frame_samples);
+			return;
+		}
+
+		packets_encoded.fetch_add(1, std::memory_order_relaxed);
+
+		// Silent frames are still encoded so the encoder state stays continuous, but only sent as an occasional
+		// keepalive. Opus DTX frames (at most two bytes) count as silent whatever the gate says.
+		samples_since_sent += frame_samples;
+		bool silent = !speech || payload_size <= DTX_PACKET_SIZE;
+		if (silent && samples_since_sent < KEEPALIVE_SAMPLES) {
+			packets_suppressed.fetch_add(1, std::memory_order_relaxed);
+			update_send_path_stats(frame_samples);
+			return;
+		}
+		samples_since_sent = 0;
+
+		VoipPacketHeader header;
+		header.version = VOIP_PACKET_VERSION;
+		header.flags = (applied_packet_loss_percent > 0 ? VOIP_FLAG_FEC : 0) | (silent ? 0 : VOIP_FLAG_VAD);
+		header.sequence = send_sequence++;
+		header.timestamp = timestamp;
+		header.speaker_id = local_speaker_id;
+		write_voip_header(packet, header);
+
+		int packet_size = static_cast<int>(VOIP_HEADER_SIZE) + payload_size;
+		encoded_listeners.notify(packet, static_cast<size_t>(packet_size));
+
+		// Only packets that went out are timed; the listeners hand them to the data channel synchronously.
+		const int64_t sent_ns = latency::now_ns();
+		latency::record(latency::Stage::PACKETIZE, encoded_ns - packet_processed_ns);
+		latency::record(latency::Stage::SEND, sent_ns - encoded_ns);
+		latency::packet_sent(header.sequence, packet_capture_ns, sent_ns);
+
+		update_send_path_stats(frame_samples);
+	}
+
+	// Capture time of the sample at position in the send path, from the stamps the input callback left.
+	int64_t capture_time_ns(uint64_t position) {
+		for (;;) {
+			if (!have_next_capture_stamp) {
+				if (capture_stamps.read(&next_capture_stamp, 1) == 0) {
+					break;
+				}
+				have_next_capture_stamp = true;
+			}
+			if (next_capture_stamp.first_sample > position) {
+				break;
+			}
+			current_capture_stamp = next_capture_stamp;
+			have_next_capture_stamp = false;
+		}
+		const uint64_t offset = position >= current_capture_stamp.first_sample ? position - current_capture_stamp.first_sample : 0;
+		return current_capture_stamp.capture_ns + static_cast<int64_t>(offset * 1000000000ull / SAMPLE_RATE);
+	}
+
+	// One FRAME_SIZE block through the whole send chain. reference holds the far-end samples rendered
+	// while frame was captured, or is null.
+	void process_frame(const float* frame, const float* reference) {
+		const int64_t capture_ns = capture_time_ns(processed_samples);
+		processed_samples += FRAME_SIZE;
+
+		float frame_out[FRAME_SIZE];
+		std::memcpy(frame_out, frame, FRAME_SIZE * sizeof(float));
+		raw_listeners.notify(frame, static_cast<size_t>(FRAME_SIZE));
+
+		const level_meter::Level raw_level = level_meter::measure(frame, FRAME_SIZE);
+		raw_peak_db.store(level_meter::to_db(raw_level.peak), std::memory_order_relaxed);
+		raw_rms_db.store(level_meter::to_db(std::sqrt(raw_level.mean_square)), std::memory_order_relaxed);
+
+		// Echo goes first: every later stage is nonlinear and would break the echo path model.
+		if (reference != nullptr && echo_cancellation_enabled.load(std::memory_order_relaxed)) {
+			echo_canceller->process(frame_out, reference);
+		}
+
+		// Runtime plugins (the denoiser) first, then the fixed chain, called directly rather than through the
+		// processor's virtual dispatch.
+		audio_processor->process_audio(frame_out, FRAME_SIZE);
+		capture_chain->process(frame_out, FRAME_SIZE);
+		const VoiceActivity chain_activity = capture_chain->voice_activity();
+		const VoiceActivity plugin_activity = audio_processor->voice_activity();
+		bool speech = chain_activity == VoiceActivity::SPEECH || plugin_activity == VoiceActivity::SPEECH
+			|| (chain_activity != VoiceActivity::SILENCE && plugin_activity != VoiceActivity::SILENCE);
+		const int64_t processed_ns = latency::now_ns();
+		latency::record(latency::Stage::CAPTURE, processed_ns - capture_ns);
+		voice_active.store(speech, std::memory_order_relaxed);
+
+		processed_listeners.notify(frame_out, static_cast<size_t>(FRAME_SIZE));
+
+		// Processing always runs in FRAME_SIZE blocks; the encoder may take several of them per packet.
+		if (accumulated_samples == 0) {
+			apply_encoder_settings();
+			accumulated_speech = false;
+			packet_capture_ns = capture_ns;
+			packet_processed_ns = processed_ns;
+		}
+		accumulated_speech = accumulated_speech || speech;
+
+		std::memcpy(encode_accumulator + accumulated_samples * CHANNELS, frame_out, BUFFER_SIZE * sizeof(float));
+		accumulated_samples += FRAME_SIZE;
+
+		if (accumulated_samples >= encode_frame_samples) {
+			encode_and_dispatch(encode_accumulator, accumulated_samples, accumulated_speech);
+			accumulated_samples = 0;
+		}
+	}
+
+	// Accepts captured audio in blocks of any size. Whole frames are processed straight from buffer; a
+	// partial frame waits in the reblockers for the next call, so no sample is dropped.
+	void compute_audio(const float* buffer, const float* reference, long frame_count) {
+		size_t offset = 0;
+		const size_t count = frame_count > 0 ? static_cast<size_t>(frame_count) : 0;
+
+		while (offset < count) {
+			if (capture_reblocker.empty() && count - offset >= FRAME_SIZE) {
+				process_frame(buffer + offset, reference != nullptr ? reference + offset : nullptr);
+				offset += FRAME_SIZE;
+				continue;
+			}
+
+			const size_t taken = capture_reblocker.write(buffer + offset, count - offset);
+			if (reference != nullptr) {
+				reference_reblocker.write(reference + offset, taken);
+			}
+			else {
+				reference_reblocker.write_silence(taken);
+			}
+			offset += taken;
+
+			if (capture_reblocker.full()) {
+				process_frame(capture_reblocker.frame(), reference != nullptr ? reference_reblocker.frame() : nullptr);
+				capture_reblocker.clear();
+				reference_reblocker.clear();
+			}
+		}
+	}
+
+	SendPathStats get_send_path_stats() {
+		return SendPathStats{
+			packets_encoded.load(std::memory_order_relaxed),
+			average_encode_ns.load(std::memory_order_relaxed) / 1000.0,
+			packets_suppressed.load(std::memory_order_relaxed)
+		};
+	}
+
+	bool is_voice_active() {
+		return voice_active.load(std::memory_order_relaxed);
+	}
+
+	// Hands one block of captured audio at SAMPLE_RATE to the send path. Only the active input stream calls this.
+	// capture_ns is when samples[0] was recorded, on the steady clock. It falls back to the callback time
+	// when the host API does not report the ADC time; timed says which.
+	void deliver_capture(const float* samples, size_t sample_count, int64_t capture_ns, bool timed) {
+		// Pulled here, where the capture timestamp is known, even when the echo canceller runs on the encoder thread.
+		echo_reference.pull(callback_reference, sample_count, timed ? capture_ns : 0);
+
+		// Stamped before the samples are queued so a frame never finds its stamp missing.
+		const CaptureStamp stamp{ captured_samples, capture_ns };
+		capture_stamps.write(&stamp, 1);
+
+		if (capture_mode.load(std::memory_order_relaxed) == CaptureMode::IN_CALLBACK) {
+			captured_samples += sample_count;
+			compute_audio(samples, callback_reference, static_cast<long>(sample_count));
+			return;
+		}
+
+		const size_t written = capture_ring.write(samples, sample_count);
+		reference_ring.write(callback_reference, written);
+		captured_samples += written;
+		encoder_cv.notify_one();
+	}
+
 	PaError pa_stream_callback(const void*in_buffer,
 		void* output_buffer,
 		unsigned long frame_count,
 		const PaStreamCallbackTimeInfo* time_info,
 		PaStreamCallbackFlags status_flags,
 		void* user_data) {
+		if (status_flags & paInputOverflow) {
+			input_overflows.add();
+		}
+
+		InputDeviceStream* device = static_cast<InputDeviceStream*>(user_data);
+		const float* in = (const float*)in_buffer;
+		size_t sample_count = std::min(static_cast<size_t>(frame_count), device->max_frames);
+		double adc_time = time_info->inputBufferAdcTime;
+
+		if (device->resampler) {
+			sample_count = device->resampler->process(in, sample_count, device->resampled);
+			in = device->resampled;
+			if (adc_time > 0.0) {
+				adc_time -= device->resampler->latency_seconds();
+			}
+		}
+		const int64_t capture_ns = stream_time_to_ns(adc_time, time_info->currentTime, latency::now_ns());
+		const bool timed = has_stream_time(adc_time, time_info->currentTime);
+
+		// A stream waiting to take over only stages what it captures; one that has been replaced stops itself.
+		const bool keep_running = device_switch::route_capture(device, in, sample_count, active_input, pending_input,
+			[capture_ns, timed](const float* samples, size_t count, size_t lead) {
+				deliver_capture(samples, count, capture_ns - static_cast<int64_t>(lead * 1000000000ull / SAMPLE_RATE), timed);
+			});
+		return keep_running ? paContinue : paComplete;
+	}
+
+	void encoder_loop() {
+		float frame[FRAME_SIZE];
+		float reference[FRAME_SIZE];
+
+		while (encoder_running.load(std::memory_order_acquire)) {
+			while (capture_ring.size() >= FRAME_SIZE) {
+				capture_ring.read(frame, FRAME_SIZE);
+				reference_ring.read(reference, FRAME_SIZE);
+				compute_audio(frame, reference, FRAME_SIZE);
+			}
+
+			// The callback notifies without holding the lock, so a wakeup can be missed; the timeout bounds that.
+			std::unique_lock<std::mutex> lock(encoder_mutex);
+			encoder_cv.wait_for(lock, std::chrono::milliseconds(10), []() {
+				return !encoder_running.load(std::memory_order_acquire) || capture_ring.size() >= FRAME_SIZE;
+			});
+		}
+	}
+
+	void start_encoder_thread() {
+		if (encoder_running.exchange(true)) {
+			return;
+		}
+
+		capture_ring.clear();
+		reference_ring.clear();
+		encoder_thread = std::thread(encoder_loop);
+	}
+
+	void stop_encoder_thread() {
+		if (!encoder_running.exchange(false)) {
+			return;
+		}
+
+		encoder_cv.notify_one();
+		if (encoder_thread.joinable()) {
+			encoder_thread.join();
+		}
+	}
+
+	InputLevels get_input_levels() {
+		if (!capture_chain) {
+			return InputLevels{ -120.0f, -120.0f, -120.0f, -120.0f, 0.0f };
+		}
+		AgcLevels levels = capture_chain->get<2>().get_levels();
+		return InputLevels{ raw_peak_db.load(std::memory_order_relaxed), raw_rms_db.load(std::memory_order_relaxed), levels.output_peak_db,
+			levels.output_rms_db, levels.gain_db };
+	}
+
+	void set_target_loudness(double target_db) {
+		if (capture_chain) {
+			capture_chain->get<2>().set_target_loudness(target_db);
+		}
+	}
+
+	void set_echo_cancellation(bool enabled) {
+		echo_cancellation_enabled.store(enabled, std::memory_order_relaxed);
+	}
+
+	EchoCancellationStats get_echo_cancellation_stats() {
+		EchoCancellationStats stats{};
+		stats.enabled = echo_cancellation_enabled.load(std::memory_order_relaxed);
+		if (echo_canceller) {
+			EchoCancellerStats canceller_stats = echo_canceller->get_stats();
+			stats.erle_db = canceller_stats.erle_db;
+			stats.far_end_active = canceller_stats.far_end_active;
+			stats.double_talk = canceller_stats.double_talk;
+			stats.filter_resets = canceller_stats.resets;
+		}
+		stats.reference_realignments = echo_reference.realignments();
+		stats.reference_underrun_samples = echo_reference.underruns();
+		return stats;
+	}
 
-		float* in = (float*)in_buffer;
+	DenoiserStats get_denoiser_stats() {
+		DenoiserStats stats{};
+#if defined(SPEAKLY_WITH_RNNOISE)
+		if (denoiser) {
+			RnnoiseStats rnnoise_stats = denoiser->get_stats();
+			stats.available = true;
+			stats.bypassed = rnnoise_stats.bypassed;
+			stats.vad_probability = rnnoise_stats.vad_probability;
+			stats.bypass_count = rnnoise_stats.bypass_count;
+			stats.average_process_us = rnnoise_stats.average_process_us;
+		}
+#endif
+		return stats;
+	}
+
+	bool set_capture_mode(CaptureMode mode) {
+		// Holding the lock keeps a stream from being opened while the encoder thread is started or stopped.
+		std::lock_guard<std::mutex> lock(device_mutex);
+		if (input_device != nullptr) {
+			logger::Logger::get_instance().log(logger::LogLevel::L_WARNING, "Capture mode can only change while no input stream is open");
+			return false;
+		}
+
+		capture_mode.store(mode, std::memory_order_relaxed);
+		// Once init() has run, the encoder thread follows the mode; before that, init() starts it.
+		if (mode == CaptureMode::IN_CALLBACK) {
+			stop_encoder_thread();
+		}
+		else if (encoder != nullptr) {
+			start_encoder_thread();
+		}
+		return true;
+	}
 
-		compute_audio(in, frame_count);
+	CaptureMode get_capture_mode() {
+		return capture_mode.load(std::memory_order_relaxed);
+	}
 
-		return 0;
+	CaptureRingStats get_capture_ring_stats() {
+		return CaptureRingStats{
+			capture_ring.size(),
+			capture_ring.high_water_mark(),
+			capture_ring.capacity(),
+			capture_ring.overruns()
+		};
+	}
+
+	// Opens a mono stream on device at its native rate, falling back to SAMPLE_RATE if the host refuses it.
+	// opened_rate receives the rate actually used.
+	PaError open_device_stream(PaStream** stream, PaDeviceIndex device, bool input, PaStreamCallback* callback, void* user_data, int& opened_rate) {
+		const PaDeviceInfo* device_info = Pa_GetDeviceInfo(device);
+		if (device_info == NULL) {
+			return paInvalidDevice;
+		}
+
+		PaStreamParameters parameters;
+		parameters.device = device;
+		parameters.channelCount = CHANNELS;
+		parameters.sampleFormat = paFloat32;
+		parameters.suggestedLatency = input ? device_info->defaultLowInputLatency : device_info->defaultLowOutputLatency;
+		parameters.hostApiSpecificStreamInfo = NULL;
+
+		const PaStreamParameters* input_parameters = input ? &parameters : NULL;
+		const PaStreamParameters* output_parameters = input ? NULL : &parameters;
+
+		int native_rate = static_cast<int>(device_info->defaultSampleRate);
+		if (native_rate <= 0) {
+			native_rate = SAMPLE_RATE;
+		}
+
+		// 10ms callbacks at whichever rate the device runs.
+		PaError paError = Pa_OpenStream(stream, input_parameters, output_parameters, native_rate, native_rate / 100, paClipOff, callback, user_data);
+		if (paError == paNoError) {
+			opened_rate = native_rate;
+			return paNoError;
+		}
+
+		if (native_rate == SAMPLE_RATE) {
+			return paError;
+		}
+
+		logger::Logger::get_instance().log(logger::LogLevel::L_WARNING, std::string("Could not open ") + device_info->name + " at " + std::to_string(native_rate) +
+			" Hz (" + Pa_GetErrorText(paError) + "), trying " + std::to_string(SAMPLE_RATE) + " Hz.");
+		paError = Pa_OpenStream(stream, input_parameters, output_parameters, SAMPLE_RATE, BUFFER_SIZE, paClipOff, callback, user_data);
+		if (paError == paNoError) {
+			opened_rate = SAMPLE_RATE;
+		}
+		return paError;
+	}
+
+	// Opens device for capture with its conversion to SAMPLE_RATE. The stream is left stopped.
+	PaError open_input_device(PaDeviceIndex device, std::unique_ptr<InputDeviceStream>& opened) {
+		auto stream = std::make_unique<InputDeviceStream>();
+		stream->device = device;
+		PaError paError = open_device_stream(&stream->stream, device, true, pa_stream_callback, stream.get(), stream->rate);
+		if (paError != paNoError) {
+			return paError;
+		}
+
+		if (stream->rate != SAMPLE_RATE) {
+			stream->resampler = std::make_unique<Resampler>(stream->rate, SAMPLE_RATE);
+		}
+		// Half the scratch buffer leaves room for the resampler's rounding.
+		stream->max_frames = std::min(CAPTURE_RING_SIZE, (CAPTURE_RING_SIZE / 2) * static_cast<size_t>(stream->rate) / SAMPLE_RATE);
+
+		logger::Logger::get_instance().log(logger::LogLevel::L_INFO, std::string("Input device ") + Pa_GetDeviceInfo(device)->name + " at " +
+			std::to_string(stream->rate) + " Hz.");
+		opened = std::move(stream);
+		return paNoError;
+	}
+
+	// Opens device for playback with its conversions from and back to SAMPLE_RATE. The stream is left stopped.
+	PaError open_output_device(PaDeviceIndex device, std::unique_ptr<OutputDeviceStream>& opened) {
+		auto stream = std::make_unique<OutputDeviceStream>();
+		stream->device = device;
+		PaError paError = open_device_stream(&stream->stream, device, false, pa_output_callback, stream.get(), stream->rate);
+		if (paError != paNoError) {
+			return paError;
+		}
+
+		if (stream->rate != SAMPLE_RATE) {
+			stream->resampler = std::make_unique<Resampler>(SAMPLE_RATE, stream->rate);
+			stream->reference_resampler = std::make_unique<Resampler>(stream->rate, SAMPLE_RATE);
+			stream->pending.assign(stream->resampler->max_output(BUFFER_SIZE), 0.0f);
+			stream->reference_resampled.assign(stream->reference_resampler->max_output(REFERENCE_CHUNK_SIZE), 0.0f);
+		}
+
+		logger::Logger::get_instance().log(logger::LogLevel::L_INFO, std::string("Output device ") + Pa_GetDeviceInfo(device)->name + " at " +
+			std::to_string(stream->rate) + " Hz.");
+		opened = std::move(stream);
+		return paNoError;
+	}
+
+	// The PortAudio calls device_switch::hand_over makes.
+	struct PortAudioBackend {
+		using Error = PaError;
+		static constexpr PaError OK = paNoError;
+
+		PaError start(PaStream* stream) { return Pa_StartStream(stream); }
+		PaError stop(PaStream* stream) { return Pa_StopStream(stream); }
+		PaError abort(PaStream* stream) { return Pa_AbortStream(stream); }
+		PaError close(PaStream* stream) { return Pa_CloseStream(stream); }
+	};
+
+	// Cross-fades from current to next; encoder, jitter buffers and rings are untouched. Call with
+	// device_mutex held.
+	template <typename DeviceStream>
+	PaError hand_over(std::unique_ptr<DeviceStream>& current, std::unique_ptr<DeviceStream> next, std::atomic<DeviceStream*>& active,
+		std::atomic<DeviceStream*>& pending) {
+		PortAudioBackend backend;
+		const device_switch::Result<PaError> result = device_switch::hand_over(backend, current, std::move(next), active, pending);
+		if (result.error == paNoError && !result.cross_faded) {
+			logger::Logger::get_instance().log(logger::LogLevel::L_WARNING, "Previous audio device stopped responding; switched without a cross-fade.");
+		}
+		return result.error;
+	}
+
+	PaError change_input_device(PaDeviceIndex device) {
+		std::lock_guard<std::mutex> lock(device_mutex);
+		if (!input_device) {
+			return paNotInitialized;
+		}
+		if (input_device->device == device) {
+			return paNoError;
+		}
+
+		std::unique_ptr<InputDeviceStream> next;
+		PaError paError = open_input_device(device, next);
+		if (paError != paNoError) {
+			return paError;
+		}
+		return hand_over(input_device, std::move(next), active_input, pending_input);
+	}
+
+	PaError change_output_device(PaDeviceIndex device) {
+		std::lock_guard<std::mutex> lock(device_mutex);
+		if (!output_device) {
+			return paNotInitialized;
+		}
+		if (output_device->device == device) {
+			return paNoError;
+		}
+
+		std::unique_ptr<OutputDeviceStream> next;
+		PaError paError = open_output_device(device, next);
+		if (paError != paNoError) {
+			return paError;
+		}
+		return hand_over(output_device, std::move(next), active_output, pending_output);
+	}
+
+	bool switch_input_device(int device) {
+		PaError paError = change_input_device(device);
+		if (paError != paNoError) {
+			logger::Logger::get_instance().log(logger::LogLevel::L_ERROR, std::string("Error: Failed to switch input device with ") + Pa_GetErrorText(paError));
+			return false;
+		}
+		return true;
+	}
+
+	bool switch_output_device(int device) {
+		PaError paError = change_output_device(device);
+		if (paError != paNoError) {
+			logger::Logger::get_instance().log(logger::LogLevel::L_ERROR, std::string("Error: Failed to switch output device with ") + Pa_GetErrorText(paError));
+			return false;
+		}
+		return true;
 	}
 
 	PaError initialize_portaudio() {
@@ -121,22 +1051,27 @@ namespace audio_capture {
 			return paError;
 		}
 
-		paError = Pa_OpenDefaultStream(&input_stream, CHANNELS, 0, paFloat32, SAMPLE_RATE, BUFFER_SIZE, pa_stream_callback, NULL);
+		std::lock_guard<std::mutex> lock(device_mutex);
+		paError = open_input_device(Pa_GetDefaultInputDevice(), input_device);
 		if (paError != paNoError) {
 			return paError;
 		}
 
-		paError = Pa_OpenDefaultStream(&output_stream, 0, CHANNELS, paFloat32, SAMPLE_RATE, BUFFER_SIZE, NULL, NULL);
+		paError = open_output_device(Pa_GetDefaultOutputDevice(), output_device);
 		if (paError != paNoError) {
 			return paError;
 		}
 
-		paError = Pa_StartStream(input_stream);
+		active_input.store(input_device.get(), std::memory_order_release);
+		active_output.store(output_device.get(), std::memory_order_release);
+		start_playout_thread();
+
+		paError = Pa_StartStream(input_device->stream);
 		if (paError != paNoError) {
 			return paError;
 		}
 
-		paError = Pa_StartStream(output_stream);
+		paError = Pa_StartStream(output_device->stream);
 		if (paError != paNoError) {
 			return paError;
 		}
@@ -144,10 +1079,57 @@ namespace audio_capture {
 		return paNoError;
 	}
 
+	StreamLatency get_stream_latency() {
+		std::lock_guard<std::mutex> lock(device_mutex);
+		StreamLatency latency{};
+		if (input_device) {
+			latency.input_rate = input_device->rate;
+			latency.capture_resampler_ms = input_device->resampler ? input_device->resampler->latency_seconds() * 1000.0 : 0.0;
+			const PaStreamInfo* input_info = Pa_GetStreamInfo(input_device->stream);
+			latency.input_device_ms = input_info != NULL ? input_info->inputLatency * 1000.0 : 0.0;
+		}
+		if (output_device) {
+			latency.output_rate = output_device->rate;
+			latency.playback_resampler_ms = output_device->resampler ? output_device->resampler->latency_seconds() * 1000.0 : 0.0;
+			const PaStreamInfo* output_info = Pa_GetStreamInfo(output_device->stream);
+			latency.output_device_ms = output_info != NULL ? output_info->outputLatency * 1000.0 : 0.0;
+		}
+		return latency;
+	}
+
+	// State that is already tracked elsewhere is read into gauges only when a snapshot is taken.
+	void register_metrics() {
+		metrics::Gauge& voice_active_gauge = metrics::gauge("capture.voice_active");
+		metrics::Gauge& capture_depth = metrics::gauge("capture.ring_depth");
+		metrics::Gauge& capture_overruns = metrics::gauge("capture.ring_overruns");
+		metrics::Gauge& playback_depth = metrics::gauge("playback.ring_depth");
+		metrics::Gauge& speakers = metrics::gauge("jitter.speakers");
+		metrics::Gauge& jitter_depth = metrics::gauge("jitter.depth_ms");
+		metrics::Gauge& jitter_target = metrics::gauge("jitter.target_ms");
+
+		metrics::add_collector([&]() {
+			voice_active_gauge.set(is_voice_active() ? 1.0 : 0.0);
+			capture_depth.set(static_cast<double>(capture_ring.size()));
+			capture_overruns.set(static_cast<double>(capture_ring.overruns()));
+			playback_depth.set(static_cast<double>(playback_ring.size()));
+
+			// The deepest speaker decides how late the mix plays.
+			const std::vector<SpeakerStats> speaker_stats = get_speaker_stats();
+			double depth_ms = 0.0;
+			double target_ms = 0.0;
+			for (const auto& speaker : speaker_stats) {
+				depth_ms = std::max(depth_ms, speaker.jitter.current_delay_ms);
+				target_ms = std::max(target_ms, speaker.jitter.target_delay_ms);
+			}
+			speakers.set(static_cast<double>(speaker_stats.size()));
+			jitter_depth.set(depth_ms);
+			jitter_target.set(target_ms);
+		});
+	}
+
 	int initialize_opus() {
 		int error;
 		encoder = opus_encoder_create(SAMPLE_RATE, CHANNELS, APPLICATION, &error);
-		decoder = opus_decoder_create(SAMPLE_RATE, CHANNELS, &error);
 
 		if (error != OPUS_OK) {
 			logger::Logger::get_instance().log(logger::LogLevel::L_ERROR, std::string("Error: Failed to initialize Opus with ") + opus_strerror(error));
@@ -155,28 +1137,49 @@ namespace audio_capture {
 		}
 
 		opus_encoder_ctl(encoder, OPUS_SET_BITRATE(BITRATE));
-		opus_encoder_ctl(encoder, OPUS_SET_COMPLEXITY(10));
+		opus_encoder_ctl(encoder, OPUS_SET_COMPLEXITY(DEFAULT_COMPLEXITY));
 		opus_encoder_ctl(encoder, OPUS_SET_SIGNAL(OPUS_SIGNAL_VOICE));
 		opus_encoder_ctl(encoder, OPUS_SET_INBAND_FEC(1));
+		opus_encoder_ctl(encoder, OPUS_SET_DTX(1));
 		opus_encoder_ctl(encoder, OPUS_SET_LSB_DEPTH(16));
 
+		speaker_mixer = std::make_unique<SpeakerMixer>(SAMPLE_RATE, CHANNELS, FRAME_SIZE);
+		speaker_mixer->set_tracked_speaker(local_speaker_id);
+
 		return OPUS_OK;
 	}
 
+	uint32_t get_local_speaker_id() {
+		return local_speaker_id;
+	}
+
 	InitializeState init() {
-//		std::string model_path = "./rnnoise_model.rnnn";
-//		if (!std::filesystem::exists(model_path)) {
-//			std::cerr << "Error: Could not find file " << model_path << std::endl;
-//			return InitializeState::INIT_ERROR;
-//		}
-//
-//		FILE* model_file = fopen(model_path.c_str(), "rb");
-//		rnnoise_model = rnnoise_model_from_file(model_file);
-//
-//		rnnoise = rnnoise_create(rnnoise_model);
+		// Random per session so a reconnecting client never inherits another speaker's decoder state.
+		std::random_device random_device;
+		local_speaker_id = random_device();
+		send_sequence = static_cast<uint16_t>(random_device());
+		send_timestamp = random_device();
+
+		static std::once_flag metrics_registered;
+		std::call_once(metrics_registered, register_metrics);
+
+		echo_canceller = std::make_unique<EchoCanceller>(SAMPLE_RATE, FRAME_SIZE, ECHO_TAIL_MS);
 		audio_processor = std::make_shared<AudioProcessor>();
-		audio_processor->add_plugin(std::make_shared<HighPassPlugin>(0.01));
-		audio_processor->add_plugin(std::make_shared<NoiseGatePlugin>());
+#if defined(SPEAKLY_WITH_RNNOISE)
+		// Denoise first so the gate decides on the cleaned signal.
+		denoiser = std::make_shared<RnnoisePlugin>(RNNOISE_MODEL_PATH, RNNOISE_BUDGET_US);
+		if (denoiser->is_loaded()) {
+			audio_processor->add_plugin(denoiser);
+		}
+		else {
+			denoiser.reset();
+		}
+#endif
+		// The default chain is fixed at compile time and runs after whatever plugins are added at runtime.
+		// The gate sits before gain control: behind the AGC it would see room noise raised toward the target
+		// level and open on it. Gated silence is below the AGC's noise floor, so the gain only adapts to what
+		// the gate lets through.
+		capture_chain = std::make_shared<CaptureChain>(HighPassPlugin(HIGH_PASS_CUTOFF_HZ, SAMPLE_RATE), NoiseGatePlugin(SAMPLE_RATE), AgcPlugin(SAMPLE_RATE));
 
 		int opus_state = initialize_opus();
 
@@ -184,6 +1187,10 @@ namespace audio_capture {
 			return InitializeState::OPUS_ERROR;
 		}
 
+		if (capture_mode.load(std::memory_order_relaxed) == CaptureMode::ENCODER_THREAD) {
+			start_encoder_thread();
+		}
+
 		PaError pa_state = initialize_portaudio();
 
 		if (pa_state != paNoError) {
@@ -193,111 +1200,129 @@ namespace audio_capture {
 		return InitializeState::INITIALIZED;
 	}
 
+	// Moves capture and playback to the devices named in the parameters; a null side keeps its device. Only the
+	// device is taken from the parameters, the streams are always opened mono at the device's native rate.
 	PaError update_stream_params(const PaStreamParameters* inputParams, const PaStreamParameters* outputParams) {
-		PaError paError;
+		PaError paError = paNoError;
 
-		if (input_stream == NULL) {
-			paError = Pa_OpenStream(&input_stream, inputParams, outputParams, SAMPLE_RATE, paFramesPerBufferUnspecified, paClipOff, NULL, NULL);
+		if (inputParams != NULL) {
+			paError = change_input_device(inputParams->device);
 			if (paError != paNoError) {
 				return paError;
 			}
-
-			paError = Pa_StartStream(input_stream);
-			if (paError != paNoError) {
-				return paError;
-			}
-
-			return paNoError;
-		}
-
-		paError = Pa_StopStream(input_stream);
-		if (paError != paNoError) {
-			return paError;
 		}
 
-		paError = Pa_CloseStream(input_stream);
-		if (paError != paNoError) {
-			return paError;
+		if (outputParams != NULL) {
+			paError = change_output_device(outputParams->device);
 		}
 
-		paError = Pa_OpenStream(&input_stream, inputParams, outputParams, SAMPLE_RATE, paFramesPerBufferUnspecified, paClipOff, NULL, NULL);
-		if (paError != paNoError) {
-			return paError;
-		}
-
-		paError = Pa_StartStream(input_stream);
-		if (paError != paNoError) {
-			return paError;
-		}
-
-		return paNoError;
+		return paError;
 	}
 
+	std::vector<AudioDevice> list_devices() {
+		PaDeviceIndex current_input = paNoDevice;
+		PaDeviceIndex current_output = paNoDevice;
+		{
+			std::lock_guard<std::mutex> lock(device_mutex);
+			current_input = input_device ? input_device->device : paNoDevice;
+			current_output = output_device ? output_device->device : paNoDevice;
+		}
 
-	void get_device_info() {
+		// Other host APIs list the same hardware again; only the default one is offered.
+		const PaHostApiIndex host_api = Pa_GetDefaultHostApi();
+		const PaHostApiInfo* host_api_info = Pa_GetHostApiInfo(host_api);
+		std::vector<AudioDevice> devices;
 		for (int i = 0; i < Pa_GetDeviceCount(); i++) {
 			const PaDeviceInfo* device_info = Pa_GetDeviceInfo(i);
-			if (device_info->hostApi != Pa_GetDefaultHostApi()) {
+			if (device_info == NULL || device_info->hostApi != host_api) {
 				continue;
 			}
-			if (device_info->maxInputChannels > 0) {
-				logger::Logger::get_instance().log(logger::LogLevel::L_INFO, std::string("Input Device: ") + device_info->name + " " + std::to_string(i));
+
+			AudioDevice device{};
+			device.index = i;
+			device.name = device_info->name;
+			device.host_api = host_api_info != NULL ? host_api_info->name : "";
+			device.max_input_channels = device_info->maxInputChannels;
+			device.max_output_channels = device_info->maxOutputChannels;
+			device.default_sample_rate = device_info->defaultSampleRate;
+			device.is_default_input = i == Pa_GetDefaultInputDevice();
+			device.is_default_output = i == Pa_GetDefaultOutputDevice();
+			device.is_current_input = i == current_input;
+			device.is_current_output = i == current_output;
+			devices.push_back(device);
+		}
+		return devices;
+	}
+
+	void get_device_info() {
+		for (const AudioDevice& device : list_devices()) {
+			if (device.max_input_channels > 0) {
+				logger::Logger::get_instance().log(logger::LogLevel::L_INFO, "Input Device: " + device.name + " " + std::to_string(device.index));
 			}
-			if (device_info->maxOutputChannels > 0) {
-				logger::Logger::get_instance().log(logger::LogLevel::L_INFO, std::string("Output Device: ") + device_info->name + " " + std::to_string(i));
+			if (device.max_output_channels > 0) {
+				logger::Logger::get_instance().log(logger::LogLevel::L_INFO, "Output Device: " + device.name + " " + std::to_string(device.index));
 			}
 		}
 	}
 
 	void attach_raw_listener(std::shared_ptr<RawListener> listener) {
-		raw_listeners.push_back(listener);
+		raw_listeners.attach(std::move(listener));
 	}
 
 	void detach_raw_listener(std::shared_ptr<RawListener> listener) {
-		auto it = std::remove(raw_listeners.begin(), raw_listeners.end(), listener);
-		if (it != raw_listeners.end()) {
-			raw_listeners.erase(it);
-		}
+		raw_listeners.detach(listener);
 	}
 
 	void attach_processed_listener(std::shared_ptr<ProcessedListener> listener) {
-		processed_listeners.push_back(listener);
+		processed_listeners.attach(std::move(listener));
 	}
 
 	void detach_processed_listener(std::shared_ptr<ProcessedListener> listener) {
-		auto it = std::remove(processed_listeners.begin(), processed_listeners.end(), listener);
-		if (it != processed_listeners.end()) {
-			processed_listeners.erase(it);
-		}
+		processed_listeners.detach(listener);
 	}
 
 	void attach_encoded_listener(std::shared_ptr<EncodedListener> listener) {
-		encoded_listeners.push_back(listener);
+		encoded_listeners.attach(std::move(listener));
 	}
 
 	void detach_encoded_listener(std::shared_ptr<EncodedListener> listener) {
-		auto it = std::remove(encoded_listeners.begin(), encoded_listeners.end(), listener);
-		if (it != encoded_listeners.end()) {
-			encoded_listeners.erase(it);
-		}
+		encoded_listeners.detach(listener);
 	}
 
 	void terminate_models() {
 		logger::Logger::get_instance().log(logger::LogLevel::L_INFO, "Terminating audio processing services.");
-//		rnnoise_destroy(rnnoise);
-//		rnnoise_model_free(rnnoise_model);
+#if defined(SPEAKLY_WITH_RNNOISE)
+		if (denoiser) {
+			audio_processor->remove_plugin(denoiser);
+			denoiser.reset();
+		}
+#endif
 	}
 
 	void terminate_opus() {
 		logger::Logger::get_instance().log(logger::LogLevel::L_INFO, "Terminating Opus.");
 		opus_encoder_destroy(encoder);
-		opus_decoder_destroy(decoder);
+		encoder = nullptr;
+		speaker_mixer.reset();
 	}
 
 	void terminate_portaudio() {
 		logger::Logger::get_instance().log(logger::LogLevel::L_INFO, "Terminating PortAudio.");
-		Pa_StopStream(input_stream);
-		Pa_CloseStream(input_stream);
+		std::lock_guard<std::mutex> lock(device_mutex);
+		if (input_device) {
+			Pa_StopStream(input_device->stream);
+			Pa_CloseStream(input_device->stream);
+		}
+		stop_encoder_thread();
+		if (output_device) {
+			Pa_StopStream(output_device->stream);
+			Pa_CloseStream(output_device->stream);
+		}
+		stop_playout_thread();
+		active_input.store(nullptr, std::memory_order_release);
+		active_output.store(nullptr, std::memory_order_release);
+		input_device.reset();
+		output_device.reset();
 		Pa_Terminate();
 	}
 }
\ No newline at end of file
@@ -1,11 +1,15 @@
 #pragma once
 
 #include <vector>
+#include <string>
 #include <functional>
 #include <memory>
 #include <cstddef>
+#include <cstdint>
 #include <opus/opus_defines.h>
 
+#include "speaker_mixer.h"
+
 constexpr auto MAX_ENCODED_BUFFER_SIZE = 4096;
 constexpr auto BITRATE = OPUS_BITRATE_MAX;
 constexpr auto FRAME_SIZE = 480;
@@ -28,16 +32,153 @@ namespace audio_capture {
 		INIT_ERROR
 	};
 
+	enum class CaptureMode {
+		// Process, encode and dispatch directly inside the PortAudio callback.
+		IN_CALLBACK,
+		// The callback only copies samples into a lock-free ring that a dedicated encoder thread drains.
+		ENCODER_THREAD
+	};
+
+	struct CaptureRingStats {
+		size_t depth;
+		size_t high_water_mark;
+		size_t capacity;
+		uint64_t overruns;
+	};
+
+	struct PlaybackStats {
+		size_t depth;
+		size_t high_water_mark;
+		uint64_t underruns;
+		uint64_t underrun_samples;
+		double last_callback_us;
+		double worst_callback_us;
+	};
+
+	struct SendPathStats {
+		uint64_t packets_encoded;
+		// Mean time spent in opus_encode_float per packet over the last second of audio.
+		double average_encode_us;
+		// Encoded packets withheld because the frame was silent; divide by packets_encoded for the suppressed share.
+		uint64_t packets_suppressed;
+	};
+
+	struct StreamLatency {
+		// Rates the devices were opened at.
+		int input_rate;
+		int output_rate;
+		// Exact group delay added converting to and from the codec rate; zero at the native rate.
+		double capture_resampler_ms;
+		double playback_resampler_ms;
+		// As reported by PortAudio for the open streams.
+		double input_device_ms;
+		double output_device_ms;
+	};
+
+	// Microphone meter readings in dBFS of the last frame. The input readings are the microphone as captured,
+	// before echo cancellation and the noise gate, so they keep moving while the gate is closed; the output
+	// readings are after gain control.
+	struct InputLevels {
+		float input_peak_db;
+		float input_rms_db;
+		float output_peak_db;
+		float output_rms_db;
+		float gain_db;
+	};
+
+	struct EchoCancellationStats {
+		bool enabled;
+		double erle_db;
+		bool far_end_active;
+		bool double_talk;
+		uint64_t filter_resets;
+		// Jumps of the far-end reference to stay aligned with the capture clock.
+		uint64_t reference_realignments;
+		uint64_t reference_underrun_samples;
+	};
+
+	struct DenoiserStats {
+		// False when the build has no RNNoise or it failed to load.
+		bool available;
+		bool bypassed;
+		// Speech probability of the last denoised frame, 0 to 1.
+		float vad_probability;
+		uint64_t bypass_count;
+		double average_process_us;
+	};
+
+	// A capture or playback device of the default host API, as offered for selection.
+	struct AudioDevice {
+		int index;
+		std::string name;
+		std::string host_api;
+		int max_input_channels;
+		int max_output_channels;
+		double default_sample_rate;
+		bool is_default_input;
+		bool is_default_output;
+		// Whether the running streams use this device.
+		bool is_current_input;
+		bool is_current_output;
+	};
+
+	struct EncoderSettings {
+		int bitrate;
+		int complexity;
+		int packet_loss_percent;
+		// 10, 20, 40 or 60.
+		int frame_duration_ms;
+	};
+
+	// Refused (returns false) while an input stream is open, so the callback and the encoder thread can never
+	// both be processing. Starts or stops the encoder thread to match.
+	bool set_capture_mode(CaptureMode mode);
+	CaptureMode get_capture_mode();
+	CaptureRingStats get_capture_ring_stats();
+
 	InitializeState init();
-	int decode_output_audio(const std::vector<std::byte>& data);
-	int decode_output_audio(unsigned char data[], size_t data_size);
+	// Queue a received packet for playout. Never blocks; decoding and playback happen on the playout thread.
+	int queue_output_audio(const std::vector<std::byte>& data);
+	int queue_output_audio(const unsigned char data[], size_t data_size);
+	std::vector<SpeakerStats> get_speaker_stats();
+	// Expected loss the encoder sizes its in-band FEC for. Safe to call from any thread.
+	void set_packet_loss_percent(int percent);
+	// Retunes the running encoder. Safe to call from any thread; takes effect at the next packet boundary.
+	void set_encoder_settings(const EncoderSettings& settings);
+	EncoderSettings get_encoder_settings();
+	PlaybackStats get_playback_stats();
+	SendPathStats get_send_path_stats();
+	// Whether the capture chain's gate/VAD considered the last processed block speech.
+	bool is_voice_active();
+
+	DenoiserStats get_denoiser_stats();
+
+	StreamLatency get_stream_latency();
+
+	// Updated every processed block; cheap enough to poll from the UI.
+	InputLevels get_input_levels();
+	// RMS level in dBFS gain control steers speech towards.
+	void set_target_loudness(double target_db);
+
+	// Echo cancellation uses the output stream as its reference; on by default.
+	void set_echo_cancellation(bool enabled);
+	EchoCancellationStats get_echo_cancellation_stats();
+	void reset_playback_worst_case();
 	void get_device_info();
+	std::vector<AudioDevice> list_devices();
+	// Move capture or playback to another device while running. The new stream is opened next to the old one and
+	// faded in over one callback; encoder and jitter buffer state carry over. Blocks until the old stream is closed.
+	bool switch_input_device(int device);
+	bool switch_output_device(int device);
 	// Destruct
 	void terminate_models();
 	void terminate_opus();
 	void terminate_portaudio();
 
-	// Attach a listener that can receive encoded audio data
+	// Speaker ID (SSRC) stamped into every outgoing voip packet header.
+	uint32_t get_local_speaker_id();
+
+	// Attach a listener that can receive encoded audio data, framed with a voip packet header
 	void attach_encoded_listener(std::shared_ptr<EncodedListener> listener);
 	void detach_encoded_listener(std::shared_ptr<EncodedListener> listener);
 
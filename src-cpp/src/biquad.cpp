@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+#include "biquad.h"
+#include "simd.h"
+
+namespace biquad {
+	static constexpr double PI = 3.14159265358979323846;
+
+	BiquadCoefficients design(BiquadType type, double sample_rate, double frequency, double q, double gain_db) {
+		frequency = std::clamp(frequency, 1.0, sample_rate * 0.49);
+		q = std::max(q, 0.01);
+
+		const double w0 = 2.0 * PI * frequency / sample_rate;
+		const double cos_w0 = std::cos(w0);
+		const double alpha = std::sin(w0) / (2.0 * q);
+		const double a = std::pow(10.0, gain_db / 40.0);
+		const double shelf = 2.0 * std::sqrt(a) * alpha;
+
+		double b0 = 1.0, b1 = 0.0, b2 = 0.0, a0 = 1.0, a1 = 0.0, a2 = 0.0;
+
+		switch (type) {
+		case BiquadType::LOW_PASS:
+			b0 = (1.0 - cos_w0) / 2.0;
+			b1 = 1.0 - cos_w0;
+			b2 = (1.0 - cos_w0) / 2.0;
+			a0 = 1.0 + alpha;
+			a1 = -2.0 * cos_w0;
+			a2 = 1.0 - alpha;
+			break;
+		case BiquadType::HIGH_PASS:
+			b0 = (1.0 + cos_w0) / 2.0;
+			b1 = -(1.0 + cos_w0);
+			b2 = (1.0 + cos_w0) / 2.0;
+			a0 = 1.0 + alpha;
+			a1 = -2.0 * cos_w0;
+			a2 = 1.0 - alpha;
+			break;
+		case BiquadType::LOW_SHELF:
+			b0 = a * ((a + 1.0) - (a - 1.0) * cos_w0 + shelf);
+			b1 = 2.0 * a * ((a - 1.0) - (a + 1.0) * cos_w0);
+			b2 = a * ((a + 1.0) - (a - 1.0) * cos_w0 - shelf);
+			a0 = (a + 1.0) + (a - 1.0) * cos_w0 + shelf;
+			a1 = -2.0 * ((a - 1.0) + (a + 1.0) * cos_w0);
+			a2 = (a + 1.0) + (a - 1.0) * cos_w0 - shelf;
+			break;
+		case BiquadType::HIGH_SHELF:
+			b0 = a * ((a + 1.0) + (a - 1.0) * cos_w0 + shelf);
+			b1 = -2.0 * a * ((a - 1.0) + (a + 1.0) * cos_w0);
+			b2 = a * ((a + 1.0) + (a - 1.0) * cos_w0 - shelf);
+			a0 = (a + 1.0) - (a - 1.0) * cos_w0 + shelf;
+			a1 = 2.0 * ((a - 1.0) - (a + 1.0) * cos_w0);
+			a2 = (a + 1.0) - (a - 1.0) * cos_w0 - shelf;
+			break;
+		case BiquadType::PEAKING:
+			b0 = 1.0 + alpha * a;
+			b1 = -2.0 * cos_w0;
+			b2 = 1.0 - alpha * a;
+			a0 = 1.0 + alpha / a;
+			a1 = -2.0 * cos_w0;
+			a2 = 1.0 - alpha / a;
+			break;
+		}
+
+		BiquadCoefficients coefficients;
+		coefficients.b0 = static_cast<float>(b0 / a0);
+		coefficients.b1 = static_cast<float>(b1 / a0);
+		coefficients.b2 = static_cast<float>(b2 / a0);
+		coefficients.a1 = static_cast<float>(a1 / a0);
+		coefficients.a2 = static_cast<float>(a2 / a0);
+		return coefficients;
+	}
+
+	double butterworth_q(int order, int section) {
+		// Pole pairs of a Butterworth filter sit at angles (2k + 1) * pi / (2 * order) from the imaginary axis.
+		const double angle = (2.0 * section + 1.0) * PI / (2.0 * order);
+		return 1.0 / (2.0 * std::sin(angle));
+	}
+}
+
+BiquadCascade::BiquadCascade() {
+	set_sections(nullptr, 0);
+}
+
+void BiquadCascade::set_sections(const BiquadCoefficients* coefficients, size_t count) {
+	count = std::min(count, MAX_BIQUAD_SECTIONS);
+	const bool reshaped = count != sections;
+	sections = count;
+
+	for (size_t i = 0; i < MAX_BIQUAD_SECTIONS; ++i) {
+		const BiquadCoefficients section = i < count ? coefficients[i] : BiquadCoefficients{};
+		b0[i] = section.b0;
+		b1[i] = section.b1;
+		b2[i] = section.b2;
+		a1[i] = section.a1;
+		a2[i] = section.a2;
+	}
+
+	if (reshaped) {
+		reset();
+	}
+}
+
+void BiquadCascade::reset() {
+	std::fill(std::begin(s1), std::end(s1), 0.0f);
+	std::fill(std::begin(s2), std::end(s2), 0.0f);
+}
+
+void BiquadCascade::process(float* buffer, size_t count) {
+	if (sections == 0) {
+		return;
+	}
+
+#if defined(SPEAKLY_HAVE_SSE)
+	// A single section gains nothing from the pipeline, and blocks shorter than it never fill it.
+	if (sections > 1 && count >= sections) {
+		switch (sections) {
+		case 2:
+			process_pipelined<2>(buffer, count);
+			return;
+		case 3:
+			process_pipelined<3>(buffer, count);
+			return;
+		default:
+			process_pipelined<MAX_BIQUAD_SECTIONS>(buffer, count);
+			return;
+		}
+	}
+#endif
+
+	process_scalar(buffer, count);
+}
+
+void BiquadCascade::process_scalar(float* buffer, size_t count) {
+	for (size_t i = 0; i < count; ++i) {
+		float sample = buffer[i];
+		for (size_t section = 0; section < sections; ++section) {
+			sample = step(section, sample);
+		}
+		buffer[i] = sample;
+	}
+}
+
+template <size_t depth>
+void BiquadCascade::process_pipelined(float* buffer, size_t count) {
+#if defined(SPEAKLY_HAVE_SSE)
+	// The pipeline is only as deep as the cascade: a sample leaves through lane depth - 1, so lanes past it
+	// cost nothing in fill, drain or latency. They still ride along in the vector step, which is four
+	// lanes wide whatever the depth; their identity coefficients keep their state at zero.
+	alignas(16) float carry[MAX_BIQUAD_SECTIONS] = {};
+
+	// Fill: at step n only lanes 0..n hold real samples.
+	for (size_t n = 0; n + 1 < depth; ++n) {
+		for (size_t section = n + 1; section-- > 0;) {
+			carry[section] = step(section, section == 0 ? buffer[n] : carry[section - 1]);
+		}
+	}
+
+	const __m128 vb0 = _mm_load_ps(b0);
+	const __m128 vb1 = _mm_load_ps(b1);
+	const __m128 vb2 = _mm_load_ps(b2);
+	const __m128 va1 = _mm_load_ps(a1);
+	const __m128 va2 = _mm_load_ps(a2);
+	__m128 vs1 = _mm_load_ps(s1);
+	__m128 vs2 = _mm_load_ps(s2);
+	__m128 output = _mm_load_ps(carry);
+
+	// Steady state: lane k filters sample n - k. The last lane's output is final and is written back
+	// depth - 1 samples behind the read position, so processing in place is safe.
+	for (size_t n = depth - 1; n < count; ++n) {
+		__m128 input = _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(output), 4));
+		input = _mm_move_ss(input, _mm_set_ss(buffer[n]));
+
+		output = _mm_add_ps(_mm_mul_ps(vb0, input), vs1);
+		vs1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(vb1, input), _mm_mul_ps(va1, output)), vs2);
+		vs2 = _mm_sub_ps(_mm_mul_ps(vb2, input), _mm_mul_ps(va2, output));
+
+		buffer[n - (depth - 1)] = _mm_cvtss_f32(_mm_shuffle_ps(output, output, _MM_SHUFFLE(depth - 1, depth - 1, depth - 1, depth - 1)));
+	}
+
+	_mm_store_ps(s1, vs1);
+	_mm_store_ps(s2, vs2);
+	_mm_store_ps(carry, output);
+
+	// Drain: lanes 1..depth - 1 still owe output for the last depth - 1 samples.
+	for (size_t n = count; n < count + depth - 1; ++n) {
+		for (size_t section = depth - 1; section > n - count; --section) {
+			carry[section] = step(section, carry[section - 1]);
+		}
+		buffer[n - (depth - 1)] = carry[depth - 1];
+	}
+#else
+	process_scalar(buffer, count);
+#endif
+}
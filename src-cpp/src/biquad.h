@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+
+// Most sections a BiquadCascade holds. Matches the SSE lane count so one vector step advances every section.
+constexpr size_t MAX_BIQUAD_SECTIONS = 4;
+
+enum class BiquadType {
+	LOW_PASS,
+	HIGH_PASS,
+	LOW_SHELF,
+	HIGH_SHELF,
+	PEAKING
+};
+
+// Normalised second-order section (a0 == 1).
+struct BiquadCoefficients {
+	float b0 = 1.0f;
+	float b1 = 0.0f;
+	float b2 = 0.0f;
+	float a1 = 0.0f;
+	float a2 = 0.0f;
+};
+
+namespace biquad {
+	// Audio EQ Cookbook designs. frequency is in Hz; gain_db only applies to the shelf and peaking types.
+	BiquadCoefficients design(BiquadType type, double sample_rate, double frequency, double q, double gain_db = 0.0);
+
+	// Q of each section of an order-th Butterworth filter built from order / 2 biquads.
+	double butterworth_q(int order, int section);
+}
+
+// Series of up to MAX_BIQUAD_SECTIONS transposed-direct-form-II biquads over a mono stream.
+//
+// With SSE each section lives in its own lane and the cascade is pipelined: at step n lane k filters
+// sample n - k, taking lane k - 1's output from the previous step as its input. The first and last
+// few samples of a block fill and drain the pipeline in scalar code, so there is no added latency
+// and the output is bit-identical to the plain per-section loop used as the fallback.
+class BiquadCascade {
+public:
+	BiquadCascade();
+
+	// Replaces the sections. Extra sections beyond MAX_BIQUAD_SECTIONS are ignored. Filter state is kept
+	// so coefficients can be retuned without a click, unless the section count changes.
+	void set_sections(const BiquadCoefficients* sections, size_t count);
+
+	void reset();
+
+	void process(float* buffer, size_t count);
+
+	size_t section_count() const { return sections; }
+
+private:
+	void process_scalar(float* buffer, size_t count);
+	// depth is the section count; the dispatch in process() picks it.
+	template <size_t depth>
+	void process_pipelined(float* buffer, size_t count);
+
+	// Advances one section by one sample and returns its output.
+	float step(size_t section, float input) {
+		float output = b0[section] * input + s1[section];
+		s1[section] = b1[section] * input - a1[section] * output + s2[section];
+		s2[section] = b2[section] * input - a2[section] * output;
+		return output;
+	}
+
+	size_t sections = 0;
+
+	// Structure-of-arrays so a whole set loads into one vector. Unused sections are identity.
+	alignas(16) float b0[MAX_BIQUAD_SECTIONS];
+	alignas(16) float b1[MAX_BIQUAD_SECTIONS];
+	alignas(16) float b2[MAX_BIQUAD_SECTIONS];
+	alignas(16) float a1[MAX_BIQUAD_SECTIONS];
+	alignas(16) float a2[MAX_BIQUAD_SECTIONS];
+	alignas(16) float s1[MAX_BIQUAD_SECTIONS];
+	alignas(16) float s2[MAX_BIQUAD_SECTIONS];
+};
@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <cmath>
+
+#include "bitrate_controller.h"
+#include "common.h"
+
+namespace {
+	constexpr int MIN_BITRATE = 12000;
+	constexpr int MAX_BITRATE = 96000;
+	constexpr int INITIAL_BITRATE = 64000;
+
+	constexpr double BACKOFF_FACTOR = 0.7;
+	constexpr double PROBE_FACTOR = 1.15;
+	// Clean intervals required before the bitrate is raised again.
+	constexpr int CLEAN_INTERVALS_BEFORE_PROBE = 3;
+
+	constexpr double HIGH_LOSS_PERCENT = 10.0;
+	constexpr double LOW_LOSS_PERCENT = 2.0;
+	constexpr double HIGH_RTT_MS = 300.0;
+	constexpr size_t CONGESTED_BUFFERED_AMOUNT = 8 * 1024;
+
+	// Encoder share of real time above which complexity is lowered, and below which it may rise.
+	constexpr double ENCODE_BUDGET_HIGH = 0.15;
+	constexpr double ENCODE_BUDGET_LOW = 0.05;
+	constexpr int MIN_COMPLEXITY = 3;
+	constexpr int MAX_COMPLEXITY = 10;
+
+	// Expected loss is never set to zero so some FEC is always there for a sudden burst.
+	constexpr int MIN_PACKET_LOSS_PERCENT = 2;
+	constexpr int MAX_PACKET_LOSS_PERCENT = 30;
+
+	constexpr int FRAME_DURATIONS_MS[] = { 10, 20, 40, 60 };
+
+	int longer_frame(int duration_ms) {
+		for (int candidate : FRAME_DURATIONS_MS) {
+			if (candidate > duration_ms) {
+				return candidate;
+			}
+		}
+		return duration_ms;
+	}
+
+	int shorter_frame(int duration_ms) {
+		int result = duration_ms;
+		for (int candidate : FRAME_DURATIONS_MS) {
+			if (candidate < duration_ms) {
+				result = candidate;
+			}
+		}
+		return result;
+	}
+}
+
+BitrateController::BitrateController() {
+	settings.bitrate = INITIAL_BITRATE;
+	settings.complexity = MAX_COMPLEXITY;
+	settings.packet_loss_percent = 10;
+	settings.frame_duration_ms = FRAME_DURATIONS_MS[0];
+}
+
+audio_capture::EncoderSettings BitrateController::update(const NetworkConditions& conditions) {
+	const audio_capture::EncoderSettings previous = settings;
+	// Static literals: the log message below queues only the pointers.
+	const char* reason = "";
+	const char* encode_reason = "";
+
+	smoothed_loss = 0.7 * smoothed_loss + 0.3 * conditions.loss_percent;
+
+	const bool congested = conditions.send_drops > 0 || conditions.buffered_amount >= CONGESTED_BUFFERED_AMOUNT;
+	const bool high_rtt = conditions.rtt_ms.has_value() && *conditions.rtt_ms >= HIGH_RTT_MS;
+
+	if (congested || smoothed_loss >= HIGH_LOSS_PERCENT) {
+		settings.bitrate = std::max(MIN_BITRATE, static_cast<int>(settings.bitrate * BACKOFF_FACTOR));
+		settings.frame_duration_ms = longer_frame(settings.frame_duration_ms);
+		clean_intervals = 0;
+		reason = congested ? ", congested" : ", high loss";
+	}
+	else if (smoothed_loss < LOW_LOSS_PERCENT && !high_rtt) {
+		if (++clean_intervals >= CLEAN_INTERVALS_BEFORE_PROBE) {
+			settings.bitrate = std::min(MAX_BITRATE, static_cast<int>(settings.bitrate * PROBE_FACTOR));
+			settings.frame_duration_ms = shorter_frame(settings.frame_duration_ms);
+			clean_intervals = 0;
+			reason = ", clean link";
+		}
+	}
+	else {
+		clean_intervals = 0;
+	}
+
+	settings.packet_loss_percent = std::clamp(static_cast<int>(std::ceil(smoothed_loss * 1.5)),
+		MIN_PACKET_LOSS_PERCENT, MAX_PACKET_LOSS_PERCENT);
+
+	// The measured encode cost belongs to packets of the previous frame duration.
+	const double frame_budget_us = previous.frame_duration_ms * 1000.0;
+	const double encode_share = conditions.average_encode_us / frame_budget_us;
+	if (encode_share > ENCODE_BUDGET_HIGH && settings.complexity > MIN_COMPLEXITY) {
+		settings.complexity--;
+		encode_reason = ", encode cost";
+	}
+	else if (encode_share > 0.0 && encode_share < ENCODE_BUDGET_LOW && settings.complexity < MAX_COMPLEXITY) {
+		settings.complexity++;
+	}
+
+	if (settings.bitrate != previous.bitrate || settings.complexity != previous.complexity ||
+		settings.packet_loss_percent != previous.packet_loss_percent || settings.frame_duration_ms != previous.frame_duration_ms) {
+		// rtt -1 when not measured yet.
+		logger::Logger::get_instance().log(logger::LogLevel::L_INFO,
+			"Bitrate controller: bitrate %d -> %d, loss%% %d -> %d, complexity %d -> %d, frame %dms -> %dms "
+			"(loss %.1f%%, rtt %dms, buffered %zuB, encode %.0fus of %.0fus%s%s)",
+			previous.bitrate, settings.bitrate, previous.packet_loss_percent, settings.packet_loss_percent,
+			previous.complexity, settings.complexity, previous.frame_duration_ms, settings.frame_duration_ms,
+			smoothed_loss, conditions.rtt_ms ? static_cast<int>(*conditions.rtt_ms) : -1, conditions.buffered_amount,
+			conditions.average_encode_us, frame_budget_us, logger::StaticText(reason), logger::StaticText(encode_reason));
+	}
+
+	return settings;
+}
+
+const audio_capture::EncoderSettings& BitrateController::get_settings() const {
+	return settings;
+}
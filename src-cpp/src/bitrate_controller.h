@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+#include "audio_capture.h"
+
+struct NetworkConditions {
+	// Share of expected packets that never arrived over the last interval, 0-100. The SFU reports nothing
+	// about what reaches it from us, so this is loss on the streams we receive from it: a proxy for our
+	// uplink that shares the access link but not the path. send_drops, buffered_amount and rtt_ms are the
+	// measurements taken on the send side itself.
+	double loss_percent;
+	std::optional<double> rtt_ms;
+	size_t buffered_amount;
+	// Frames the sender dropped during the interval because the data channel backed up.
+	uint64_t send_drops;
+	double average_encode_us;
+};
+
+// Decides encoder bitrate, expected loss, complexity and frame duration from network feedback.
+//
+// Bitrate backs off multiplicatively on loss or send-side congestion and creeps back up after
+// several clean intervals. Longer frames are used while the link is struggling to cut per-packet
+// overhead, and complexity follows the measured encode cost. Every change is logged with its reason.
+class BitrateController {
+public:
+	BitrateController();
+
+	audio_capture::EncoderSettings update(const NetworkConditions& conditions);
+
+	const audio_capture::EncoderSettings& get_settings() const;
+
+private:
+	audio_capture::EncoderSettings settings;
+	double smoothed_loss = 0.0;
+	int clean_intervals = 0;
+};
@@ -0,0 +1,69 @@
+#include <opus/opus.h>
+
+#include "decoder_pool.h"
+#include "common.h"
+
+DecoderPool::DecoderPool(int sample_rate, int channels, size_t preallocated, size_t max_decoders)
+	: sample_rate(sample_rate), channels(channels), max_decoders(max_decoders) {
+	free_decoders.reserve(max_decoders);
+
+	for (size_t i = 0; i < preallocated && i < max_decoders; ++i) {
+		OpusDecoder* decoder = create_decoder();
+		if (decoder == nullptr) {
+			break;
+		}
+		free_decoders.push_back(decoder);
+	}
+}
+
+DecoderPool::~DecoderPool() {
+	// Decoders still held by speakers are the caller's to release first.
+	for (auto* decoder : free_decoders) {
+		opus_decoder_destroy(decoder);
+	}
+}
+
+OpusDecoder* DecoderPool::acquire() {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (!free_decoders.empty()) {
+		OpusDecoder* decoder = free_decoders.back();
+		free_decoders.pop_back();
+		opus_decoder_ctl(decoder, OPUS_RESET_STATE);
+		return decoder;
+	}
+
+	if (created >= max_decoders) {
+		logger::Logger::get_instance().log(logger::LogLevel::L_WARNING, "Decoder pool exhausted at %zu decoders", max_decoders);
+		return nullptr;
+	}
+
+	return create_decoder();
+}
+
+void DecoderPool::release(OpusDecoder* decoder) {
+	if (decoder == nullptr) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	free_decoders.push_back(decoder);
+}
+
+size_t DecoderPool::in_use() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return created - free_decoders.size();
+}
+
+OpusDecoder* DecoderPool::create_decoder() {
+	int error;
+	OpusDecoder* decoder = opus_decoder_create(sample_rate, channels, &error);
+
+	if (error != OPUS_OK) {
+		logger::Logger::get_instance().log(logger::LogLevel::L_ERROR, "Error: Failed to create Opus decoder with %s", logger::StaticText(opus_strerror(error)));
+		return nullptr;
+	}
+
+	created++;
+	return decoder;
+}
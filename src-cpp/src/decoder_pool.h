@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+struct OpusDecoder;
+
+// Recycles Opus decoder instances so a speaker joining or leaving never costs a
+// create/destroy pair. Decoders are reset before being handed out again.
+class DecoderPool {
+public:
+	DecoderPool(int sample_rate, int channels, size_t preallocated, size_t max_decoders);
+	~DecoderPool();
+
+	DecoderPool(const DecoderPool&) = delete;
+	DecoderPool& operator=(const DecoderPool&) = delete;
+
+	// Returns nullptr once max_decoders are in use.
+	OpusDecoder* acquire();
+	void release(OpusDecoder* decoder);
+
+	size_t in_use() const;
+
+private:
+	OpusDecoder* create_decoder();
+
+	const int sample_rate;
+	const int channels;
+	const size_t max_decoders;
+
+	mutable std::mutex mutex;
+	std::vector<OpusDecoder*> free_decoders;
+	size_t created = 0;
+};
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <memory>
+#include <thread>
+
+// Switching a running stream to another device without a gap.
+//
+// The next stream is started alongside the current one and stands by: an input stream stages what it
+// captures, an output stream plays silence. The current stream's callback then cross-fades into it over
+// one block and makes it active. A current stream that has stopped calling back (an unplugged device) is
+// aborted after TIMEOUT and replaced outright.
+//
+// Generic over the stream type and over the backend that starts and stops streams, so tests can drive a
+// switch through a mock backend; audio_capture.cpp plugs in PortAudio. A Backend provides an Error type,
+// an OK value and start, stop, abort and close, each taking the DeviceStream's stream handle.
+namespace device_switch {
+	constexpr auto TIMEOUT = std::chrono::milliseconds(500);
+
+	// Equal-power ramp over a whole block: the two devices' signals are unrelated, so their powers add.
+	inline float fade_in_gain(size_t index, size_t count) {
+		return std::sin((static_cast<float>(index) + 0.5f) / static_cast<float>(count) * 1.5707963f);
+	}
+
+	inline float fade_out_gain(size_t index, size_t count) {
+		return std::cos((static_cast<float>(index) + 0.5f) / static_cast<float>(count) * 1.5707963f);
+	}
+
+	template <typename Error>
+	struct Result {
+		Error error;
+		// False when the current stream had stopped calling back and was aborted without a cross-fade.
+		bool cross_faded;
+	};
+
+	// Starts next alongside current and waits for current's callback to cross-fade into it and step aside.
+	// On success current is closed and replaced by next; if next fails to start it is closed and current
+	// keeps running. Not thread-safe; the caller serialises switches.
+	template <typename Backend, typename DeviceStream>
+	Result<typename Backend::Error> hand_over(Backend& backend, std::unique_ptr<DeviceStream>& current, std::unique_ptr<DeviceStream> next,
+		std::atomic<DeviceStream*>& active, std::atomic<DeviceStream*>& pending) {
+		pending.store(next.get(), std::memory_order_release);
+		const typename Backend::Error error = backend.start(next->stream);
+		if (error != Backend::OK) {
+			pending.store(nullptr, std::memory_order_release);
+			backend.close(next->stream);
+			return { error, false };
+		}
+
+		const auto deadline = std::chrono::steady_clock::now() + TIMEOUT;
+		while (active.load(std::memory_order_acquire) != next.get() && std::chrono::steady_clock::now() < deadline) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		const bool cross_faded = active.load(std::memory_order_acquire) == next.get();
+		if (cross_faded) {
+			// The callback has completed; stopping lets its faded-out last block play.
+			backend.stop(current->stream);
+		}
+		else {
+			backend.abort(current->stream);
+			active.store(next.get(), std::memory_order_release);
+		}
+		pending.store(nullptr, std::memory_order_release);
+		backend.close(current->stream);
+		current = std::move(next);
+		return { Backend::OK, cross_faded };
+	}
+
+	// The part of an input stream's callback that takes part in a switch. DeviceStream needs an SpscRing
+	// staging and a faded scratch buffer of at least sample_count samples.
+	//
+	// A stream waiting to take over only stages what it captures. The active stream passes its block on
+	// through deliver(samples, count, lead), where lead is how many samples before in the block starts;
+	// once a replacement has a block staged, it delivers the cross-fade into it instead and hands over.
+	// Returns false once the stream should stop calling back.
+	template <typename DeviceStream, typename Deliver>
+	bool route_capture(DeviceStream* device, const float* in, size_t sample_count, std::atomic<DeviceStream*>& active,
+		std::atomic<DeviceStream*>& pending, Deliver&& deliver) {
+		if (device != active.load(std::memory_order_acquire)) {
+			if (device != pending.load(std::memory_order_acquire)) {
+				return false;
+			}
+			device->staging.write(in, sample_count);
+			return true;
+		}
+
+		// Just took over: anything staged since the cross-fade directly follows the faded block.
+		if (device->staging.size() > 0) {
+			device->staging.trim(sample_count);
+			const size_t staged = device->staging.read(device->faded, sample_count);
+			deliver(device->faded, staged, staged);
+		}
+
+		// Fade into the replacement's newest block, then hand the send path over.
+		DeviceStream* next = pending.load(std::memory_order_acquire);
+		if (next != nullptr && next != device && next->staging.size() >= sample_count) {
+			next->staging.trim(sample_count);
+			next->staging.read(device->faded, sample_count);
+			for (size_t i = 0; i < sample_count; i++) {
+				device->faded[i] = in[i] * fade_out_gain(i, sample_count) + device->faded[i] * fade_in_gain(i, sample_count);
+			}
+			deliver(device->faded, sample_count, size_t{ 0 });
+
+			active.store(next, std::memory_order_release);
+			return false;
+		}
+
+		deliver(in, sample_count, size_t{ 0 });
+		return true;
+	}
+
+	// First thing in an output stream's callback; DeviceStream needs an atomic<bool> running and a bool
+	// fade_in. True when device is the active stream and should render into out. Otherwise out is filled
+	// with silence, a waiting replacement marks itself running so the active stream starts fading into it,
+	// and keep_running turns false for a stream that has been replaced.
+	template <typename DeviceStream>
+	bool output_is_active(DeviceStream* device, float* out, size_t sample_count, std::atomic<DeviceStream*>& active,
+		std::atomic<DeviceStream*>& pending, bool& keep_running) {
+		keep_running = true;
+		if (device == active.load(std::memory_order_acquire)) {
+			return true;
+		}
+
+		std::fill(out, out + sample_count, 0.0f);
+		if (device != pending.load(std::memory_order_acquire)) {
+			keep_running = false;
+			return false;
+		}
+		device->running.store(true, std::memory_order_release);
+		return false;
+	}
+
+	// After the active output stream has rendered out. The first block after taking over fades in; when a
+	// replacement is already running the block fades out and the replacement is returned. The caller
+	// finishes the callback, then passes it to complete_output_hand_over and stops calling back.
+	template <typename DeviceStream>
+	DeviceStream* fade_output(DeviceStream* device, float* out, size_t sample_count, std::atomic<DeviceStream*>& pending) {
+		if (device->fade_in) {
+			for (size_t i = 0; i < sample_count; i++) {
+				out[i] *= fade_in_gain(i, sample_count);
+			}
+			device->fade_in = false;
+		}
+
+		// pending still names a stream that has just taken over until hand_over clears it.
+		DeviceStream* next = pending.load(std::memory_order_acquire);
+		if (next == nullptr || next == device || !next->running.load(std::memory_order_acquire)) {
+			return nullptr;
+		}
+		for (size_t i = 0; i < sample_count; i++) {
+			out[i] *= fade_out_gain(i, sample_count);
+		}
+		return next;
+	}
+
+	// Everything the outgoing stream touched is published before the replacement may take over.
+	template <typename DeviceStream>
+	void complete_output_hand_over(DeviceStream* next, std::atomic<DeviceStream*>& active) {
+		next->fade_in = true;
+		active.store(next, std::memory_order_release);
+	}
+}
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <cmath>
+
+#include "echo_canceller.h"
+
+// Normalised step size; below 1 trades convergence speed for less misadjustment.
+constexpr float STEP_SIZE = 0.5f;
+// Smoothing of the per-bin far-end power used for normalisation.
+constexpr float POWER_SMOOTHING = 0.9f;
+// Far-end blocks quieter than this (mean square, about -60dBFS) carry nothing to adapt on.
+constexpr double FAR_END_ACTIVE_POWER = 1e-6;
+// Geigel double-talk detector: near-end peaks above this share of the recent far-end peak mean someone is
+// talking locally. Speaker-to-microphone paths attenuate by well over 6dB.
+constexpr float DOUBLE_TALK_RATIO = 0.5f;
+// Blocks adaptation stays frozen after double talk ends, so the filter does not learn the tail of a word.
+constexpr int DOUBLE_TALK_HOLD_BLOCKS = 5;
+// Blocks in a row where the output is louder than the microphone before the filter is thrown away.
+constexpr int DIVERGED_BLOCK_LIMIT = 10;
+// Smoothing of the energies ERLE is computed from.
+constexpr double ERLE_SMOOTHING = 0.95;
+
+// Written out because std::complex multiplication goes through a NaN-checking library call unless the
+// build uses fast math, and this runs partitions * bins times per block.
+static inline std::complex<float> multiply(std::complex<float> a, std::complex<float> b) {
+	return { a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real() };
+}
+
+static inline std::complex<float> multiply_conjugate(std::complex<float> a, std::complex<float> b) {
+	return { a.real() * b.real() + a.imag() * b.imag(), a.real() * b.imag() - a.imag() * b.real() };
+}
+
+EchoCanceller::EchoCanceller(int sample_rate, size_t block_size, int tail_ms)
+	: block_size(block_size),
+	  fft_size(2 * block_size),
+	  bins(block_size + 1),
+	  partitions(std::max<size_t>(1, (static_cast<size_t>(tail_ms) * sample_rate / 1000 + block_size - 1) / block_size)),
+	  fft(2 * block_size),
+	  history(partitions, Spectrum(fft_size)),
+	  weights(partitions, Spectrum(fft_size)),
+	  far_peaks(partitions, 0.0f),
+	  previous_far(block_size, 0.0f),
+	  far_power(fft_size, 0.0f),
+	  time_buffer(fft_size),
+	  frequency_buffer(fft_size),
+	  error_spectrum(fft_size) {}
+
+void EchoCanceller::reset() {
+	for (Spectrum& spectrum : history) {
+		std::fill(spectrum.begin(), spectrum.end(), std::complex<float>());
+	}
+	std::fill(far_peaks.begin(), far_peaks.end(), 0.0f);
+	std::fill(previous_far.begin(), previous_far.end(), 0.0f);
+	std::fill(far_power.begin(), far_power.end(), 0.0f);
+	clear_filter();
+	double_talk_hold = 0;
+	near_energy = 0.0;
+	error_energy = 0.0;
+	erle_db.store(0.0, std::memory_order_relaxed);
+}
+
+void EchoCanceller::clear_filter() {
+	for (Spectrum& spectrum : weights) {
+		std::fill(spectrum.begin(), spectrum.end(), std::complex<float>());
+	}
+	diverged_blocks = 0;
+}
+
+void EchoCanceller::process(float* near, const float* far) {
+	// Far-end spectrum of [previous block, this block], the overlap-save input window.
+	history_head = (history_head + partitions - 1) % partitions;
+	float far_peak = 0.0f;
+	double far_block_power = 0.0;
+	for (size_t i = 0; i < block_size; ++i) {
+		time_buffer[i] = previous_far[i];
+		time_buffer[block_size + i] = far[i];
+		far_peak = std::max(far_peak, std::fabs(far[i]));
+		far_block_power += static_cast<double>(far[i]) * far[i];
+	}
+	std::copy(far, far + block_size, previous_far.begin());
+	far_block_power /= static_cast<double>(block_size);
+	far_peaks[history_head] = far_peak;
+
+	Spectrum& current = history[history_head];
+	fft.forward(time_buffer.data(), current.data());
+	for (size_t k = 0; k < bins; ++k) {
+		far_power[k] = POWER_SMOOTHING * far_power[k] + (1.0f - POWER_SMOOTHING) * std::norm(current[k]);
+	}
+
+	// Echo estimate: sum over partitions of filter times the far-end spectrum that many blocks ago.
+	std::fill(frequency_buffer.begin(), frequency_buffer.end(), std::complex<float>());
+	for (size_t p = 0; p < partitions; ++p) {
+		const Spectrum& x = history[(history_head + p) % partitions];
+		const Spectrum& w = weights[p];
+		for (size_t k = 0; k < bins; ++k) {
+			frequency_buffer[k] += multiply(w[k], x[k]);
+		}
+	}
+	mirror(frequency_buffer);
+	fft.inverse(frequency_buffer.data(), time_buffer.data());
+
+	// Only the second half of the overlap-save output is free of circular wrap.
+	float near_peak = 0.0f;
+	double near_block_energy = 0.0;
+	double error_block_energy = 0.0;
+	for (size_t i = 0; i < block_size; ++i) {
+		const float error = near[i] - time_buffer[block_size + i].real();
+		near_peak = std::max(near_peak, std::fabs(near[i]));
+		near_block_energy += static_cast<double>(near[i]) * near[i];
+		error_block_energy += static_cast<double>(error) * error;
+		time_buffer[i] = 0.0f;
+		time_buffer[block_size + i] = error;
+	}
+
+	const bool far_active = far_block_power > FAR_END_ACTIVE_POWER;
+	const float recent_far_peak = *std::max_element(far_peaks.begin(), far_peaks.end());
+	if (far_active && near_peak > DOUBLE_TALK_RATIO * recent_far_peak) {
+		double_talk_hold = DOUBLE_TALK_HOLD_BLOCKS;
+	}
+	else if (double_talk_hold > 0) {
+		double_talk_hold--;
+	}
+	const bool talking = double_talk_hold > 0;
+
+	// A filter making things louder has diverged; pass the microphone through and start over if it persists.
+	const bool diverged = error_block_energy > near_block_energy * 1.5 && near_block_energy > 0.0;
+	diverged_blocks = diverged ? diverged_blocks + 1 : 0;
+	if (diverged_blocks >= DIVERGED_BLOCK_LIMIT) {
+		clear_filter();
+		resets.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	if (!diverged) {
+		for (size_t i = 0; i < block_size; ++i) {
+			near[i] = time_buffer[block_size + i].real();
+		}
+	}
+
+	if (far_active && !talking) {
+		fft.forward(time_buffer.data(), error_spectrum.data());
+
+		// NLMS update of every partition, normalised by the total far-end power the filter spans.
+		const float regularisation = 1e-6f * static_cast<float>(fft_size);
+		for (size_t k = 0; k < bins; ++k) {
+			error_spectrum[k] *= STEP_SIZE / (static_cast<float>(partitions) * far_power[k] + regularisation);
+		}
+		for (size_t p = 0; p < partitions; ++p) {
+			const Spectrum& x = history[(history_head + p) % partitions];
+			Spectrum& w = weights[p];
+			for (size_t k = 0; k < bins; ++k) {
+				w[k] += multiply_conjugate(x[k], error_spectrum[k]);
+			}
+		}
+
+		// Keeping every partition a causal block_size-tap filter costs two FFTs each; doing one per
+		// block, round robin, is enough to stop them drifting.
+		constrain(constrain_next);
+		constrain_next = (constrain_next + 1) % partitions;
+
+		near_energy = ERLE_SMOOTHING * near_energy + (1.0 - ERLE_SMOOTHING) * near_block_energy;
+		error_energy = ERLE_SMOOTHING * error_energy + (1.0 - ERLE_SMOOTHING) * std::min(error_block_energy, near_block_energy);
+		if (error_energy > 0.0 && near_energy > 0.0) {
+			erle_db.store(10.0 * std::log10(near_energy / error_energy), std::memory_order_relaxed);
+		}
+	}
+
+	far_end_active.store(far_active, std::memory_order_relaxed);
+	double_talk.store(talking, std::memory_order_relaxed);
+}
+
+void EchoCanceller::mirror(Spectrum& spectrum) const {
+	// Signals are real, so only bins 0..fft_size / 2 are worked on; the rest are their conjugates.
+	for (size_t k = bins; k < fft_size; ++k) {
+		spectrum[k] = std::conj(spectrum[fft_size - k]);
+	}
+}
+
+void EchoCanceller::constrain(size_t partition) {
+	Spectrum& w = weights[partition];
+	mirror(w);
+	fft.inverse(w.data(), time_buffer.data());
+	std::fill(time_buffer.begin() + block_size, time_buffer.end(), std::complex<float>());
+	fft.forward(time_buffer.data(), w.data());
+}
+
+EchoCancellerStats EchoCanceller::get_stats() const {
+	return EchoCancellerStats{
+		erle_db.load(std::memory_order_relaxed),
+		far_end_active.load(std::memory_order_relaxed),
+		double_talk.load(std::memory_order_relaxed),
+		resets.load(std::memory_order_relaxed)
+	};
+}
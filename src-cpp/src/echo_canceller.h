@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "fft.h"
+
+struct EchoCancellerStats {
+	// Echo return loss enhancement: how far the canceller pushed the echo below the raw microphone level.
+	double erle_db;
+	bool far_end_active;
+	bool double_talk;
+	// Times the filter diverged and was cleared.
+	uint64_t resets;
+};
+
+// Acoustic echo canceller.
+//
+// A partitioned-block frequency-domain adaptive filter (overlap-save, one partition per block) models
+// the path from the rendered far-end signal to the microphone and subtracts its estimate. Adaptation is
+// normalised per bin by the far-end power and frozen during double talk (Geigel detector). Works on plain
+// sample buffers with no device dependency, so it can be run offline over recorded near/far pairs.
+class EchoCanceller {
+public:
+	// block_size is the number of samples passed to every process() call; tail_ms is the longest echo
+	// path the filter can model.
+	EchoCanceller(int sample_rate, size_t block_size, int tail_ms);
+
+	// Removes the echo of far (what was rendered) from near (the microphone) in place. Both hold
+	// block_size samples.
+	void process(float* near, const float* far);
+
+	void reset();
+
+	EchoCancellerStats get_stats() const;
+
+	size_t get_block_size() const { return block_size; }
+
+private:
+	using Spectrum = std::vector<std::complex<float>>;
+
+	void mirror(Spectrum& spectrum) const;
+	void constrain(size_t partition);
+	void clear_filter();
+
+	const size_t block_size;
+	const size_t fft_size;
+	const size_t bins;
+	const size_t partitions;
+	Fft fft;
+
+	// Far-end spectra, newest at history_head, and the matching filter partitions.
+	std::vector<Spectrum> history;
+	std::vector<Spectrum> weights;
+	std::vector<float> far_peaks;
+	size_t history_head = 0;
+	size_t constrain_next = 0;
+
+	std::vector<float> previous_far;
+	std::vector<float> far_power;
+	Spectrum time_buffer;
+	Spectrum frequency_buffer;
+	Spectrum error_spectrum;
+
+	int double_talk_hold = 0;
+	int diverged_blocks = 0;
+	double near_energy = 0.0;
+	double error_energy = 0.0;
+
+	std::atomic<double> erle_db{ 0.0 };
+	std::atomic<bool> far_end_active{ false };
+	std::atomic<bool> double_talk{ false };
+	std::atomic<uint64_t> resets{ 0 };
+};
@@ -0,0 +1,74 @@
+#include <algorithm>
+#include <cmath>
+
+#include "echo_reference.h"
+
+// Drift the read position may have from the clocks before it is corrected, 2ms at 48kHz. Smaller
+// corrections would chase callback timing jitter, and every jump makes the echo canceller re-converge.
+constexpr int64_t REALIGN_TOLERANCE_SAMPLES = 96;
+
+EchoReference::EchoReference(int sample_rate, size_t capacity) : sample_rate(sample_rate), ring(capacity) {}
+
+void EchoReference::push(const float* samples, size_t count, int64_t dac_ns) {
+	ring.write(samples, count);
+
+	const uint32_t begin = sequence.load(std::memory_order_relaxed);
+	sequence.store(begin + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	end_ns.store(dac_ns != 0 ? dac_ns + static_cast<int64_t>(count * 1000000000ull / sample_rate) : 0, std::memory_order_relaxed);
+	written.store(written.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+	sequence.store(begin + 2, std::memory_order_release);
+}
+
+void EchoReference::pull(float* out, size_t count, int64_t adc_ns) {
+	int64_t snapshot_end_ns;
+	uint64_t snapshot_written;
+	uint32_t begin;
+	do {
+		begin = sequence.load(std::memory_order_acquire);
+		snapshot_end_ns = end_ns.load(std::memory_order_relaxed);
+		snapshot_written = written.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+	} while ((begin & 1) != 0 || begin != sequence.load(std::memory_order_relaxed));
+
+	size_t filled = 0;
+
+	if (adc_ns != 0 && snapshot_end_ns != 0) {
+		// Time at which the next unread reference sample was heard, compared with when the microphone block started.
+		const double queued_ns = static_cast<double>(snapshot_written - read) * 1e9 / sample_rate;
+		const double next_ns = static_cast<double>(snapshot_end_ns) - queued_ns;
+		const int64_t offset = static_cast<int64_t>(std::llround((static_cast<double>(adc_ns) - next_ns) * sample_rate / 1e9));
+
+		if (offset > REALIGN_TOLERANCE_SAMPLES) {
+			// The reference is behind: skip what played before this block was captured.
+			float discard[256];
+			size_t to_skip = std::min(static_cast<size_t>(offset), ring.size());
+			while (to_skip > 0) {
+				const size_t skipped = ring.read(discard, std::min(to_skip, sizeof(discard) / sizeof(discard[0])));
+				read += skipped;
+				to_skip -= skipped;
+			}
+			realignments_.fetch_add(1, std::memory_order_relaxed);
+		}
+		else if (offset < -REALIGN_TOLERANCE_SAMPLES) {
+			// The block was captured before the queued reference was heard: lead with silence.
+			filled = std::min(static_cast<size_t>(-offset), count);
+			std::fill(out, out + filled, 0.0f);
+			realignments_.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	const size_t got = ring.read(out + filled, count - filled);
+	read += got;
+	filled += got;
+
+	if (filled < count) {
+		std::fill(out + filled, out + count, 0.0f);
+		underruns_.fetch_add(count - filled, std::memory_order_relaxed);
+	}
+}
+
+void EchoReference::reset() {
+	ring.clear();
+	read = written.load(std::memory_order_acquire);
+}
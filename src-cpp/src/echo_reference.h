@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "spsc_ring.h"
+
+// Hands the frames the output device rendered to the capture side, aligned in time.
+//
+// The output callback pushes what it played together with the time at which that reaches the DAC; the
+// input callback pulls, for its own ADC time, the far-end samples that were playing when its block was
+// captured. The echo in the microphone then lags the reference only by the acoustic path. Both times are
+// steady-clock nanoseconds (latency::now_ns): PortAudio's stream times belong to each stream and need
+// not share an origin between the input and output streams.
+class EchoReference {
+public:
+	EchoReference(int sample_rate, size_t capacity);
+
+	// Output callback. dac_ns is when samples[0] is heard; zero if the host API does not report it.
+	void push(const float* samples, size_t count, int64_t dac_ns);
+
+	// Input callback. adc_ns is when the capture block's first sample was recorded; zero if the host API
+	// does not report it. Missing reference is filled with silence.
+	void pull(float* out, size_t count, int64_t adc_ns);
+
+	// Consumer side; drops everything queued and forgets the alignment.
+	void reset();
+
+	// Times the read position jumped to follow the clocks.
+	uint64_t realignments() const { return realignments_.load(std::memory_order_relaxed); }
+	// Samples of silence substituted because nothing had been rendered yet.
+	uint64_t underruns() const { return underruns_.load(std::memory_order_relaxed); }
+
+private:
+	const int sample_rate;
+	SpscRing<float> ring;
+
+	// Written by the producer under a sequence lock so the consumer reads them as a pair.
+	std::atomic<uint32_t> sequence{ 0 };
+	std::atomic<int64_t> end_ns{ 0 };
+	std::atomic<uint64_t> written{ 0 };
+
+	// Consumer only.
+	uint64_t read = 0;
+
+	std::atomic<uint64_t> realignments_{ 0 };
+	std::atomic<uint64_t> underruns_{ 0 };
+};
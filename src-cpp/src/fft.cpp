@@ -0,0 +1,132 @@
+#include <cmath>
+
+#include "fft.h"
+
+Fft::Fft(size_t size) : n(size) {
+	const double pi = 3.14159265358979323846;
+	forward_twiddles.resize(n);
+	inverse_twiddles.resize(n);
+	for (size_t i = 0; i < n; ++i) {
+		const double phase = -2.0 * pi * static_cast<double>(i) / static_cast<double>(n);
+		forward_twiddles[i] = std::complex<float>(static_cast<float>(std::cos(phase)), static_cast<float>(std::sin(phase)));
+		inverse_twiddles[i] = std::conj(forward_twiddles[i]);
+	}
+
+	// Factor into radix 4 first, then 2, 3, 5 and finally whatever primes remain.
+	size_t remaining = n;
+	size_t radix = 4;
+	size_t largest = 1;
+	while (remaining > 1) {
+		while (remaining % radix != 0) {
+			switch (radix) {
+			case 4: radix = 2; break;
+			case 2: radix = 3; break;
+			default: radix += 2; break;
+			}
+			if (radix * radix > remaining) {
+				radix = remaining;
+			}
+		}
+		remaining /= radix;
+		factors.push_back(radix);
+		factors.push_back(remaining);
+		largest = std::max(largest, radix);
+	}
+
+	scratch.resize(largest);
+}
+
+void Fft::forward(const std::complex<float>* in, std::complex<float>* out) {
+	if (n == 1) {
+		out[0] = in[0];
+		return;
+	}
+	work(out, in, 1, factors.data(), forward_twiddles.data());
+}
+
+void Fft::inverse(const std::complex<float>* in, std::complex<float>* out) {
+	if (n == 1) {
+		out[0] = in[0];
+		return;
+	}
+	work(out, in, 1, factors.data(), inverse_twiddles.data());
+
+	const float scale = 1.0f / static_cast<float>(n);
+	for (size_t i = 0; i < n; ++i) {
+		out[i] *= scale;
+	}
+}
+
+// Recursive decimation in time: each stage splits the input into radix interleaved sub-sequences,
+// transforms them in place in out, then combines them with one butterfly pass.
+void Fft::work(std::complex<float>* out, const std::complex<float>* in, size_t stride, const size_t* stage,
+	const std::complex<float>* twiddles) {
+	const size_t radix = stage[0];
+	const size_t m = stage[1];
+	std::complex<float>* begin = out;
+	std::complex<float>* end = out + radix * m;
+
+	if (m == 1) {
+		for (; out != end; ++out, in += stride) {
+			*out = *in;
+		}
+	}
+	else {
+		for (; out != end; out += m, in += stride) {
+			work(out, in, stride * radix, stage + 2, twiddles);
+		}
+	}
+
+	butterfly(begin, stride, radix, m, twiddles);
+}
+
+void Fft::butterfly(std::complex<float>* out, size_t stride, size_t radix, size_t m, const std::complex<float>* twiddles) {
+	if (radix == 2) {
+		for (size_t k = 0; k < m; ++k) {
+			const std::complex<float> t = out[k + m] * twiddles[k * stride];
+			out[k + m] = out[k] - t;
+			out[k] += t;
+		}
+		return;
+	}
+
+	if (radix == 4) {
+		// twiddles[n / 4] is -j going forward and +j going back.
+		const std::complex<float> quarter = twiddles[stride * m];
+		for (size_t k = 0; k < m; ++k) {
+			const std::complex<float> a0 = out[k];
+			const std::complex<float> a1 = out[k + m] * twiddles[k * stride];
+			const std::complex<float> a2 = out[k + 2 * m] * twiddles[2 * k * stride];
+			const std::complex<float> a3 = out[k + 3 * m] * twiddles[3 * k * stride];
+			const std::complex<float> s0 = a0 + a2;
+			const std::complex<float> s1 = a0 - a2;
+			const std::complex<float> s2 = a1 + a3;
+			const std::complex<float> s3 = (a1 - a3) * quarter;
+			out[k] = s0 + s2;
+			out[k + m] = s1 + s3;
+			out[k + 2 * m] = s0 - s2;
+			out[k + 3 * m] = s1 - s3;
+		}
+		return;
+	}
+
+	// Generic radix-p DFT over the p sub-results, with twiddles folded in.
+	for (size_t u = 0; u < m; ++u) {
+		for (size_t q = 0, k = u; q < radix; ++q, k += m) {
+			scratch[q] = out[k];
+		}
+
+		for (size_t q1 = 0, k = u; q1 < radix; ++q1, k += m) {
+			size_t twiddle_index = 0;
+			std::complex<float> sum = scratch[0];
+			for (size_t q = 1; q < radix; ++q) {
+				twiddle_index += stride * k;
+				if (twiddle_index >= n) {
+					twiddle_index %= n;
+				}
+				sum += scratch[q] * twiddles[twiddle_index];
+			}
+			out[k] = sum;
+		}
+	}
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+// Mixed-radix complex FFT for the DSP code, so the tree needs no FFT dependency.
+//
+// Any size works; sizes built from small factors (2, 3, 4, 5) are fast, which covers the multiples of
+// the 480-sample audio frame. Twiddles and scratch are allocated once in the constructor, so transforms
+// are safe on the audio path.
+class Fft {
+public:
+	explicit Fft(size_t size);
+
+	size_t size() const { return n; }
+
+	// out must not alias in.
+	void forward(const std::complex<float>* in, std::complex<float>* out);
+	// Scaled by 1 / size, so inverse(forward(x)) == x.
+	void inverse(const std::complex<float>* in, std::complex<float>* out);
+
+private:
+	void work(std::complex<float>* out, const std::complex<float>* in, size_t stride, const size_t* factors,
+		const std::complex<float>* twiddles);
+	void butterfly(std::complex<float>* out, size_t stride, size_t radix, size_t m, const std::complex<float>* twiddles);
+
+	size_t n;
+	// Pairs of (radix, remaining length) for each stage.
+	std::vector<size_t> factors;
+	std::vector<std::complex<float>> forward_twiddles;
+	std::vector<std::complex<float>> inverse_twiddles;
+	std::vector<std::complex<float>> scratch;
+};
@@ -0,0 +1,28 @@
+#include "ice_signaling.h"
+
+#include "common.h"
+
+namespace ice_signaling {
+	std::string encode_candidate(const Candidate& candidate) {
+		return json{ { "candidate", candidate.candidate }, { "sdpMid", candidate.mid }, { "sdpMLineIndex", 0 } }.dump();
+	}
+
+	std::string encode_end_of_candidates() {
+		return encode_candidate(Candidate{});
+	}
+
+	MessageKind decode(const std::string& data, Candidate& candidate) {
+		const json message = json::parse(data, nullptr, false);
+		if (message.is_discarded() || !message.is_object() || !message.contains("candidate") || !message["candidate"].is_string()) {
+			return MessageKind::INVALID;
+		}
+
+		const std::string text = message["candidate"].get<std::string>();
+		if (text.empty()) {
+			return MessageKind::END_OF_CANDIDATES;
+		}
+		candidate.candidate = text;
+		candidate.mid = message.contains("sdpMid") && message["sdpMid"].is_string() ? message["sdpMid"].get<std::string>() : std::string();
+		return MessageKind::CANDIDATE;
+	}
+}
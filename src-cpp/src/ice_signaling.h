@@ -0,0 +1,84 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+// The trickle ICE side of signaling, kept apart from libdatachannel so it can be tested on its own.
+//
+// Candidates travel as the data of "iceCandidate" messages: { candidate, sdpMid, sdpMLineIndex }, with an
+// empty candidate marking the end of candidates.
+namespace ice_signaling {
+	struct Candidate {
+		std::string candidate;
+		std::string mid;
+	};
+
+	enum class MessageKind {
+		CANDIDATE,
+		END_OF_CANDIDATES,
+		// Not JSON, or no candidate field.
+		INVALID
+	};
+
+	std::string encode_candidate(const Candidate& candidate);
+	std::string encode_end_of_candidates();
+	// Fills candidate only for MessageKind::CANDIDATE. Never throws.
+	MessageKind decode(const std::string& data, Candidate& candidate);
+
+	// Remote candidates can trickle in ahead of the answer, and a peer connection refuses them until the
+	// remote description is set. The queue holds them until then and afterwards passes them straight on,
+	// keeping arrival order either way. apply runs under the queue's lock, so the answer's flush and a
+	// candidate arriving on another thread never interleave.
+	class RemoteCandidateQueue {
+	public:
+		// Forget everything; for a new peer connection.
+		void reset() {
+			std::lock_guard<std::mutex> lock(mutex);
+			pending.clear();
+			description_set = false;
+			end_of_candidates = false;
+		}
+
+		// apply(const Candidate&) now if the remote description is set, otherwise later from description_applied.
+		template <typename Apply>
+		void add(Candidate candidate, Apply&& apply) {
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!description_set) {
+				pending.push_back(std::move(candidate));
+				return;
+			}
+			apply(candidate);
+		}
+
+		// Call once the remote description is set; applies the held candidates in arrival order.
+		template <typename Apply>
+		void description_applied(Apply&& apply) {
+			std::lock_guard<std::mutex> lock(mutex);
+			description_set = true;
+			for (const Candidate& candidate : pending) {
+				apply(candidate);
+			}
+			pending.clear();
+		}
+
+		// The remote side has gathered everything. Returns false if it had already said so.
+		bool end_received() {
+			std::lock_guard<std::mutex> lock(mutex);
+			const bool first = !end_of_candidates;
+			end_of_candidates = true;
+			return first;
+		}
+
+		size_t held() {
+			std::lock_guard<std::mutex> lock(mutex);
+			return pending.size();
+		}
+
+	private:
+		std::mutex mutex;
+		std::vector<Candidate> pending;
+		bool description_set = false;
+		bool end_of_candidates = false;
+	};
+}
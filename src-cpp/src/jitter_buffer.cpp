@@ -0,0 +1,282 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "jitter_buffer.h"
+#include "voip_packet.h"
+
+namespace {
+	// Bounds for the adaptive target depth.
+	constexpr double MIN_TARGET_MS = 20.0;
+	constexpr double MAX_TARGET_MS = 200.0;
+	// How many jitter deviations of headroom the target keeps on top of one packet.
+	constexpr double JITTER_HEADROOM = 3.0;
+
+	// Signed distance between two 16-bit sequence numbers, correct across wraparound.
+	int16_t sequence_diff(uint16_t a, uint16_t b) {
+		return static_cast<int16_t>(static_cast<uint16_t>(a - b));
+	}
+}
+
+JitterBuffer::JitterBuffer(int sample_rate)
+	: sample_rate(sample_rate), slots(std::make_unique<std::array<Slot, JITTER_BUFFER_SLOTS>>()) {
+}
+
+bool JitterBuffer::insert(uint16_t sequence, uint32_t timestamp, uint32_t duration, uint8_t flags, const unsigned char* data, size_t size,
+	std::chrono::steady_clock::time_point arrival) {
+	if (size == 0 || size > MAX_JITTER_PACKET_SIZE) {
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (have_played && sequence_diff(sequence, next_sequence) < 0) {
+		late++;
+		return false;
+	}
+
+	// The stream jumped further ahead than the buffer can hold (sender restart, long outage); start over.
+	if (have_received && sequence_diff(sequence, highest_sequence) >= static_cast<int>(JITTER_BUFFER_SLOTS)) {
+		dropped += packet_count;
+		for (auto& slot : *slots) {
+			slot.filled = false;
+		}
+		packet_count = 0;
+		playing = false;
+		have_played = false;
+		have_received = false;
+	}
+
+	Slot& slot = (*slots)[sequence % JITTER_BUFFER_SLOTS];
+	if (slot.filled) {
+		if (slot.packet.sequence == sequence) {
+			return false;
+		}
+
+		dropped++;
+		packet_count--;
+	}
+
+	slot.filled = true;
+	slot.packet.sequence = sequence;
+	slot.packet.timestamp = timestamp;
+	slot.packet.duration = duration;
+	slot.packet.flags = flags;
+	slot.packet.size = size;
+	slot.packet.arrival = arrival;
+	std::memcpy(slot.packet.data, data, size);
+	packet_count++;
+	received++;
+
+	update_jitter(timestamp, arrival);
+
+	if (!have_received || sequence_diff(sequence, highest_sequence) > 0) {
+		highest_sequence = sequence;
+		highest_timestamp_end = timestamp + duration;
+	}
+
+	have_received = true;
+	last_duration = duration;
+
+	return true;
+}
+
+JitterBufferResult JitterBuffer::pop(JitterBufferPacket& out) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (!playing) {
+		uint16_t oldest;
+		if (packet_count == 0 || buffered_samples() < target_samples() || !find_oldest(oldest)) {
+			return JitterBufferResult::BUFFERING;
+		}
+
+		next_sequence = oldest;
+		next_timestamp = (*slots)[oldest % JITTER_BUFFER_SLOTS].packet.timestamp;
+		playing = true;
+		have_played = true;
+	}
+
+	// Shed latency when the buffer has grown well past its target, one packet per pop so it stays inaudible.
+	Slot* slot = &(*slots)[next_sequence % JITTER_BUFFER_SLOTS];
+	if (slot->filled && slot->packet.sequence == next_sequence &&
+		buffered_samples() > target_samples() + 2 * last_duration) {
+		next_timestamp += slot->packet.duration;
+		release(next_sequence);
+		next_sequence++;
+		dropped++;
+		slot = &(*slots)[next_sequence % JITTER_BUFFER_SLOTS];
+	}
+
+	if (slot->filled && slot->packet.sequence == next_sequence) {
+		const JitterBufferPacket& packet = slot->packet;
+
+		// A timestamp jump with no sequence gap means the sender skipped silent frames; play the gap as silence.
+		const int32_t gap = static_cast<int32_t>(packet.timestamp - next_timestamp);
+		if (gap > 0) {
+			const uint32_t silence = std::min(static_cast<uint32_t>(gap), std::max(last_duration, 1u));
+			out.sequence = next_sequence;
+			out.timestamp = next_timestamp;
+			out.duration = silence;
+			out.flags = 0;
+			out.size = 0;
+
+			next_timestamp += silence;
+			return JitterBufferResult::GAP;
+		}
+
+		out.sequence = packet.sequence;
+		out.timestamp = packet.timestamp;
+		out.duration = packet.duration;
+		out.flags = packet.flags;
+		out.size = packet.size;
+		out.arrival = packet.arrival;
+		std::memcpy(out.data, packet.data, packet.size);
+
+		last_played_speech = (packet.flags & VOIP_FLAG_VAD) != 0;
+		next_timestamp += packet.duration;
+		release(next_sequence);
+		next_sequence++;
+		return JitterBufferResult::PACKET;
+	}
+
+	if (packet_count > 0) {
+		out.sequence = next_sequence;
+		out.timestamp = next_timestamp;
+		out.duration = last_duration;
+		out.flags = 0;
+		out.size = 0;
+
+		lost++;
+		next_timestamp += last_duration;
+		next_sequence++;
+		return JitterBufferResult::MISSING;
+	}
+
+	// Running dry after the sender marked its last frame as non-speech is the start of a DTX pause.
+	playing = false;
+	if (last_played_speech) {
+		underruns++;
+	}
+	else {
+		silences++;
+	}
+	return JitterBufferResult::BUFFERING;
+}
+
+bool JitterBuffer::peek(uint16_t sequence, JitterBufferPacket& out) const {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	const Slot& slot = (*slots)[sequence % JITTER_BUFFER_SLOTS];
+	if (!slot.filled || slot.packet.sequence != sequence) {
+		return false;
+	}
+
+	out.sequence = slot.packet.sequence;
+	out.timestamp = slot.packet.timestamp;
+	out.duration = slot.packet.duration;
+	out.flags = slot.packet.flags;
+	out.size = slot.packet.size;
+	out.arrival = slot.packet.arrival;
+	std::memcpy(out.data, slot.packet.data, slot.packet.size);
+	return true;
+}
+
+void JitterBuffer::reset() {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (auto& slot : *slots) {
+		slot.filled = false;
+	}
+
+	packet_count = 0;
+	playing = false;
+	have_played = false;
+	have_received = false;
+	have_previous_arrival = false;
+	jitter_samples = 0.0;
+}
+
+JitterBufferStats JitterBuffer::get_stats() const {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	const double samples_to_ms = 1000.0 / sample_rate;
+
+	JitterBufferStats stats;
+	stats.current_delay_ms = buffered_samples() * samples_to_ms;
+	stats.target_delay_ms = target_samples() * samples_to_ms;
+	stats.jitter_ms = jitter_samples * samples_to_ms;
+	stats.received = received;
+	stats.late = late;
+	stats.lost = lost;
+	stats.dropped = dropped;
+	stats.underruns = underruns;
+	stats.silences = silences;
+	return stats;
+}
+
+void JitterBuffer::update_jitter(uint32_t timestamp, std::chrono::steady_clock::time_point arrival) {
+	// RFC 3550 interarrival jitter: smoothed deviation of the arrival spacing from the timestamp spacing.
+	if (have_previous_arrival) {
+		const double arrival_delta = std::chrono::duration<double>(arrival - previous_arrival).count() * sample_rate;
+		const double timestamp_delta = static_cast<int32_t>(timestamp - previous_timestamp);
+		const double deviation = std::fabs(arrival_delta - timestamp_delta);
+		jitter_samples += (deviation - jitter_samples) / 16.0;
+	}
+
+	have_previous_arrival = true;
+	previous_arrival = arrival;
+	previous_timestamp = timestamp;
+}
+
+uint32_t JitterBuffer::buffered_samples() const {
+	if (packet_count == 0) {
+		return 0;
+	}
+
+	uint32_t start = next_timestamp;
+	if (!playing) {
+		uint16_t oldest;
+		if (!find_oldest(oldest)) {
+			return 0;
+		}
+		start = (*slots)[oldest % JITTER_BUFFER_SLOTS].packet.timestamp;
+	}
+
+	const int32_t buffered = static_cast<int32_t>(highest_timestamp_end - start);
+	return buffered > 0 ? static_cast<uint32_t>(buffered) : 0;
+}
+
+uint32_t JitterBuffer::target_samples() const {
+	const double min_target = MIN_TARGET_MS * sample_rate / 1000.0;
+	const double max_target = MAX_TARGET_MS * sample_rate / 1000.0;
+	const double target = last_duration + JITTER_HEADROOM * jitter_samples;
+	return static_cast<uint32_t>(std::clamp(target, min_target, max_target));
+}
+
+bool JitterBuffer::find_oldest(uint16_t& sequence) const {
+	bool found = false;
+	int oldest_diff = 0;
+
+	for (const auto& slot : *slots) {
+		if (!slot.filled) {
+			continue;
+		}
+
+		const int diff = sequence_diff(slot.packet.sequence, highest_sequence);
+		if (!found || diff < oldest_diff) {
+			found = true;
+			oldest_diff = diff;
+			sequence = slot.packet.sequence;
+		}
+	}
+
+	return found;
+}
+
+void JitterBuffer::release(uint16_t sequence) {
+	Slot& slot = (*slots)[sequence % JITTER_BUFFER_SLOTS];
+	if (slot.filled && slot.packet.sequence == sequence) {
+		slot.filled = false;
+		packet_count--;
+	}
+}
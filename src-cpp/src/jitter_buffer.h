@@ -0,0 +1,113 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+// Largest encoded packet the jitter buffer will hold. Opus never produces more than 1275 bytes per frame.
+constexpr size_t MAX_JITTER_PACKET_SIZE = 1500;
+// Number of packets the jitter buffer can hold at once, 640ms at 10ms per packet.
+constexpr size_t JITTER_BUFFER_SLOTS = 64;
+
+struct JitterBufferPacket {
+	uint16_t sequence;
+	uint32_t timestamp;
+	uint32_t duration;
+	uint8_t flags;
+	size_t size;
+	// When the packet came off the network; the time it spent buffered is part of the playout latency.
+	std::chrono::steady_clock::time_point arrival;
+	unsigned char data[MAX_JITTER_PACKET_SIZE];
+};
+
+enum class JitterBufferResult {
+	// A packet was due and is returned in the out parameter.
+	PACKET,
+	// A packet was due but never arrived; the caller should conceal it.
+	MISSING,
+	// The sender stopped transmitting (DTX) before the next packet; the caller should play out.duration
+	// samples of silence. Not a loss, so no concealment.
+	GAP,
+	// Nothing is due yet (prebuffering, or the stream went quiet); the caller should play silence.
+	BUFFERING
+};
+
+struct JitterBufferStats {
+	double current_delay_ms;
+	double target_delay_ms;
+	double jitter_ms;
+	uint64_t received;
+	uint64_t late;
+	uint64_t lost;
+	uint64_t dropped;
+	uint64_t underruns;
+	// Times the buffer ran dry because the sender went quiet, which is expected and not an underrun.
+	uint64_t silences;
+};
+
+// Adaptive jitter buffer for a single incoming stream.
+//
+// Packets are inserted from the network thread keyed on sequence number and sample timestamp, and
+// popped one at a time by whatever thread follows the output device clock. The target depth tracks
+// the RFC 3550 inter-arrival jitter estimate; packets arriving after their playout slot are discarded.
+class JitterBuffer {
+public:
+	explicit JitterBuffer(int sample_rate);
+
+	// flags are the voip header flags; VOIP_FLAG_VAD tells a DTX pause apart from an underrun.
+	// Returns false when the packet was discarded (late, duplicate or oversized).
+	bool insert(uint16_t sequence, uint32_t timestamp, uint32_t duration, uint8_t flags, const unsigned char* data, size_t size,
+		std::chrono::steady_clock::time_point arrival);
+
+	JitterBufferResult pop(JitterBufferPacket& out);
+
+	// Copies the packet with the given sequence number without removing it. Used to pull in-band FEC
+	// for a missing packet out of its successor.
+	bool peek(uint16_t sequence, JitterBufferPacket& out) const;
+
+	void reset();
+
+	JitterBufferStats get_stats() const;
+
+private:
+	struct Slot {
+		bool filled = false;
+		JitterBufferPacket packet;
+	};
+
+	void update_jitter(uint32_t timestamp, std::chrono::steady_clock::time_point arrival);
+	uint32_t buffered_samples() const;
+	uint32_t target_samples() const;
+	bool find_oldest(uint16_t& sequence) const;
+	void release(uint16_t sequence);
+
+	const int sample_rate;
+	std::unique_ptr<std::array<Slot, JITTER_BUFFER_SLOTS>> slots;
+	mutable std::mutex mutex;
+
+	size_t packet_count = 0;
+	bool playing = false;
+	bool have_played = false;
+	bool have_received = false;
+	uint16_t next_sequence = 0;
+	uint32_t next_timestamp = 0;
+	uint16_t highest_sequence = 0;
+	uint32_t highest_timestamp_end = 0;
+	uint32_t last_duration = 0;
+	bool last_played_speech = false;
+
+	bool have_previous_arrival = false;
+	std::chrono::steady_clock::time_point previous_arrival;
+	uint32_t previous_timestamp = 0;
+	double jitter_samples = 0.0;
+
+	uint64_t received = 0;
+	uint64_t late = 0;
+	uint64_t lost = 0;
+	uint64_t dropped = 0;
+	uint64_t underruns = 0;
+	uint64_t silences = 0;
+};
@@ -0,0 +1,101 @@
+#include "latency_histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+size_t LatencyHistogram::index_of(int64_t value_us) {
+	if (value_us < static_cast<int64_t>(SUB_BUCKETS)) {
+		return static_cast<size_t>(std::max<int64_t>(value_us, 0));
+	}
+
+	const uint64_t value = static_cast<uint64_t>(value_us);
+	int magnitude = 0;
+	while ((value >> magnitude) >= SUB_BUCKETS * 2) {
+		magnitude++;
+	}
+	if (static_cast<size_t>(magnitude) >= MAGNITUDES) {
+		return BUCKET_COUNT - 1;
+	}
+
+	// value >> magnitude now lies in [SUB_BUCKETS, 2 * SUB_BUCKETS).
+	const size_t sub_bucket = static_cast<size_t>(value >> magnitude) - SUB_BUCKETS;
+	return SUB_BUCKETS + static_cast<size_t>(magnitude) * SUB_BUCKETS + sub_bucket;
+}
+
+int64_t LatencyHistogram::upper_bound_of(size_t index) {
+	if (index < SUB_BUCKETS) {
+		return static_cast<int64_t>(index);
+	}
+
+	const size_t magnitude = (index - SUB_BUCKETS) / SUB_BUCKETS;
+	const size_t sub_bucket = (index - SUB_BUCKETS) % SUB_BUCKETS + SUB_BUCKETS;
+	return static_cast<int64_t>(((sub_bucket + 1) << magnitude) - 1);
+}
+
+void LatencyHistogram::record(int64_t value_us) {
+	value_us = std::max<int64_t>(value_us, 0);
+	counts_[index_of(value_us)].fetch_add(1, std::memory_order_relaxed);
+	total_.fetch_add(1, std::memory_order_relaxed);
+	sum_us_.fetch_add(value_us, std::memory_order_relaxed);
+
+	int64_t max = max_us_.load(std::memory_order_relaxed);
+	while (value_us > max && !max_us_.compare_exchange_weak(max, value_us, std::memory_order_relaxed)) {
+	}
+}
+
+void LatencyHistogram::reset() {
+	for (auto& count : counts_) {
+		count.store(0, std::memory_order_relaxed);
+	}
+	total_.store(0, std::memory_order_relaxed);
+	sum_us_.store(0, std::memory_order_relaxed);
+	max_us_.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::count() const {
+	return total_.load(std::memory_order_relaxed);
+}
+
+double LatencyHistogram::mean_us() const {
+	const uint64_t total = count();
+	return total > 0 ? static_cast<double>(sum_us_.load(std::memory_order_relaxed)) / static_cast<double>(total) : 0.0;
+}
+
+int64_t LatencyHistogram::max_us() const {
+	return max_us_.load(std::memory_order_relaxed);
+}
+
+int64_t LatencyHistogram::percentile_us(double percentile) const {
+	uint64_t total = 0;
+	for (const auto& count : counts_) {
+		total += count.load(std::memory_order_relaxed);
+	}
+	if (total == 0) {
+		return 0;
+	}
+
+	const uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(std::clamp(percentile, 0.0, 100.0) / 100.0 * static_cast<double>(total))));
+	uint64_t seen = 0;
+	for (size_t i = 0; i < BUCKET_COUNT; i++) {
+		seen += counts_[i].load(std::memory_order_relaxed);
+		if (seen >= target) {
+			// The top bucket is open-ended; the exact maximum is a better answer there.
+			if (i == BUCKET_COUNT - 1) {
+				return max_us();
+			}
+			return std::min(upper_bound_of(i), max_us());
+		}
+	}
+	return max_us();
+}
+
+std::vector<LatencyHistogram::Bucket> LatencyHistogram::buckets() const {
+	std::vector<Bucket> result;
+	for (size_t i = 0; i < BUCKET_COUNT; i++) {
+		const uint64_t count = counts_[i].load(std::memory_order_relaxed);
+		if (count > 0) {
+			result.push_back(Bucket{ upper_bound_of(i), count });
+		}
+	}
+	return result;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Log-linear histogram of durations in microseconds, in the style of HdrHistogram.
+//
+// Values below SUB_BUCKETS are counted exactly; above that every power of two is split into
+// SUB_BUCKETS equal buckets, so any recorded value is known to within 1/SUB_BUCKETS (about 3%)
+// from 1us up to over half a minute. Recording is a few relaxed atomic increments and is safe
+// from any number of threads, including audio callbacks; queries read a consistent-enough snapshot.
+class LatencyHistogram {
+public:
+	static constexpr int SUB_BUCKET_BITS = 5;
+	static constexpr size_t SUB_BUCKETS = size_t{ 1 } << SUB_BUCKET_BITS;
+	// Powers of two above the exact range; the last one also takes anything larger.
+	static constexpr size_t MAGNITUDES = 20;
+	static constexpr size_t BUCKET_COUNT = SUB_BUCKETS + MAGNITUDES * SUB_BUCKETS;
+
+	struct Bucket {
+		// Largest value the bucket holds.
+		int64_t upper_us;
+		uint64_t count;
+	};
+
+	LatencyHistogram() = default;
+	LatencyHistogram(const LatencyHistogram&) = delete;
+	LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+	void record(int64_t value_us);
+	void reset();
+
+	uint64_t count() const;
+	double mean_us() const;
+	int64_t max_us() const;
+	// Smallest bucket bound at or below which percentile (0-100) of the values fall.
+	int64_t percentile_us(double percentile) const;
+	// Non-empty buckets in ascending order.
+	std::vector<Bucket> buckets() const;
+
+private:
+	static size_t index_of(int64_t value_us);
+	static int64_t upper_bound_of(size_t index);
+
+	std::array<std::atomic<uint64_t>, BUCKET_COUNT> counts_{};
+	std::atomic<uint64_t> total_{ 0 };
+	std::atomic<int64_t> sum_us_{ 0 };
+	std::atomic<int64_t> max_us_{ 0 };
+};
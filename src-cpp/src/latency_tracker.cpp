@@ -0,0 +1,133 @@
+#include "latency_tracker.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+
+#include "common.h"
+#include "latency_histogram.h"
+
+namespace latency {
+	// Our packets remembered for loopback matching; 2.5s of 10ms packets, far longer than any round trip.
+	constexpr size_t SENT_PACKET_SLOTS = 256;
+	constexpr uint32_t NO_SEQUENCE = 0xFFFFFFFF;
+
+	struct SentPacket {
+		// Written last and checked again after reading, so a reader never takes a half-updated slot.
+		std::atomic<uint32_t> sequence{ NO_SEQUENCE };
+		std::atomic<int64_t> capture_ns{ 0 };
+		std::atomic<int64_t> sent_ns{ 0 };
+	};
+
+	std::array<LatencyHistogram, static_cast<size_t>(Stage::COUNT)> histograms;
+	std::array<SentPacket, SENT_PACKET_SLOTS> sent_packets;
+
+	int64_t now_ns() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	const char* stage_name(Stage stage) {
+		switch (stage) {
+		case Stage::CAPTURE:
+			return "capture";
+		case Stage::PACKETIZE:
+			return "packetize";
+		case Stage::SEND:
+			return "send";
+		case Stage::NETWORK:
+			return "network";
+		case Stage::JITTER:
+			return "jitter";
+		case Stage::DECODE:
+			return "decode";
+		case Stage::PLAYOUT:
+			return "playout";
+		case Stage::MOUTH_TO_EAR:
+			return "mouth_to_ear";
+		default:
+			return "unknown";
+		}
+	}
+
+	void record(Stage stage, int64_t duration_ns) {
+		histograms[static_cast<size_t>(stage)].record(duration_ns / 1000);
+	}
+
+	void packet_sent(uint16_t sequence, int64_t capture_ns, int64_t sent_ns) {
+		SentPacket& slot = sent_packets[sequence % SENT_PACKET_SLOTS];
+		slot.sequence.store(NO_SEQUENCE, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		slot.capture_ns.store(capture_ns, std::memory_order_relaxed);
+		slot.sent_ns.store(sent_ns, std::memory_order_relaxed);
+		slot.sequence.store(sequence, std::memory_order_release);
+	}
+
+	bool find_sent(uint16_t sequence, int64_t& capture_ns, int64_t& sent_ns) {
+		const SentPacket& slot = sent_packets[sequence % SENT_PACKET_SLOTS];
+		if (slot.sequence.load(std::memory_order_acquire) != sequence) {
+			return false;
+		}
+		capture_ns = slot.capture_ns.load(std::memory_order_relaxed);
+		sent_ns = slot.sent_ns.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return slot.sequence.load(std::memory_order_relaxed) == sequence;
+	}
+
+	bool loopback_arrived(uint16_t sequence, int64_t arrival_ns) {
+		int64_t capture_ns;
+		int64_t sent_ns;
+		if (!find_sent(sequence, capture_ns, sent_ns)) {
+			return false;
+		}
+		record(Stage::NETWORK, arrival_ns - sent_ns);
+		return true;
+	}
+
+	std::vector<StageSummary> get_summary() {
+		std::vector<StageSummary> summary;
+		for (size_t i = 0; i < histograms.size(); i++) {
+			const LatencyHistogram& histogram = histograms[i];
+			summary.push_back(StageSummary{
+				stage_name(static_cast<Stage>(i)),
+				histogram.count(),
+				histogram.mean_us() / 1000.0,
+				histogram.percentile_us(50.0) / 1000.0,
+				histogram.percentile_us(90.0) / 1000.0,
+				histogram.percentile_us(99.0) / 1000.0,
+				histogram.percentile_us(99.9) / 1000.0,
+				histogram.max_us() / 1000.0
+			});
+		}
+		return summary;
+	}
+
+	std::string to_json() {
+		const std::vector<StageSummary> summary = get_summary();
+		json stages = json::object();
+		for (size_t i = 0; i < summary.size(); i++) {
+			const StageSummary& stage = summary[i];
+			json buckets = json::array();
+			for (const auto& bucket : histograms[i].buckets()) {
+				buckets.push_back({ bucket.upper_us, bucket.count });
+			}
+			stages[stage.name] = {
+				{ "count", stage.count },
+				{ "meanMs", stage.mean_ms },
+				{ "p50Ms", stage.p50_ms },
+				{ "p90Ms", stage.p90_ms },
+				{ "p99Ms", stage.p99_ms },
+				{ "p999Ms", stage.p999_ms },
+				{ "maxMs", stage.max_ms },
+				// [upper bound in us, count] for every non-empty bucket.
+				{ "buckets", buckets }
+			};
+		}
+		return json{ { "stages", stages } }.dump();
+	}
+
+	void reset() {
+		for (auto& histogram : histograms) {
+			histogram.reset();
+		}
+	}
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Mouth-to-ear latency broken down by pipeline stage.
+//
+// Every stage keeps a LatencyHistogram of how long audio spent in it. Times are steady-clock
+// nanoseconds; device timestamps are mapped onto that clock in the audio callbacks. Stages that
+// need the sender's clock (network, mouth_to_ear) are only measured in loopback, when the server
+// sends our own packets back to us.
+namespace latency {
+	enum class Stage {
+		// ADC time of a frame's first sample until it leaves the processing chain.
+		CAPTURE,
+		// End of processing until the packet is encoded, including waiting for the rest of the packet.
+		PACKETIZE,
+		// Encoded until handed to the data channel.
+		SEND,
+		// Handed to the data channel until our own packet came back (loopback only).
+		NETWORK,
+		// Arrival until the jitter buffer released the packet to the decoder.
+		JITTER,
+		DECODE,
+		// Mixed until its first sample reaches the DAC.
+		PLAYOUT,
+		// ADC to DAC for our own looped-back audio.
+		MOUTH_TO_EAR,
+		COUNT
+	};
+
+	struct StageSummary {
+		const char* name;
+		uint64_t count;
+		double mean_ms;
+		double p50_ms;
+		double p90_ms;
+		double p99_ms;
+		double p999_ms;
+		double max_ms;
+	};
+
+	int64_t now_ns();
+	const char* stage_name(Stage stage);
+
+	// Any thread, including audio callbacks. Negative durations (clock mapping error) count as zero.
+	void record(Stage stage, int64_t duration_ns);
+
+	// Remember when one of our packets was captured and sent, so its looped-back copy can be timed.
+	void packet_sent(uint16_t sequence, int64_t capture_ns, int64_t sent_ns);
+	// Looks up a packet remembered by packet_sent. Fails once the sequence number has been reused.
+	bool find_sent(uint16_t sequence, int64_t& capture_ns, int64_t& sent_ns);
+	// One of our own packets came back at arrival_ns: records its network round trip. False when it is not
+	// one we remember.
+	bool loopback_arrived(uint16_t sequence, int64_t arrival_ns);
+
+	std::vector<StageSummary> get_summary();
+	// Summary plus the non-empty buckets of every stage.
+	std::string to_json();
+	void reset();
+}
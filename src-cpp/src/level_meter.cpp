@@ -0,0 +1,65 @@
+#include <algorithm>
+#include <cmath>
+
+#include "level_meter.h"
+#include "simd.h"
+
+namespace level_meter {
+	Level measure(const float* buffer, size_t count) {
+		if (count == 0) {
+			return Level{ 0.0f, 0.0f };
+		}
+
+		size_t i = 0;
+		float peak = 0.0f;
+		float sum = 0.0f;
+
+#if defined(SPEAKLY_HAVE_AVX)
+		const __m256 abs_mask_256 = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+		__m256 peak_256 = _mm256_setzero_ps();
+		__m256 sum_256 = _mm256_setzero_ps();
+		for (; i + 8 <= count; i += 8) {
+			__m256 sample = _mm256_loadu_ps(buffer + i);
+			peak_256 = _mm256_max_ps(peak_256, _mm256_and_ps(sample, abs_mask_256));
+			sum_256 = _mm256_add_ps(sum_256, _mm256_mul_ps(sample, sample));
+		}
+		alignas(32) float peak_lanes[8];
+		alignas(32) float sum_lanes[8];
+		_mm256_store_ps(peak_lanes, peak_256);
+		_mm256_store_ps(sum_lanes, sum_256);
+		for (int lane = 0; lane < 8; ++lane) {
+			peak = std::max(peak, peak_lanes[lane]);
+			sum += sum_lanes[lane];
+		}
+#endif
+#if defined(SPEAKLY_HAVE_SSE)
+		const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+		__m128 peak_128 = _mm_setzero_ps();
+		__m128 sum_128 = _mm_setzero_ps();
+		for (; i + 4 <= count; i += 4) {
+			__m128 sample = _mm_loadu_ps(buffer + i);
+			peak_128 = _mm_max_ps(peak_128, _mm_and_ps(sample, abs_mask));
+			sum_128 = _mm_add_ps(sum_128, _mm_mul_ps(sample, sample));
+		}
+		alignas(16) float peak_quad[4];
+		alignas(16) float sum_quad[4];
+		_mm_store_ps(peak_quad, peak_128);
+		_mm_store_ps(sum_quad, sum_128);
+		for (int lane = 0; lane < 4; ++lane) {
+			peak = std::max(peak, peak_quad[lane]);
+			sum += sum_quad[lane];
+		}
+#endif
+
+		for (; i < count; ++i) {
+			peak = std::max(peak, std::fabs(buffer[i]));
+			sum += buffer[i] * buffer[i];
+		}
+
+		return Level{ peak, sum / static_cast<float>(count) };
+	}
+
+	float to_db(float amplitude) {
+		return amplitude > 1e-6f ? 20.0f * std::log10(amplitude) : -120.0f;
+	}
+}
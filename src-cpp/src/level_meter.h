@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+
+namespace level_meter {
+	struct Level {
+		// Largest absolute sample.
+		float peak;
+		// Mean of the squared samples; sqrt gives RMS, 10 * log10 gives dBFS.
+		float mean_square;
+	};
+
+	// Peak and mean square of a block in one vectorized pass.
+	Level measure(const float* buffer, size_t count);
+
+	// dBFS of a linear amplitude, clamped to -120 for silence.
+	float to_db(float amplitude);
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Listeners the audio threads call while other threads attach and detach them.
+//
+// Same scheme as AudioProcessor: the list is an immutable snapshot behind an atomic pointer. Attaching
+// or detaching copies it on the calling thread and swaps the copy in, so notify() never blocks or
+// allocates. Replaced snapshots are freed by a later edit (or the destructor) once no notify() is running;
+// until then a just-detached listener may still be called once.
+template <typename Listener>
+class ListenerSet {
+public:
+	ListenerSet() : active(new List()) {}
+
+	~ListenerSet() {
+		delete active.load();
+		for (List* list : retired) {
+			delete list;
+		}
+	}
+
+	ListenerSet(const ListenerSet&) = delete;
+	ListenerSet& operator=(const ListenerSet&) = delete;
+
+	// Any thread except the ones that notify.
+	void attach(std::shared_ptr<Listener> listener) {
+		std::lock_guard<std::mutex> lock(writer_mutex);
+		auto list = std::make_unique<List>(*active.load());
+		list->push_back(std::move(listener));
+		publish(std::move(list));
+	}
+
+	void detach(const std::shared_ptr<Listener>& listener) {
+		std::lock_guard<std::mutex> lock(writer_mutex);
+		auto list = std::make_unique<List>(*active.load());
+		list->erase(std::remove(list->begin(), list->end(), listener), list->end());
+		publish(std::move(list));
+	}
+
+	// Calls every attached listener that holds a target.
+	template <typename... Args>
+	void notify(const Args&... args) const {
+		// Sequentially consistent so the increment is visible before the load, pairing with publish().
+		readers.fetch_add(1);
+		const List* list = active.load();
+		// By reference; copying each shared_ptr would bump its atomic refcount per listener per block.
+		for (const auto& listener : *list) {
+			if (*listener) {
+				(*listener)(args...);
+			}
+		}
+		readers.fetch_sub(1, std::memory_order_release);
+	}
+
+private:
+	using List = std::vector<std::shared_ptr<Listener>>;
+
+	void publish(std::unique_ptr<List> list) {
+		retired.push_back(active.exchange(list.release()));
+		// A notify() that starts after the exchange loads the new list, so once none is running every retired
+		// list is unreachable.
+		if (readers.load() != 0) {
+			return;
+		}
+		for (List* old : retired) {
+			delete old;
+		}
+		retired.clear();
+	}
+
+	std::atomic<List*> active;
+	mutable std::atomic<int> readers{ 0 };
+
+	// Writer side only.
+	std::mutex writer_mutex;
+	std::vector<List*> retired;
+};
@@ -1,48 +1,183 @@
 #include "logger.h"
 
+#include <algorithm>
+#include <ctime>
+#include <iostream>
+
 namespace logger {
+	// How long a message may wait before the flusher writes it; errors wake the flusher immediately.
+	constexpr auto FLUSH_INTERVAL = std::chrono::milliseconds(20);
+
 	Logger& Logger::get_instance() {
 		static Logger instance;
 		return instance;
 	}
 
 	void Logger::set_log_file(const std::string& filename) {
+		std::lock_guard<std::mutex> lock(file_mutex_);
 		logFile_.open(filename, std::ofstream::out | std::ofstream::app);
 	}
 
+	void Logger::set_console_output(bool enabled) {
+		console_output_.store(enabled, std::memory_order_relaxed);
+	}
+
+	void Logger::set_level(LogLevel level) {
+		level_.store(level, std::memory_order_relaxed);
+	}
+
 	void Logger::log(LogLevel level, const std::string& message) {
-		std::string timestamp = get_timestamp();
-		std::string levelStr = get_log_level(level);
+		if (!enabled(level)) {
+			return;
+		}
+		enqueue_text(level, message.data(), message.size());
+	}
 
-		std::cout << timestamp << " [" << levelStr << "] " << message << std::endl;
+	void Logger::enqueue_text(LogLevel level, const char* text, size_t length) {
+		bool queued = records_.push([&](LogRecord& record) {
+			record.timestamp_ns = now_ns();
+			record.level = level;
+			record.formatter = nullptr;
+			record.length = static_cast<uint32_t>(std::min(length, LogRecord::PAYLOAD_SIZE));
+			std::memcpy(record.payload, text, record.length);
+			// Mark a cut message so it is not mistaken for the whole of it.
+			if (length > LogRecord::PAYLOAD_SIZE) {
+				std::memcpy(record.payload + LogRecord::PAYLOAD_SIZE - 3, "...", 3);
+			}
+		});
+		finish_enqueue(level, queued);
+	}
 
-		if (logFile_.is_open()) {
-			logFile_ << timestamp << " [" << levelStr << "] " << message << std::endl;
-			logFile_.flush();
+	void Logger::finish_enqueue(LogLevel level, bool queued) {
+		if (level == LogLevel::L_FATAL) {
+			// The process is likely about to go down; make sure this reaches the file.
+			flush();
+		}
+		else if (queued && level >= LogLevel::L_ERROR) {
+			flush_cv_.notify_one();
+		}
+	}
+
+	void Logger::flush() {
+		std::unique_lock<std::mutex> lock(flush_mutex_);
+		if (!running_) {
+			return;
 		}
+		const uint64_t ticket = ++flush_requested_;
+		flush_cv_.notify_one();
+		flushed_cv_.wait(lock, [&]() { return flush_completed_ >= ticket || !running_; });
 	}
 
 	void Logger::close_log_file() {
+		flush();
+		std::lock_guard<std::mutex> lock(file_mutex_);
 		if (logFile_.is_open()) {
 			logFile_.close();
 		}
 	}
 
-	Logger::Logger() {}
+	Logger::Logger() : records_(RECORD_COUNT) {
+		flusher_ = std::thread([this]() { flush_loop(); });
+	}
 
 	Logger::~Logger() {
+		{
+			std::lock_guard<std::mutex> lock(flush_mutex_);
+			running_ = false;
+		}
+		flush_cv_.notify_one();
+		if (flusher_.joinable()) {
+			flusher_.join();
+		}
+		flushed_cv_.notify_all();
 		close_log_file();
 	}
 
-	std::string Logger::get_timestamp() const {
-		std::time_t now = std::time(nullptr);
-		char timestamp[20];
-		std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", std::localtime(&now));
+	void Logger::flush_loop() {
+		std::string batch;
+		batch.reserve(64 * 1024);
+		bool running = true;
+
+		while (running) {
+			uint64_t ticket;
+			{
+				std::unique_lock<std::mutex> lock(flush_mutex_);
+				flush_cv_.wait_for(lock, FLUSH_INTERVAL, [&]() { return !running_ || flush_requested_ > flush_completed_; });
+				running = running_;
+				ticket = flush_requested_;
+			}
+
+			// Everything published before the ticket was taken is drained by this pass.
+			batch.clear();
+			while (records_.pop([&](const LogRecord& record) { write_record(record, batch); })) {
+			}
+
+			const uint64_t drops = records_.dropped();
+			if (drops != reported_drops_) {
+				batch += get_timestamp(now_ns()) + " [WARNING] " + std::to_string(drops - reported_drops_) + " log messages dropped\n";
+				reported_drops_ = drops;
+			}
+
+			if (!batch.empty()) {
+				if (console_output_.load(std::memory_order_relaxed)) {
+					std::fwrite(batch.data(), 1, batch.size(), stdout);
+					std::fflush(stdout);
+				}
+				std::lock_guard<std::mutex> lock(file_mutex_);
+				if (logFile_.is_open()) {
+					logFile_.write(batch.data(), static_cast<std::streamsize>(batch.size()));
+					logFile_.flush();
+				}
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(flush_mutex_);
+				flush_completed_ = ticket;
+			}
+			flushed_cv_.notify_all();
+		}
+	}
+
+	void Logger::write_record(const LogRecord& record, std::string& batch) const {
+		batch += get_timestamp(record.timestamp_ns);
+		batch += " [";
+		batch += get_log_level(record.level);
+		batch += "] ";
+
+		if (record.formatter != nullptr) {
+			char text[LogRecord::PAYLOAD_SIZE];
+			record.formatter(record, text, sizeof(text));
+			batch += text;
+		}
+		else {
+			batch.append(record.payload, record.length);
+		}
+		batch += '\n';
+	}
+
+	// Records carry steady-clock time; it is mapped onto the wall clock at the moment of writing.
+	std::string Logger::get_timestamp(int64_t timestamp_ns) const {
+		const auto age = std::chrono::nanoseconds(now_ns() - timestamp_ns);
+		const auto wall = std::chrono::system_clock::now() - std::chrono::duration_cast<std::chrono::system_clock::duration>(age);
+		const std::time_t seconds = std::chrono::system_clock::to_time_t(wall);
+		const auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(wall.time_since_epoch()).count() % 1000;
+
+		std::tm local{};
+#if defined(_WIN32)
+		localtime_s(&local, &seconds);
+#else
+		localtime_r(&seconds, &local);
+#endif
+		char timestamp[32];
+		size_t length = std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &local);
+		std::snprintf(timestamp + length, sizeof(timestamp) - length, ".%03d", static_cast<int>(milliseconds));
 		return timestamp;
 	}
 
-	std::string Logger::get_log_level(LogLevel level) const {
+	const char* Logger::get_log_level(LogLevel level) const {
 		switch (level) {
+		case LogLevel::L_DEBUG:
+			return "DEBUG";
 		case LogLevel::L_INFO:
 			return "INFO";
 		case LogLevel::L_WARNING:
@@ -55,4 +190,4 @@ namespace logger {
 			return "UNKNOWN";
 		}
 	}
-}
\ No newline at end of file
+}
@@ -1,25 +1,113 @@
 #ifndef LOGGER_H
 #define LOGGER_H
 
-#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
-#include <ctime>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+
+#include "mpsc_ring.h"
+
+// Levels below this are compiled out of SPEAKLY_LOG entirely; 0 keeps everything down to debug.
+#ifndef SPEAKLY_LOG_LEVEL
+#define SPEAKLY_LOG_LEVEL 0
+#endif
 
 namespace logger {
 	enum class LogLevel {
+		L_DEBUG,
 		L_INFO,
 		L_WARNING,
 		L_ERROR,
 		L_FATAL
 	};
 
+	constexpr LogLevel COMPILED_LOG_LEVEL = static_cast<LogLevel>(SPEAKLY_LOG_LEVEL);
+
+	constexpr bool compiled_in(LogLevel level) {
+		return level >= COMPILED_LOG_LEVEL;
+	}
+
+	// A string argument for the printf-style log(), formatted with %s. Only the pointer is queued, so the
+	// text must have static storage: a string literal, or one picked from a table of them.
+	struct StaticText {
+		explicit constexpr StaticText(const char* text) : text(text) {}
+		const char* text;
+	};
+
+	// One queued message. Either the text itself, or a format string literal plus its arguments packed as they
+	// were passed; formatting happens on the flusher thread.
+	struct LogRecord {
+		static constexpr size_t PAYLOAD_SIZE = 480;
+
+		int64_t timestamp_ns;
+		LogLevel level;
+		uint32_t length;
+		const char* format;
+		void (*formatter)(const LogRecord& record, char* out, size_t size);
+		alignas(8) char payload[PAYLOAD_SIZE];
+	};
+
+	// Callers only copy their message into a preallocated record and return: no allocation, no lock and no I/O
+	// on the calling thread. A background thread formats records and writes them out in batches. When the
+	// queue is full the message is dropped and counted rather than blocking the caller.
 	class Logger {
 	public:
 		static Logger& get_instance();
 
 		void set_log_file(const std::string& filename);
-		void log(LogLevel level, const std::string& message);
 		void close_log_file();
+		// Whether messages are also written to stdout; on by default.
+		void set_console_output(bool enabled);
+
+		// Messages below level are discarded at the call site. Safe to call from any thread.
+		void set_level(LogLevel level);
+		bool enabled(LogLevel level) const {
+			return compiled_in(level) && level >= level_.load(std::memory_order_relaxed);
+		}
+
+		// Copies message, truncating it to one record.
+		void log(LogLevel level, const std::string& message);
+
+		// printf-style. format must be a string literal; arguments must be numbers or StaticText and are
+		// copied unformatted. With no arguments the text is copied as it is.
+		template <typename... Args>
+		void log(LogLevel level, const char* format, Args... args) {
+			if (!enabled(level)) {
+				return;
+			}
+
+			if constexpr (sizeof...(Args) == 0) {
+				enqueue_text(level, format, std::strlen(format));
+			}
+			else {
+				static_assert(((std::is_arithmetic_v<Args> || std::is_same_v<Args, StaticText>) && ...),
+					"log arguments are formatted later; pass numbers or StaticText, or build a std::string message");
+				using Packed = std::tuple<Args...>;
+				static_assert(sizeof(Packed) <= LogRecord::PAYLOAD_SIZE, "too many log arguments");
+
+				bool queued = records_.push([&](LogRecord& record) {
+					record.timestamp_ns = now_ns();
+					record.level = level;
+					record.format = format;
+					record.formatter = &format_packed<Args...>;
+					new (record.payload) Packed(args...);
+				});
+				finish_enqueue(level, queued);
+			}
+		}
+
+		// Blocks until everything logged before the call has been written.
+		void flush();
 
 	private:
 		Logger();
@@ -27,10 +115,64 @@ namespace logger {
 		Logger(const Logger&) = delete;
 		Logger& operator=(const Logger&) = delete;
 
-		std::string get_timestamp() const;
-		std::string get_log_level(LogLevel level) const;
+		static int64_t now_ns() {
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		template <typename... Args>
+		static void format_packed(const LogRecord& record, char* out, size_t size) {
+			const auto& packed = *reinterpret_cast<const std::tuple<Args...>*>(record.payload);
+			std::apply([&](auto... args) { std::snprintf(out, size, record.format, unwrap(args)...); }, packed);
+		}
+
+		template <typename T>
+		static T unwrap(T value) {
+			return value;
+		}
+
+		static const char* unwrap(StaticText text) {
+			return text.text;
+		}
 
+		void enqueue_text(LogLevel level, const char* text, size_t length);
+		void finish_enqueue(LogLevel level, bool queued);
+		void flush_loop();
+		void write_record(const LogRecord& record, std::string& batch) const;
+		std::string get_timestamp(int64_t timestamp_ns) const;
+		const char* get_log_level(LogLevel level) const;
+
+		// Roughly 1MB of records; a burst beyond that within one flush interval is dropped.
+		static constexpr size_t RECORD_COUNT = 2048;
+
+		MpscRing<LogRecord> records_;
+		std::atomic<LogLevel> level_{ LogLevel::L_INFO };
+		std::atomic<bool> console_output_{ true };
+
+		std::thread flusher_;
+		bool running_ = true;
+		uint64_t flush_requested_ = 0;
+		uint64_t flush_completed_ = 0;
+		std::mutex flush_mutex_;
+		std::condition_variable flush_cv_;
+		std::condition_variable flushed_cv_;
+
+		// Guards the file against set_log_file/close_log_file; only the flusher writes to it.
+		std::mutex file_mutex_;
 		std::ofstream logFile_;
+		uint64_t reported_drops_ = 0;
 	};
 }
-#endif 
\ No newline at end of file
+
+// Logs through the shared logger. Levels below SPEAKLY_LOG_LEVEL vanish at compile time and levels below
+// the runtime level skip evaluating the arguments, so expensive messages cost nothing when filtered.
+#define SPEAKLY_LOG(level, ...) \
+	do { \
+		if constexpr (logger::compiled_in(level)) { \
+			logger::Logger& speakly_logger_ = logger::Logger::get_instance(); \
+			if (speakly_logger_.enabled(level)) { \
+				speakly_logger_.log(level, __VA_ARGS__); \
+			} \
+		} \
+	} while (0)
+
+#endif
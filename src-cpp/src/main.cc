@@ -1,21 +1,147 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include <nlohmann/json.hpp>
+
 #include "molybden.hpp"
 #include "voicechat.hpp"
+#include "audio_capture.h"
+#include "latency_tracker.h"
+#include "metrics.h"
 
 using namespace molybden;
 
+// The meter is pushed to the page at this rate; faster than the eye needs, slow enough to cost nothing.
+constexpr auto LEVEL_METER_INTERVAL = std::chrono::milliseconds(50);
+// Metrics are for reading, not watching; a snapshot also runs the collectors, which take locks.
+constexpr auto METRICS_INTERVAL = std::chrono::seconds(1);
+
+std::atomic<bool> page_updates_running{ false };
+std::thread page_update_thread;
+// Runs init_all, which sets up the session and tears it down once asked to exit.
+std::thread session_thread;
+
 std::string greet(std::string name) {
   return "Hello " + name + "! This message comes from C++";
 }
 
+// JSON list of selectable devices for the page's device pickers.
+std::string list_audio_devices() {
+  nlohmann::json devices = nlohmann::json::array();
+  for (const auto& device : audio_capture::list_devices()) {
+    devices.push_back({
+      { "index", device.index },
+      { "name", device.name },
+      { "hostApi", device.host_api },
+      { "inputChannels", device.max_input_channels },
+      { "outputChannels", device.max_output_channels },
+      { "sampleRate", device.default_sample_rate },
+      { "defaultInput", device.is_default_input },
+      { "defaultOutput", device.is_default_output },
+      { "currentInput", device.is_current_input },
+      { "currentOutput", device.is_current_output }
+    });
+  }
+  return devices.dump();
+}
+
+bool set_input_device(int index) {
+  return audio_capture::switch_input_device(index);
+}
+
+bool set_output_device(int index) {
+  return audio_capture::switch_output_device(index);
+}
+
+std::string get_latency_report() {
+  return latency::to_json();
+}
+
+void reset_latency_report() {
+  latency::reset();
+}
+
+std::string get_metrics() {
+  return metrics::snapshot_json();
+}
+
+// Pushes the level meter and, less often, a metrics snapshot to the page, so neither the audio threads nor the
+// page ever wait on each other.
+void start_page_updates(std::shared_ptr<Browser> browser) {
+  if (page_updates_running.exchange(true)) {
+    return;
+  }
+
+  page_update_thread = std::thread([browser]() {
+    auto next_metrics = std::chrono::steady_clock::now() + METRICS_INTERVAL;
+    while (page_updates_running.load()) {
+      std::this_thread::sleep_for(LEVEL_METER_INTERVAL);
+
+      auto levels = audio_capture::get_input_levels();
+      char script[256];
+      std::snprintf(script, sizeof(script),
+                    "window.dispatchEvent(new CustomEvent('speakly-levels', { detail: "
+                    "{ peakDb: %.1f, rmsDb: %.1f, outputPeakDb: %.1f, outputRmsDb: %.1f, gainDb: %.1f } }));",
+                    levels.input_peak_db, levels.input_rms_db, levels.output_peak_db, levels.output_rms_db, levels.gain_db);
+      browser->mainFrame()->executeJavaScript(script);
+
+      const auto now = std::chrono::steady_clock::now();
+      if (now >= next_metrics) {
+        next_metrics = now + METRICS_INTERVAL;
+        browser->mainFrame()->executeJavaScript(
+            "window.dispatchEvent(new CustomEvent('speakly-metrics', { detail: " + metrics::snapshot_json() + " }));");
+      }
+    }
+  });
+}
+
+void stop_page_updates() {
+  if (!page_updates_running.exchange(false)) {
+    return;
+  }
+  if (page_update_thread.joinable()) {
+    page_update_thread.join();
+  }
+}
+
+// Called when the window closes, while the browser is still alive: nothing may be pushed to the page after
+// this, and every thread must be joined before the process exits.
+void shutdown() {
+  stop_page_updates();
+  request_exit();
+  if (session_thread.joinable()) {
+    session_thread.join();
+  }
+}
+
 void launch() {
   App::init([](std::shared_ptr<App> app) {
     auto browser = Browser::create(app);
     browser->onInjectJs = [](const InjectJsArgs& args, InjectJsAction action) {
       args.window->putProperty("greet", greet);
+      args.window->putProperty("listAudioDevices", list_audio_devices);
+      args.window->putProperty("setInputDevice", set_input_device);
+      args.window->putProperty("setOutputDevice", set_output_device);
+      args.window->putProperty("getLatencyReport", get_latency_report);
+      args.window->putProperty("resetLatencyReport", reset_latency_report);
+      args.window->putProperty("getMetrics", get_metrics);
+      args.window->putProperty("setLoopback", set_loopback);
       action.proceed();
     };
+    browser->onClosed += [](const BrowserClosed& event) {
+      shutdown();
+    };
     browser->loadUrl(app->baseUrl());
     browser->show();
-    init_all();
+    start_page_updates(browser);
+    // App::init must return so the UI thread keeps pumping; the session stops when the window closes or on
+    // "exit" at the console.
+    session_thread = std::thread([]() {
+      init_all();
+      stop_page_updates();
+    });
   });
 }
@@ -0,0 +1,97 @@
+#include "mapped_file.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+#if defined(_WIN32)
+bool MappedFile::open(const std::string& path) {
+	close();
+
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+		CloseHandle(file);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) {
+		CloseHandle(file);
+		return false;
+	}
+
+	const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (view == nullptr) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+
+	file_ = file;
+	mapping_ = mapping;
+	data_ = view;
+	size_ = static_cast<size_t>(file_size.QuadPart);
+	return true;
+}
+
+void MappedFile::close() {
+	if (data_ != nullptr) {
+		UnmapViewOfFile(data_);
+		CloseHandle(mapping_);
+		CloseHandle(file_);
+	}
+	data_ = nullptr;
+	mapping_ = nullptr;
+	file_ = nullptr;
+	size_ = 0;
+}
+#else
+bool MappedFile::open(const std::string& path) {
+	close();
+
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+
+	void* view = mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping keeps its own reference to the file.
+	::close(fd);
+	if (view == MAP_FAILED) {
+		return false;
+	}
+
+	data_ = view;
+	size_ = static_cast<size_t>(file_stat.st_size);
+	return true;
+}
+
+void MappedFile::close() {
+	if (data_ != nullptr) {
+		munmap(const_cast<void*>(data_), size_);
+	}
+	data_ = nullptr;
+	size_ = 0;
+}
+#endif
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file. The mapping lives as long as the object; pages are only
+// faulted in when touched, so large model files cost nothing until used.
+class MappedFile {
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// Returns false (and leaves the object empty) if the file cannot be opened or mapped.
+	bool open(const std::string& path);
+	void close();
+
+	const void* data() const { return data_; }
+	size_t size() const { return size_; }
+	bool is_open() const { return data_ != nullptr; }
+
+private:
+	const void* data_ = nullptr;
+	size_t size_ = 0;
+#if defined(_WIN32)
+	void* file_ = nullptr;
+	void* mapping_ = nullptr;
+#endif
+};
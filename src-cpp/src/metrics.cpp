@@ -0,0 +1,90 @@
+#include "metrics.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "common.h"
+
+namespace metrics {
+	struct Registry {
+		std::mutex mutex;
+		// Ordered so snapshots list metrics the same way every time.
+		std::map<std::string, std::unique_ptr<Counter>> counters;
+		std::map<std::string, std::unique_ptr<Gauge>> gauges;
+		std::map<std::string, std::unique_ptr<LatencyHistogram>> histograms;
+		std::vector<std::function<void()>> collectors;
+	};
+
+	// Built on first use so metrics may be looked up from other translation units' static initializers.
+	Registry& registry() {
+		static Registry instance;
+		return instance;
+	}
+
+	template <typename Metric>
+	Metric& find_or_create(std::map<std::string, std::unique_ptr<Metric>>& metrics, const std::string& name) {
+		std::unique_ptr<Metric>& metric = metrics[name];
+		if (!metric) {
+			metric = std::make_unique<Metric>();
+		}
+		return *metric;
+	}
+
+	Counter& counter(const std::string& name) {
+		std::lock_guard<std::mutex> lock(registry().mutex);
+		return find_or_create(registry().counters, name);
+	}
+
+	Gauge& gauge(const std::string& name) {
+		std::lock_guard<std::mutex> lock(registry().mutex);
+		return find_or_create(registry().gauges, name);
+	}
+
+	LatencyHistogram& histogram(const std::string& name) {
+		std::lock_guard<std::mutex> lock(registry().mutex);
+		return find_or_create(registry().histograms, name);
+	}
+
+	void add_collector(std::function<void()> collector) {
+		std::lock_guard<std::mutex> lock(registry().mutex);
+		registry().collectors.push_back(std::move(collector));
+	}
+
+	std::string snapshot_json() {
+		std::vector<std::function<void()>> collectors;
+		{
+			std::lock_guard<std::mutex> lock(registry().mutex);
+			collectors = registry().collectors;
+		}
+		// Collectors set gauges, which takes the registry lock, so they run without it.
+		for (const auto& collector : collectors) {
+			collector();
+		}
+
+		std::lock_guard<std::mutex> lock(registry().mutex);
+		json counters = json::object();
+		for (const auto& [name, counter] : registry().counters) {
+			counters[name] = counter->value();
+		}
+
+		json gauges = json::object();
+		for (const auto& [name, gauge] : registry().gauges) {
+			gauges[name] = gauge->value();
+		}
+
+		json histograms = json::object();
+		for (const auto& [name, histogram] : registry().histograms) {
+			histograms[name] = {
+				{ "count", histogram->count() },
+				{ "mean", histogram->mean_us() },
+				{ "p50", histogram->percentile_us(50.0) },
+				{ "p99", histogram->percentile_us(99.0) },
+				{ "max", histogram->max_us() }
+			};
+		}
+
+		return json{ { "counters", counters }, { "gauges", gauges }, { "histograms", histograms } }.dump();
+	}
+}
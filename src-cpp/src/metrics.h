@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "latency_histogram.h"
+
+// Process-wide registry of named metrics.
+//
+// Metrics are looked up by name once, typically into a static reference, and updated through that
+// reference afterwards: a counter or gauge update is a single relaxed atomic operation and a
+// histogram record a handful, so audio callbacks may update them freely. Values that already live
+// elsewhere are pulled in by collectors that run only when a snapshot is taken.
+namespace metrics {
+	class Counter {
+	public:
+		void add(uint64_t amount = 1) {
+			value_.fetch_add(amount, std::memory_order_relaxed);
+		}
+
+		uint64_t value() const {
+			return value_.load(std::memory_order_relaxed);
+		}
+
+	private:
+		std::atomic<uint64_t> value_{ 0 };
+	};
+
+	class Gauge {
+	public:
+		void set(double value) {
+			value_.store(value, std::memory_order_relaxed);
+		}
+
+		double value() const {
+			return value_.load(std::memory_order_relaxed);
+		}
+
+	private:
+		std::atomic<double> value_{ 0.0 };
+	};
+
+	// Returns the metric registered under name, creating it on first use. The reference stays valid for the
+	// life of the process. Takes a lock; not for the hot path.
+	Counter& counter(const std::string& name);
+	Gauge& gauge(const std::string& name);
+	// Values in microseconds.
+	LatencyHistogram& histogram(const std::string& name);
+
+	// Runs on the snapshotting thread before every snapshot.
+	void add_collector(std::function<void()> collector);
+
+	// Every metric as JSON: counters and gauges by name, histograms as count, mean and percentiles.
+	std::string snapshot_json();
+}
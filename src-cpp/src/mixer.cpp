@@ -0,0 +1,70 @@
+#include <cmath>
+
+#include "mixer.h"
+#include "simd.h"
+
+namespace mixer {
+	void accumulate(float* destination, const float* source, size_t count) {
+		size_t i = 0;
+
+#if defined(SPEAKLY_HAVE_AVX)
+		for (; i + 8 <= count; i += 8) {
+			__m256 sum = _mm256_add_ps(_mm256_loadu_ps(destination + i), _mm256_loadu_ps(source + i));
+			_mm256_storeu_ps(destination + i, sum);
+		}
+#endif
+#if defined(SPEAKLY_HAVE_SSE)
+		for (; i + 4 <= count; i += 4) {
+			__m128 sum = _mm_add_ps(_mm_loadu_ps(destination + i), _mm_loadu_ps(source + i));
+			_mm_storeu_ps(destination + i, sum);
+		}
+#endif
+
+		for (; i < count; ++i) {
+			destination[i] += source[i];
+		}
+	}
+
+	// Above the threshold the excess u (normalised to the remaining headroom) is mapped through
+	// u / (1 + u), which is continuous in value and slope at the knee and approaches full scale.
+	static float limit_sample(float sample, float threshold, float headroom) {
+		float magnitude = std::fabs(sample);
+		if (magnitude <= threshold) {
+			return sample;
+		}
+
+		float excess = (magnitude - threshold) / headroom;
+		float limited = threshold + headroom * excess / (1.0f + excess);
+		return std::copysign(limited, sample);
+	}
+
+	void soft_limit(float* buffer, size_t count, float threshold) {
+		const float headroom = 1.0f - threshold;
+		size_t i = 0;
+
+#if defined(SPEAKLY_HAVE_SSE)
+		const __m128 sign_mask = _mm_set1_ps(-0.0f);
+		const __m128 threshold_v = _mm_set1_ps(threshold);
+		const __m128 headroom_v = _mm_set1_ps(headroom);
+		const __m128 inverse_headroom_v = _mm_set1_ps(1.0f / headroom);
+		const __m128 one = _mm_set1_ps(1.0f);
+
+		for (; i + 4 <= count; i += 4) {
+			__m128 sample = _mm_loadu_ps(buffer + i);
+			__m128 sign = _mm_and_ps(sample, sign_mask);
+			__m128 magnitude = _mm_andnot_ps(sign_mask, sample);
+
+			__m128 excess = _mm_mul_ps(_mm_max_ps(_mm_sub_ps(magnitude, threshold_v), _mm_setzero_ps()), inverse_headroom_v);
+			__m128 bent = _mm_add_ps(threshold_v, _mm_div_ps(_mm_mul_ps(headroom_v, excess), _mm_add_ps(one, excess)));
+
+			__m128 over = _mm_cmpgt_ps(magnitude, threshold_v);
+			__m128 limited = _mm_or_ps(_mm_and_ps(over, bent), _mm_andnot_ps(over, magnitude));
+			_mm_storeu_ps(buffer + i, _mm_or_ps(limited, sign));
+		}
+#endif
+
+		for (; i < count; ++i) {
+			buffer[i] = limit_sample(buffer[i], threshold, headroom);
+		}
+	}
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+
+namespace mixer {
+	// Adds count samples of source into destination.
+	void accumulate(float* destination, const float* source, size_t count);
+
+	// Leaves samples below threshold untouched and bends everything above it smoothly towards
+	// full scale, so summed speakers never clip.
+	void soft_limit(float* buffer, size_t count, float threshold = 0.8f);
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Bounded lock-free multi-producer/single-consumer queue of fixed-size slots.
+//
+// Producers claim a slot with one compare-and-swap, fill it in place and publish it; a full queue
+// makes push() fail instead of waiting. The single consumer takes slots in claim order. Each slot
+// carries a sequence number telling both sides whose turn it is, so no side ever takes a lock or
+// allocates. Capacity is rounded up to a power of two.
+template <typename T>
+class MpscRing {
+public:
+	explicit MpscRing(size_t min_capacity) {
+		capacity_ = 1;
+		while (capacity_ < min_capacity) {
+			capacity_ <<= 1;
+		}
+		mask_ = capacity_ - 1;
+		slots_ = std::make_unique<Slot[]>(capacity_);
+		for (size_t i = 0; i < capacity_; i++) {
+			slots_[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	MpscRing(const MpscRing&) = delete;
+	MpscRing& operator=(const MpscRing&) = delete;
+
+	// Any thread. Calls fill(T&) on a claimed slot and publishes it; returns false without calling fill
+	// when the queue is full.
+	template <typename Fill>
+	bool push(Fill&& fill) {
+		size_t position = enqueue_position_.load(std::memory_order_relaxed);
+		Slot* slot;
+		for (;;) {
+			slot = &slots_[position & mask_];
+			const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+			const intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+			if (difference == 0) {
+				if (enqueue_position_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			}
+			else if (difference < 0) {
+				dropped_.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			else {
+				position = enqueue_position_.load(std::memory_order_relaxed);
+			}
+		}
+
+		fill(slot->value);
+		slot->sequence.store(position + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side. Calls consume(const T&) on the oldest published slot and frees it; returns false when
+	// that slot is empty or still being filled.
+	template <typename Consume>
+	bool pop(Consume&& consume) {
+		Slot& slot = slots_[dequeue_position_ & mask_];
+		if (slot.sequence.load(std::memory_order_acquire) != dequeue_position_ + 1) {
+			return false;
+		}
+
+		consume(static_cast<const T&>(slot.value));
+		slot.sequence.store(dequeue_position_ + capacity_, std::memory_order_release);
+		dequeue_position_++;
+		return true;
+	}
+
+	size_t capacity() const {
+		return capacity_;
+	}
+
+	// Total number of pushes refused because the queue was full.
+	uint64_t dropped() const {
+		return dropped_.load(std::memory_order_relaxed);
+	}
+
+private:
+	struct Slot {
+		std::atomic<size_t> sequence{ 0 };
+		T value;
+	};
+
+	size_t capacity_;
+	size_t mask_;
+	std::unique_ptr<Slot[]> slots_;
+
+	// Producers contend on the enqueue index; the consumer's index is private to it.
+	alignas(64) std::atomic<size_t> enqueue_position_{ 0 };
+	alignas(64) size_t dequeue_position_ = 0;
+	alignas(64) std::atomic<uint64_t> dropped_{ 0 };
+};
@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <cmath>
+
+#include "agc_plugin.h"
+#include "../level_meter.h"
+
+// Blocks quieter than this are treated as silence and do not move the gain.
+constexpr float NOISE_FLOOR_DB = -50.0f;
+// Most the AGC will turn a loud microphone down.
+constexpr float MAX_CUT_DB = 20.0f;
+// How fast the gain may rise and fall. Falling faster keeps a sudden shout from lingering loud.
+constexpr float GAIN_RISE_DB_PER_SECOND = 6.0f;
+constexpr float GAIN_FALL_DB_PER_SECOND = 30.0f;
+// Time constant of the loudness estimate.
+constexpr float LOUDNESS_TIME_CONSTANT_S = 0.1f;
+// Limiter recovery time from full reduction back to unity.
+constexpr float LIMITER_RELEASE_S = 0.05f;
+
+AgcPlugin::AgcPlugin(int sample_rate, double lookahead_ms, double ceiling_db)
+    : AudioEffectPlugin("Automatic Gain Control"),
+      sample_rate(sample_rate),
+      lookahead(std::clamp<size_t>(static_cast<size_t>(lookahead_ms * sample_rate / 1000.0), 1, MAX_LIMITER_LOOKAHEAD)),
+      ceiling(static_cast<float>(std::pow(10.0, ceiling_db / 20.0))),
+      release_step(1.0f / (LIMITER_RELEASE_S * sample_rate)) {
+    delay.fill(0.0f);
+    box.fill(1.0f);
+    box_sum = static_cast<double>(lookahead);
+}
+
+void AgcPlugin::process(float* buffer, int buffer_size) {
+    if (buffer_size <= 0) {
+        return;
+    }
+
+    const level_meter::Level input = level_meter::measure(buffer, buffer_size);
+    const float input_rms_level = level_meter::to_db(std::sqrt(input.mean_square));
+    input_peak_db.store(level_meter::to_db(input.peak));
+    input_rms_db.store(input_rms_level);
+
+    const float block_seconds = static_cast<float>(buffer_size) / sample_rate;
+    if (input_rms_level > NOISE_FLOOR_DB) {
+        const float smoothing = 1.0f - std::exp(-block_seconds / LOUDNESS_TIME_CONSTANT_S);
+        loudness_db = loudness_db <= -120.0f ? input_rms_level : loudness_db + smoothing * (input_rms_level - loudness_db);
+
+        const float desired = std::clamp(static_cast<float>(target_db.load()) - loudness_db, -MAX_CUT_DB, static_cast<float>(max_gain_db.load()));
+        if (desired > gain_db) {
+            gain_db = std::min(desired, gain_db + GAIN_RISE_DB_PER_SECOND * block_seconds);
+        }
+        else {
+            gain_db = std::max(desired, gain_db - GAIN_FALL_DB_PER_SECOND * block_seconds);
+        }
+    }
+
+    // Ramp linearly from last block's gain to this one's so gain changes never step.
+    const float target_gain = std::pow(10.0f, gain_db / 20.0f);
+    const float step = (target_gain - applied_gain) / static_cast<float>(buffer_size);
+    for (int i = 0; i < buffer_size; ++i) {
+        applied_gain += step;
+        buffer[i] = limit(buffer[i] * applied_gain);
+    }
+    applied_gain = target_gain;
+
+    const level_meter::Level output = level_meter::measure(buffer, buffer_size);
+    output_peak_db.store(level_meter::to_db(output.peak));
+    output_rms_db.store(level_meter::to_db(std::sqrt(output.mean_square)));
+    published_gain_db.store(gain_db);
+}
+
+float AgcPlugin::limit(float sample) {
+    const float magnitude = std::fabs(sample);
+    const float required = magnitude > ceiling ? ceiling / magnitude : 1.0f;
+
+    // Sliding minimum over the last lookahead + 1 required gains.
+    const size_t capacity = minimum_values.size();
+    while (minimum_count > 0) {
+        const size_t back = (minimum_head + minimum_count - 1) % capacity;
+        if (minimum_values[back] < required) {
+            break;
+        }
+        minimum_count--;
+    }
+    const size_t slot = (minimum_head + minimum_count) % capacity;
+    minimum_values[slot] = required;
+    minimum_indices[slot] = sample_index;
+    minimum_count++;
+    if (minimum_indices[minimum_head] + lookahead < sample_index) {
+        minimum_head = (minimum_head + 1) % capacity;
+        minimum_count--;
+    }
+    const float held = minimum_values[minimum_head];
+    sample_index++;
+
+    box_sum += held - box[position];
+    box[position] = held;
+    const float smoothed = std::min(1.0f, static_cast<float>(box_sum / static_cast<double>(lookahead)));
+    limiter_gain = std::min(smoothed, limiter_gain + release_step);
+
+    const float delayed = delay[position];
+    delay[position] = sample;
+    position = (position + 1) % lookahead;
+
+    return delayed * limiter_gain;
+}
+
+AgcLevels AgcPlugin::get_levels() const {
+    return AgcLevels{
+        input_peak_db.load(),
+        input_rms_db.load(),
+        output_peak_db.load(),
+        output_rms_db.load(),
+        published_gain_db.load()
+    };
+}
@@ -0,0 +1,82 @@
+#ifndef SPEAKLY_AGC_PLUGIN_H
+#define SPEAKLY_AGC_PLUGIN_H
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "audio_effect_plugin.h"
+#include "plugin_parameter.h"
+
+// Longest look-ahead the limiter supports, 10ms at 48kHz.
+constexpr size_t MAX_LIMITER_LOOKAHEAD = 480;
+
+struct AgcLevels {
+    float input_peak_db;
+    float input_rms_db;
+    float output_peak_db;
+    float output_rms_db;
+    float gain_db;
+};
+
+// Automatic gain control followed by a look-ahead peak limiter.
+//
+// The loudness of blocks above the noise floor is tracked and the gain steered so speech lands at the
+// target level; silence leaves the gain alone so the room noise is not pumped up between words. The
+// gain is ramped per sample across each block. The limiter delays the signal by its look-ahead and
+// starts pulling the gain down before a peak arrives, so nothing passes the ceiling and there is no
+// hard clipping. The same meter readings are published for the UI.
+class AgcPlugin : public AudioEffectPlugin {
+private:
+    int sample_rate;
+
+    AtomicParameter<double> target_db{ -18.0 };
+    AtomicParameter<double> max_gain_db{ 30.0 };
+
+    float loudness_db = -120.0f;
+    float gain_db = 0.0f;
+    float applied_gain = 1.0f;
+
+    // Limiter state. The gain needed for each sample is held at the minimum over the look-ahead window,
+    // then box-averaged over the same length, which ramps it down early enough to meet every peak.
+    size_t lookahead;
+    float ceiling;
+    float release_step;
+    float limiter_gain = 1.0f;
+    std::array<float, MAX_LIMITER_LOOKAHEAD> delay;
+    std::array<float, MAX_LIMITER_LOOKAHEAD> box;
+    double box_sum;
+    size_t position = 0;
+
+    // Monotonic queue of (sample index, required gain) for the sliding minimum.
+    std::array<float, MAX_LIMITER_LOOKAHEAD + 1> minimum_values;
+    std::array<uint64_t, MAX_LIMITER_LOOKAHEAD + 1> minimum_indices;
+    size_t minimum_head = 0;
+    size_t minimum_count = 0;
+    uint64_t sample_index = 0;
+
+    MeterValue<float> input_peak_db{ -120.0f };
+    MeterValue<float> input_rms_db{ -120.0f };
+    MeterValue<float> output_peak_db{ -120.0f };
+    MeterValue<float> output_rms_db{ -120.0f };
+    MeterValue<float> published_gain_db{ 0.0f };
+
+    float limit(float sample);
+
+public:
+    explicit AgcPlugin(int sample_rate, double lookahead_ms = 5.0, double ceiling_db = -1.0);
+
+    void process(float* buffer, int buffer_size) override;
+
+    // Safe to call from any thread. target_db is the RMS level speech is steered to, in dBFS.
+    void set_target_loudness(double target_db) { this->target_db.store(target_db); }
+    void set_max_gain(double max_gain_db) { this->max_gain_db.store(max_gain_db); }
+
+    // Samples the limiter delays the signal by.
+    size_t get_latency() const { return lookahead; }
+
+    AgcLevels get_levels() const;
+};
+
+#endif //SPEAKLY_AGC_PLUGIN_H
@@ -2,7 +2,12 @@
 #define SPEAKLY_AUDIO_EFFECT_PLUGIN_H
 #pragma once
 
-#include <opus/opus_types.h>
+enum class VoiceActivity {
+    // The plugin does not detect speech.
+    UNKNOWN,
+    SPEECH,
+    SILENCE
+};
 
 class AudioEffectPlugin {
 protected:
@@ -11,6 +16,9 @@ public:
     AudioEffectPlugin() : name("Audio Effect Plugin") {}
     AudioEffectPlugin(const char* name) : name(name) {}
     virtual void process(float* buffer, int buffer_size) = 0;
+
+    // Gates and voice detectors report what they decided for the last processed buffer.
+    virtual VoiceActivity voice_activity() const { return VoiceActivity::UNKNOWN; }
 };
 
 #endif //SPEAKLY_AUDIO_EFFECT_PLUGIN_H
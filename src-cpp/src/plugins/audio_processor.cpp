@@ -1,12 +1,85 @@
+#include <algorithm>
+
 #include "audio_processor.h"
 
+AudioProcessor::ReadGuard::ReadGuard(const AudioProcessor& processor) : processor(processor) {
+    // Sequentially consistent so the increment is visible before the load, pairing with the writer's
+    // exchange-then-check in publish().
+    processor.readers.fetch_add(1);
+    chain = processor.active.load();
+}
+
+AudioProcessor::ReadGuard::~ReadGuard() {
+    processor.readers.fetch_sub(1, std::memory_order_release);
+}
+
+AudioProcessor::AudioProcessor() : active(new Chain()) {}
+
+AudioProcessor::~AudioProcessor() {
+    delete active.load();
+    for (Chain* chain : retired) {
+        delete chain;
+    }
+}
+
 void AudioProcessor::add_plugin(std::shared_ptr<AudioEffectPlugin> plugin) {
-    plugins.push_back(plugin);
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    auto chain = std::make_unique<Chain>(*active.load());
+    chain->plugins.push_back(std::move(plugin));
+    publish(std::move(chain));
+}
+
+void AudioProcessor::remove_plugin(const std::shared_ptr<AudioEffectPlugin>& plugin) {
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    auto chain = std::make_unique<Chain>(*active.load());
+    chain->plugins.erase(std::remove(chain->plugins.begin(), chain->plugins.end(), plugin), chain->plugins.end());
+    publish(std::move(chain));
+}
+
+void AudioProcessor::set_plugins(std::vector<std::shared_ptr<AudioEffectPlugin>> plugins) {
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    auto chain = std::make_unique<Chain>();
+    chain->plugins = std::move(plugins);
+    publish(std::move(chain));
+}
+
+void AudioProcessor::publish(std::unique_ptr<Chain> chain) {
+    retired.push_back(active.exchange(chain.release()));
+    collect_retired();
+}
+
+void AudioProcessor::collect_retired() {
+    // A reader that starts after the exchange loads the new snapshot, so once no reader is active every
+    // retired snapshot is unreachable. Audio blocks are short, so this almost always succeeds immediately;
+    // otherwise the snapshot waits for the next edit.
+    if (readers.load() != 0) {
+        return;
+    }
+    for (Chain* chain : retired) {
+        delete chain;
+    }
+    retired.clear();
 }
 
 void AudioProcessor::process_audio(float* buffer, int buffer_size) {
-    for (auto plugin : plugins) {
+    ReadGuard guard(*this);
+    // Iterate by reference; copying each shared_ptr would bump its atomic refcount twice per plugin per block.
+    for (const auto& plugin : guard.chain->plugins) {
         plugin->process(buffer, buffer_size);
     }
+}
 
-}
\ No newline at end of file
+VoiceActivity AudioProcessor::voice_activity() const {
+    ReadGuard guard(*this);
+    VoiceActivity result = VoiceActivity::UNKNOWN;
+    for (const auto& plugin : guard.chain->plugins) {
+        VoiceActivity activity = plugin->voice_activity();
+        if (activity == VoiceActivity::SPEECH) {
+            return VoiceActivity::SPEECH;
+        }
+        if (activity == VoiceActivity::SILENCE) {
+            result = VoiceActivity::SILENCE;
+        }
+    }
+    return result;
+}
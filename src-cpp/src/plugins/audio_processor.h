@@ -2,17 +2,61 @@
 #define SPEAKLY_AUDIO_PROCESSOR_H
 #pragma once
 
+#include <atomic>
 #include <vector>
 #include <memory>
+#include <mutex>
 #include "audio_effect_plugin.h"
 
+// Runtime plugin chain that can be edited while audio is flowing.
+//
+// The chain is an immutable snapshot published through an atomic pointer. Editing builds a new snapshot
+// on the calling thread and swaps it in (read-copy-update); the audio thread only ever loads the pointer,
+// so it never blocks or allocates. Replaced snapshots are retired and freed by a later edit (or the
+// destructor) once no audio thread is inside process_audio or voice_activity.
 class AudioProcessor {
 private:
-    std::vector<std::shared_ptr<AudioEffectPlugin>> plugins;
+    struct Chain {
+        std::vector<std::shared_ptr<AudioEffectPlugin>> plugins;
+    };
+
+    // Marks the audio thread as reading the current snapshot for its lifetime.
+    class ReadGuard {
+    public:
+        explicit ReadGuard(const AudioProcessor& processor);
+        ~ReadGuard();
+        const Chain* chain;
+    private:
+        const AudioProcessor& processor;
+    };
+
+    std::atomic<Chain*> active;
+    mutable std::atomic<int> readers{ 0 };
+
+    // Writer side only.
+    std::mutex writer_mutex;
+    std::vector<Chain*> retired;
+
+    void publish(std::unique_ptr<Chain> chain);
+    void collect_retired();
 
 public:
+    AudioProcessor();
+    ~AudioProcessor();
+
+    AudioProcessor(const AudioProcessor&) = delete;
+    AudioProcessor& operator=(const AudioProcessor&) = delete;
+
+    // Any thread except the audio thread.
     void add_plugin(std::shared_ptr<AudioEffectPlugin> plugin);
+    void remove_plugin(const std::shared_ptr<AudioEffectPlugin>& plugin);
+    void set_plugins(std::vector<std::shared_ptr<AudioEffectPlugin>> plugins);
+
     void process_audio(float* buffer, int buffer_size);
+
+    // Speech if any plugin heard speech in the last buffer, silence if a plugin reported silence and none
+    // reported speech, unknown when no plugin detects voice at all.
+    VoiceActivity voice_activity() const;
 };
 
 #endif //SPEAKLY_AUDIO_PROCESSOR_H
@@ -1,27 +1,42 @@
+#include <algorithm>
+
 #include "high_pass_plugin.h"
 
-HighPassPlugin::HighPassPlugin(float timeConstant) : timeConstant(timeConstant), prevSample(0.0) {}
+HighPassPlugin::HighPassPlugin(float cutoff_hz, int sample_rate, int order)
+    : AudioEffectPlugin("High Pass"),
+      sample_rate(sample_rate),
+      order(std::clamp((order + 1) / 2 * 2, 2, static_cast<int>(2 * MAX_BIQUAD_SECTIONS))),
+      cutoff_hz(cutoff_hz, sample_rate / 50) {
+    design();
+}
+
+// While the cutoff is gliding, coefficients are redesigned every this many samples.
+constexpr int CUTOFF_SMOOTHING_CHUNK = 32;
 
 void HighPassPlugin::process(float* buffer, int buffer_size) {
-    for (int i = 0; i < buffer_size; ++i) {
-        // Calculate the high-pass filtered value
-        double inputSample = static_cast<double>(buffer[i]);
-        double filteredValue = inputSample - prevSample + timeConstant * prevSample;
-
-        // Update the previous sample and buffer with the filtered value
-        prevSample = filteredValue;
-        buffer[i] = filteredValue;
+    cutoff_hz.update();
+
+    int offset = 0;
+    while (cutoff_hz.smoothing() && offset < buffer_size) {
+        const int count = std::min(CUTOFF_SMOOTHING_CHUNK, buffer_size - offset);
+        cutoff_hz.advance(count);
+        design();
+        filter.process(buffer + offset, static_cast<size_t>(count));
+        offset += count;
     }
+
+    filter.process(buffer + offset, static_cast<size_t>(buffer_size - offset));
 }
 
-void HighPassPlugin::set_time_constant(float timeConstant) {
-    // Ensure the time constant is within a valid range (0 < timeConstant < 1)
-    if (timeConstant > 1.0) {
-        timeConstant = 1.0;
-    }
-    else if (timeConstant < 0.0) {
-        timeConstant = 0.0;
-    }
+void HighPassPlugin::set_cutoff(float cutoff_hz) {
+    this->cutoff_hz.set(cutoff_hz);
+}
 
-    this->timeConstant = timeConstant;
-}
\ No newline at end of file
+void HighPassPlugin::design() {
+    BiquadCoefficients sections[MAX_BIQUAD_SECTIONS];
+    const int count = order / 2;
+    for (int i = 0; i < count; ++i) {
+        sections[i] = biquad::design(BiquadType::HIGH_PASS, sample_rate, cutoff_hz.value(), biquad::butterworth_q(order, i));
+    }
+    filter.set_sections(sections, count);
+}
@@ -3,18 +3,28 @@
 #pragma once
 
 #include "audio_effect_plugin.h"
+#include "plugin_parameter.h"
+#include "../biquad.h"
 
+// Butterworth high-pass built from cascaded biquads, used to strip rumble and DC before the gate.
 class HighPassPlugin : public AudioEffectPlugin {
 private:
-    double timeConstant;
-    double prevSample;
+    int sample_rate;
+    int order;
+    SmoothedParameter cutoff_hz;
+    BiquadCascade filter;
+
+    void design();
 
 public:
-    HighPassPlugin(float timeConstant);
+    // order is rounded up to an even number and capped at 2 * MAX_BIQUAD_SECTIONS.
+    HighPassPlugin(float cutoff_hz, int sample_rate, int order = 4);
 
     void process(float* buffer, int buffer_size) override;
 
-    void set_time_constant(float timeConstant);
+    // Safe to call from any thread; the audio thread glides to the new cutoff over 20ms.
+    void set_cutoff(float cutoff_hz);
+    float get_cutoff() const { return cutoff_hz.get_target(); }
 };
 
 #endif //SPEAKLY_HIGH_PASS_PLUGIN_H
@@ -1,56 +1,172 @@
+#include <algorithm>
+#include <cmath>
+
 #include "noise_gate_plugin.h"
-#include "../common.h"
+#include "../level_meter.h"
 
-NoiseGatePlugin::NoiseGatePlugin() : AudioEffectPlugin("Noise Gate") {
+namespace {
+    // First sample of a quarter of the detector window; the last quarter takes any remainder.
+    size_t quarter_start(size_t quarter, size_t window) {
+        return quarter * window / NOISE_GATE_QUARTERS;
+    }
 }
 
-void NoiseGatePlugin::process(float* buffer, int buffer_size) {
+NoiseGatePlugin::NoiseGatePlugin(int sample_rate) : AudioEffectPlugin("Noise Gate"), sample_rate(sample_rate) {
+    // 1ms detector window: short enough to open on a plosive, long enough to average over a cycle of voice.
+    detector_samples = std::max(1, sample_rate / 1000);
+    previous_window.assign(detector_samples, 0.0f);
+    current_window.assign(detector_samples, 0.0f);
+    update_parameters();
+}
 
-    std::vector<float> input_data(buffer, buffer + buffer_size);
+void NoiseGatePlugin::set_threshold(double threshold_db) {
+    this->threshold_db.store(threshold_db);
+}
 
-    // Calculate RMS
-    float sum_squared = 0.0f;
-    for (int i = 0; i < buffer_size; ++i) {
-        sum_squared += buffer[i] * buffer[i];
-    }
-    float rms = sqrt(sum_squared / buffer_size);
+void NoiseGatePlugin::set_timing(double attack_ms, double hold_ms, double release_ms) {
+    this->attack_ms.store(attack_ms);
+    this->hold_ms.store(hold_ms);
+    this->release_ms.store(release_ms);
+}
 
-    float db = 20.0f * log10(rms) + 30;
+void NoiseGatePlugin::update_parameters() {
+    // Compare the window's energy against the thresholds' so the detector never divides, takes a log or a root.
+    const double threshold = threshold_db.load();
+    open_energy = std::pow(10.0, threshold / 10.0) * detector_samples;
+    close_energy = std::pow(10.0, (threshold + mumble_threshold) / 10.0) * detector_samples;
 
-    int time_now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    hold_samples = static_cast<int>(hold_ms.load() * sample_rate / 1000.0);
+    attack_step = 1.0f / std::max(1.0f, static_cast<float>(attack_ms.load() * sample_rate / 1000.0));
+    release_step = 1.0f / std::max(1.0f, static_cast<float>(release_ms.load() * sample_rate / 1000.0));
+}
 
-    if (db >= threshold_db) {
-        if (!active) {
-            active = true;
-            initial_activation_time = time_now;
-        }
-        last_activation_time = time_now;
-    }
-    else if (active && db >= (threshold_db + mumble_threshold)) {
-        last_activation_time = time_now;
+void NoiseGatePlugin::process(float* buffer, int buffer_size) {
+    // Bitwise or so every parameter consumes its pending change.
+    if (threshold_db.changed() | attack_ms.changed() | hold_ms.changed() | release_ms.changed()) {
+        update_parameters();
     }
 
-    if (active) {
-        int time_since_start = time_now - initial_activation_time;
-        int time_since_last_activation = time_now - last_activation_time;
+    const size_t window = static_cast<size_t>(detector_samples);
+    size_t done = 0;
+    while (done < static_cast<size_t>(buffer_size)) {
+        // Each stretch stays within one quarter of the window.
+        size_t quarter = 0;
+        while (quarter_start(quarter + 1, window) <= phase) {
+            ++quarter;
+        }
+        const size_t start = quarter_start(quarter, window);
+        const size_t stop = quarter_start(quarter + 1, window);
+        const size_t count = std::min(static_cast<size_t>(buffer_size) - done, stop - phase);
+        float* samples = buffer + done;
+        std::copy(samples, samples + count, current_window.begin() + static_cast<std::ptrdiff_t>(phase));
+
+        const size_t measured = phase + count - start;
+        const level_meter::Level level = level_meter::measure(current_window.data() + start, measured);
+        const float energy = level.mean_square * static_cast<float>(measured);
+        if (phase + count == stop) {
+            current_energy[quarter] = energy;
+            current_peak[quarter] = level.peak;
+        }
 
-        if (time_since_last_activation >= release_time) {
-            // Deactivate the noise gate and mute the buffer
-            active = false;
-            initial_activation_time = 0;
-            memset(buffer, 0, buffer_size * sizeof(float));
+        // The window behind any sample of the stretch holds part of the previous window and part of this
+        // one up to the stretch's end, so it has no more energy than both together and no louder a sample.
+        // While the gate is open it also holds all of this window before the quarter, or all of the
+        // previous window after it.
+        double before = 0.0;
+        double total = energy;
+        double after = 0.0;
+        float peak = level.peak;
+        for (size_t q = 0; q < NOISE_GATE_QUARTERS; ++q) {
+            total += previous_energy[q] + (q < quarter ? current_energy[q] : 0.0f);
+            before += q < quarter ? current_energy[q] : 0.0f;
+            after += q > quarter ? previous_energy[q] : 0.0;
+            peak = std::max({ peak, previous_peak[q], q < quarter ? current_peak[q] : 0.0f });
         }
-        else if (time_since_start <= attack_time) {
-            // Apply fade-in (attack) effect
-            float exponent = 2.0f; // Adjust the exponent for the fade-in curve
-            float fade = pow(static_cast<float>(time_since_start) / attack_time, exponent);
+        const double upper = std::min(total, static_cast<double>(peak) * peak * static_cast<double>(window));
+        // Covers the rounding in the measured energies and in the sliding sum.
+        const double tolerance = 1e-4 * total;
 
-            for (int i = 0; i < buffer_size; ++i) {
-                buffer[i] *= fade;
+        if (upper + tolerance < (open ? close_energy : open_energy)) {
+            // Nothing in the stretch can open the gate or hold it.
+            size_t i = 0;
+            if (open && hold_remaining > static_cast<int>(count)) {
+                hold_remaining -= static_cast<int>(count);
+                ramp_up(samples, count);
+                i = count;
+            }
+            for (; i < count && (open || gain > 0.0f); ++i) {
+                step(samples[i], false, false);
             }
+            std::fill(samples + i, samples + count, 0.0f);
         }
+        else if (open && std::max(before, after) - tolerance >= close_energy) {
+            // Every sample of the stretch holds the gate open.
+            hold_remaining = hold_samples;
+            ramp_up(samples, count);
+        }
+        else {
+            for (size_t i = 0; i < count; ++i) {
+                const size_t at = phase + i;
+                if (at + 1 == window) {
+                    // The window is exactly the current one: start from its measured energy rather than the
+                    // running sum, so rounding cannot build up.
+                    window_energy = 0.0;
+                    for (float quarter_energy : current_energy) {
+                        window_energy += quarter_energy;
+                    }
+                    energy_phase = window;
+                }
+                for (; energy_phase <= at; ++energy_phase) {
+                    const float square = current_window[energy_phase] * current_window[energy_phase];
+                    window_energy += square - previous_window[energy_phase] * previous_window[energy_phase];
+                }
+                step(samples[i], window_energy >= open_energy, window_energy >= close_energy);
+            }
+        }
+
+        phase += count;
+        done += count;
+        if (phase == window) {
+            std::swap(previous_window, current_window);
+            previous_energy = current_energy;
+            previous_peak = current_peak;
+            phase = 0;
+            energy_phase = 0;
+            window_energy = 0.0;
+            for (float quarter_energy : previous_energy) {
+                window_energy += quarter_energy;
+            }
+        }
+    }
+}
+
+void NoiseGatePlugin::step(float& sample, bool above_open, bool above_close) {
+    if (above_open || (open && above_close)) {
+        open = true;
+        hold_remaining = hold_samples;
+    }
+    else if (open && --hold_remaining <= 0) {
+        open = false;
     }
-    else {
-        memset(buffer, 0, buffer_size * sizeof(float));
+
+    if (!open && gain == 0.0f) {
+        sample = 0.0f;
+        return;
+    }
+
+    // The applied gain is squared, matching the old fade-in curve, so the start of the attack is gentle.
+    gain = open ? std::min(1.0f, gain + attack_step) : std::max(0.0f, gain - release_step);
+    sample *= gain * gain;
+}
+
+void NoiseGatePlugin::ramp_up(float* samples, size_t count) {
+    for (size_t i = 0; i < count && gain < 1.0f; ++i) {
+        gain = std::min(1.0f, gain + attack_step);
+        samples[i] *= gain * gain;
     }
-}
\ No newline at end of file
+}
+
+VoiceActivity NoiseGatePlugin::voice_activity() const {
+    // Still speech while the release ramp plays out, so the encoder does not cut the tail off.
+    return open || gain > 0.0f ? VoiceActivity::SPEECH : VoiceActivity::SILENCE;
+}
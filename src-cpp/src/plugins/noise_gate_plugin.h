@@ -2,22 +2,80 @@
 #define SPEAKLY_NOISE_GATE_PLUGIN_H
 #pragma once
 
+#include <array>
+#include <cstddef>
+#include <vector>
+
 #include "audio_effect_plugin.h"
+#include "plugin_parameter.h"
+
+// Level-triggered gate with hysteresis.
+//
+// The level is the RMS of the trailing 1ms of input, updated every sample, and all timing is counted in
+// samples: the gate opens on the first sample whose window reaches the threshold and closes exactly
+// hold_ms after the last one above the close threshold, whatever the block size. Gain follows a
+// per-sample envelope: a ramp up on attack, held open while the level stays above the close threshold,
+// then a ramp down on release.
+//
+// The input is measured a quarter of a window at a time with level_meter::measure, on a grid aligned with
+// the stream. Peaks and energies of the quarters bound the window over each stretch: clearly below the
+// threshold or, while open, clearly above the close threshold, the whole stretch is decided at once. Only
+// stretches near a threshold slide the window sample by sample, so the edges stay exact.
+constexpr size_t NOISE_GATE_QUARTERS = 4;
 
 class NoiseGatePlugin : public AudioEffectPlugin {
 private:
-    bool active = false;
-
-    double threshold_db = -8.0;
+    // Levels in dBFS. The gate opens at threshold_db and, once open, stays open down to
+    // threshold_db + mumble_threshold.
+    AtomicParameter<double> threshold_db{ -38.0 };
     double mumble_threshold = -3.0;
 
-    int attack_time = 10;
-    int release_time = 800;
-    int last_activation_time = 0;
-    int initial_activation_time = 0;
+    AtomicParameter<double> attack_ms{ 10.0 };
+    AtomicParameter<double> hold_ms{ 800.0 };
+    AtomicParameter<double> release_ms{ 50.0 };
+
+    // Derived from the settings above when they change, so process() does no conversions. Only the
+    // audio thread touches these after construction.
+    double open_energy = 0.0;
+    double close_energy = 0.0;
+    int detector_samples = 0;
+    int hold_samples = 0;
+    float attack_step = 0.0f;
+    float release_step = 0.0f;
+
+    int sample_rate;
+    // The last full window of input and the one being filled, phase samples in, with the energy and peak
+    // of each completed quarter.
+    std::vector<float> previous_window;
+    std::vector<float> current_window;
+    size_t phase = 0;
+    std::array<float, NOISE_GATE_QUARTERS> previous_energy{};
+    std::array<float, NOISE_GATE_QUARTERS> previous_peak{};
+    std::array<float, NOISE_GATE_QUARTERS> current_energy{};
+    std::array<float, NOISE_GATE_QUARTERS> current_peak{};
+    // Energy of the window ending energy_phase samples into current_window; only slid forward when a
+    // stretch needs the exact level.
+    double window_energy = 0.0;
+    size_t energy_phase = 0;
+    bool open = false;
+    int hold_remaining = 0;
+    float gain = 0.0f;
+
+    void update_parameters();
+    // One sample of the gate, given where its window stands against the thresholds.
+    void step(float& sample, bool above_open, bool above_close);
+    // Attack ramp while open; samples past the end of the ramp pass unchanged.
+    void ramp_up(float* samples, size_t count);
+
 public:
-    NoiseGatePlugin();
+    explicit NoiseGatePlugin(int sample_rate);
 
     void process(float* buffer, int buffer_size) override;
+
+    VoiceActivity voice_activity() const override;
+
+    // Safe to call from any thread; picked up at the start of the next block.
+    void set_threshold(double threshold_db);
+    void set_timing(double attack_ms, double hold_ms, double release_ms);
 };
 #endif //SPEAKLY_NOISE_GATE_PLUGIN_H
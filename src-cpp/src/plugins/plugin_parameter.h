@@ -0,0 +1,107 @@
+#ifndef SPEAKLY_PLUGIN_PARAMETER_H
+#define SPEAKLY_PLUGIN_PARAMETER_H
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// A plugin setting written from the UI (or any other) thread and read by the audio thread without locks.
+//
+// Writers store the value and bump a version; the audio thread calls changed() once per block and
+// recomputes whatever it derives from the value only when that returns true. Copying is only meant for
+// setting a plugin up before it is shared with the audio thread.
+template <typename T>
+class AtomicParameter {
+private:
+    std::atomic<T> value;
+    std::atomic<uint32_t> version{ 0 };
+    uint32_t seen_version = 0;
+
+public:
+    explicit AtomicParameter(T initial) : value(initial) {}
+    AtomicParameter(const AtomicParameter& other) : value(other.load()) {}
+    AtomicParameter& operator=(const AtomicParameter&) = delete;
+
+    void store(T new_value) {
+        value.store(new_value, std::memory_order_relaxed);
+        version.fetch_add(1, std::memory_order_release);
+    }
+
+    T load() const {
+        return value.load(std::memory_order_relaxed);
+    }
+
+    // Audio thread only. True once after any number of stores.
+    bool changed() {
+        const uint32_t current = version.load(std::memory_order_acquire);
+        if (current == seen_version) {
+            return false;
+        }
+        seen_version = current;
+        return true;
+    }
+};
+
+// A reading the audio thread publishes for the UI, such as a level meter. Relaxed: readers only need
+// some recent value, not one consistent with anything else.
+template <typename T>
+class MeterValue {
+private:
+    std::atomic<T> value;
+
+public:
+    explicit MeterValue(T initial) : value(initial) {}
+    MeterValue(const MeterValue& other) : value(other.load()) {}
+    MeterValue& operator=(const MeterValue&) = delete;
+
+    void store(T new_value) { value.store(new_value, std::memory_order_relaxed); }
+    T load() const { return value.load(std::memory_order_relaxed); }
+};
+
+// An AtomicParameter the audio thread glides towards over a fixed number of samples instead of jumping,
+// so changing a gain or a cutoff mid-stream does not click.
+class SmoothedParameter {
+private:
+    AtomicParameter<float> target;
+    float current;
+    float destination;
+    float step = 0.0f;
+    int remaining = 0;
+    int ramp_samples;
+
+public:
+    SmoothedParameter(float initial, int ramp_samples) : target(initial), current(initial), destination(initial), ramp_samples(ramp_samples) {}
+
+    // Any thread.
+    void set(float value) { target.store(value); }
+    float get_target() const { return target.load(); }
+
+    // Audio thread: call at the start of each block to pick up a new target.
+    void update() {
+        if (target.changed()) {
+            destination = target.load();
+            remaining = ramp_samples > 0 ? ramp_samples : 1;
+            step = (destination - current) / static_cast<float>(remaining);
+        }
+    }
+
+    // Audio thread: advances the ramp by count samples and returns the value reached.
+    float advance(int count = 1) {
+        if (remaining > 0) {
+            if (count >= remaining) {
+                current = destination;
+                remaining = 0;
+            }
+            else {
+                current += step * static_cast<float>(count);
+                remaining -= count;
+            }
+        }
+        return current;
+    }
+
+    float value() const { return current; }
+    bool smoothing() const { return remaining > 0; }
+};
+
+#endif //SPEAKLY_PLUGIN_PARAMETER_H
@@ -0,0 +1,100 @@
+#if defined(SPEAKLY_WITH_RNNOISE)
+
+#include <chrono>
+#include <rnnoise.h>
+
+#include "rnnoise_plugin.h"
+#include "../logger.h"
+
+// Consecutive frames over budget before the plugin bypasses itself, so one preempted frame does not trip it.
+constexpr int OVER_BUDGET_FRAME_LIMIT = 3;
+// How long a bypass lasts before trying again: 5 seconds of 10ms frames.
+constexpr int BYPASS_FRAMES = 500;
+
+RnnoisePlugin::RnnoisePlugin(const std::string& model_path, double budget_us)
+    : AudioEffectPlugin("RNNoise"), budget_us(budget_us) {
+    if (!model_path.empty() && model_file.open(model_path)) {
+        model = rnnoise_model_from_buffer(model_file.data(), static_cast<int>(model_file.size()));
+        if (model == nullptr) {
+            logger::Logger::get_instance().log(logger::LogLevel::L_WARNING, "Could not load RNNoise model " + model_path + ", using the built-in model.");
+            model_file.close();
+        }
+    }
+
+    state = rnnoise_create(model);
+    if (state == nullptr) {
+        logger::Logger::get_instance().log(logger::LogLevel::L_ERROR, "Could not create RNNoise state, denoising is disabled.");
+    }
+}
+
+RnnoisePlugin::~RnnoisePlugin() {
+    if (state != nullptr) {
+        rnnoise_destroy(state);
+    }
+    if (model != nullptr) {
+        rnnoise_model_free(model);
+    }
+}
+
+void RnnoisePlugin::process(float* buffer, int buffer_size) {
+    if (state == nullptr || buffer_size % RNNOISE_FRAME_SIZE != 0) {
+        return;
+    }
+
+    if (bypass_remaining > 0) {
+        bypass_remaining -= buffer_size / RNNOISE_FRAME_SIZE;
+        if (bypass_remaining <= 0) {
+            bypassed.store(false, std::memory_order_relaxed);
+        }
+        return;
+    }
+
+    const double budget = budget_us.load();
+
+    for (int offset = 0; offset < buffer_size; offset += RNNOISE_FRAME_SIZE) {
+        float* frame = buffer + offset;
+        const auto start = std::chrono::steady_clock::now();
+
+        // RNNoise works on 16-bit sample magnitudes.
+        for (int i = 0; i < RNNOISE_FRAME_SIZE; ++i) {
+            scaled[i] = frame[i] * 32768.0f;
+        }
+        const float probability = rnnoise_process_frame(state, scaled, scaled);
+        for (int i = 0; i < RNNOISE_FRAME_SIZE; ++i) {
+            frame[i] = scaled[i] * (1.0f / 32768.0f);
+        }
+
+        const double elapsed_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        average_us = average_us == 0.0 ? elapsed_us : average_us + 0.05 * (elapsed_us - average_us);
+        vad_probability.store(probability, std::memory_order_relaxed);
+
+        over_budget_frames = elapsed_us > budget ? over_budget_frames + 1 : 0;
+        if (over_budget_frames >= OVER_BUDGET_FRAME_LIMIT) {
+            over_budget_frames = 0;
+            bypass_remaining = BYPASS_FRAMES;
+            bypassed.store(true, std::memory_order_relaxed);
+            bypass_count.fetch_add(1, std::memory_order_relaxed);
+            break;
+        }
+    }
+
+    published_average_us.store(average_us, std::memory_order_relaxed);
+}
+
+VoiceActivity RnnoisePlugin::voice_activity() const {
+    if (state == nullptr || bypassed.load(std::memory_order_relaxed)) {
+        return VoiceActivity::UNKNOWN;
+    }
+    return vad_probability.load(std::memory_order_relaxed) >= vad_threshold.load() ? VoiceActivity::SPEECH : VoiceActivity::SILENCE;
+}
+
+RnnoiseStats RnnoisePlugin::get_stats() const {
+    RnnoiseStats stats;
+    stats.vad_probability = vad_probability.load(std::memory_order_relaxed);
+    stats.bypassed = bypassed.load(std::memory_order_relaxed);
+    stats.bypass_count = bypass_count.load(std::memory_order_relaxed);
+    stats.average_process_us = published_average_us.load(std::memory_order_relaxed);
+    return stats;
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef SPEAKLY_RNNOISE_PLUGIN_H
+#define SPEAKLY_RNNOISE_PLUGIN_H
+#pragma once
+
+#if defined(SPEAKLY_WITH_RNNOISE)
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "audio_effect_plugin.h"
+#include "plugin_parameter.h"
+#include "../mapped_file.h"
+
+struct DenoiseState;
+struct RNNModel;
+
+// RNNoise processes fixed 10ms frames at 48kHz.
+constexpr int RNNOISE_FRAME_SIZE = 480;
+
+struct RnnoiseStats {
+    float vad_probability;
+    bool bypassed;
+    // Times the plugin switched itself off for running over budget.
+    uint64_t bypass_count;
+    double average_process_us;
+};
+
+// RNNoise denoiser.
+//
+// A model file is memory-mapped rather than read into the heap; without one the library's built-in
+// model is used. All state is created up front so process() never allocates. Each frame is timed and,
+// if the denoiser keeps overrunning its CPU budget, it passes audio through untouched for a while
+// instead of starving the encoder. The per-frame speech probability drives voice_activity().
+class RnnoisePlugin : public AudioEffectPlugin {
+private:
+    MappedFile model_file;
+    RNNModel* model = nullptr;
+    DenoiseState* state = nullptr;
+
+    float scaled[RNNOISE_FRAME_SIZE];
+
+    AtomicParameter<double> budget_us;
+    AtomicParameter<float> vad_threshold{ 0.5f };
+
+    double average_us = 0.0;
+    int over_budget_frames = 0;
+    int bypass_remaining = 0;
+
+    std::atomic<float> vad_probability{ 0.0f };
+    std::atomic<bool> bypassed{ false };
+    std::atomic<uint64_t> bypass_count{ 0 };
+    std::atomic<double> published_average_us{ 0.0 };
+
+public:
+    // An empty or missing model_path falls back to the built-in model.
+    explicit RnnoisePlugin(const std::string& model_path, double budget_us = 3000.0);
+    ~RnnoisePlugin();
+
+    RnnoisePlugin(const RnnoisePlugin&) = delete;
+    RnnoisePlugin& operator=(const RnnoisePlugin&) = delete;
+
+    bool is_loaded() const { return state != nullptr; }
+
+    void process(float* buffer, int buffer_size) override;
+
+    // Unknown while bypassed, so the gate alone decides.
+    VoiceActivity voice_activity() const override;
+
+    // Safe to call from any thread.
+    void set_budget(double budget_us) { this->budget_us.store(budget_us); }
+    void set_vad_threshold(float threshold) { vad_threshold.store(threshold); }
+    RnnoiseStats get_stats() const;
+};
+
+#endif
+
+#endif //SPEAKLY_RNNOISE_PLUGIN_H
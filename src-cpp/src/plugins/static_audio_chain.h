@@ -0,0 +1,58 @@
+#ifndef SPEAKLY_STATIC_AUDIO_CHAIN_H
+#define SPEAKLY_STATIC_AUDIO_CHAIN_H
+#pragma once
+
+#include <cstddef>
+#include <tuple>
+#include <utility>
+
+#include "audio_effect_plugin.h"
+
+// A plugin chain fixed at compile time.
+//
+// The members run one after another over the whole block, each through a qualified, non-virtual call
+// the compiler can inline. They are deliberately not fused into one per-sample loop: every member has
+// block-level work (the vectorized biquad pipeline, block loudness, the look-ahead limiter) that a
+// per-sample loop would defeat. The class is final, so a call through a CaptureChain pointer is not
+// virtual either; it can still sit inside a runtime AudioProcessor, at the cost of one virtual call.
+template <typename... Plugins>
+class StaticAudioChain final : public AudioEffectPlugin {
+private:
+    std::tuple<Plugins...> plugins;
+
+public:
+    template <typename... Args>
+    explicit StaticAudioChain(Args&&... args) : AudioEffectPlugin("Static Audio Chain"), plugins(std::forward<Args>(args)...) {}
+
+    void process(float* buffer, int buffer_size) override {
+        std::apply([buffer, buffer_size](Plugins&... plugin) {
+            (plugin.Plugins::process(buffer, buffer_size), ...);
+        }, plugins);
+    }
+
+    VoiceActivity voice_activity() const override {
+        VoiceActivity result = VoiceActivity::UNKNOWN;
+        std::apply([&result](const Plugins&... plugin) {
+            ((result = combine(result, plugin.Plugins::voice_activity())), ...);
+        }, plugins);
+        return result;
+    }
+
+    template <size_t Index>
+    auto& get() {
+        return std::get<Index>(plugins);
+    }
+
+private:
+    static VoiceActivity combine(VoiceActivity current, VoiceActivity next) {
+        if (current == VoiceActivity::SPEECH || next == VoiceActivity::SPEECH) {
+            return VoiceActivity::SPEECH;
+        }
+        if (current == VoiceActivity::SILENCE || next == VoiceActivity::SILENCE) {
+            return VoiceActivity::SILENCE;
+        }
+        return VoiceActivity::UNKNOWN;
+    }
+};
+
+#endif //SPEAKLY_STATIC_AUDIO_CHAIN_H
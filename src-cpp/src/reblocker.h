@@ -0,0 +1,48 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+
+// Collects samples arriving in blocks of any size into frames of exactly frame_size.
+//
+// Samples are never dropped: whatever does not complete a frame stays queued for the next write, so
+// every sample waits the same time relative to the frame grid and latency stays constant. Storage is
+// allocated once; write() is safe on the audio thread.
+class Reblocker {
+public:
+	explicit Reblocker(size_t frame_size) : frame_size_(frame_size), buffer_(std::make_unique<float[]>(frame_size)) {}
+
+	Reblocker(const Reblocker&) = delete;
+	Reblocker& operator=(const Reblocker&) = delete;
+
+	// Copies up to count samples towards the current frame and returns how many were taken. Stops at a
+	// frame boundary, so call full() after each write.
+	size_t write(const float* data, size_t count) {
+		const size_t taken = std::min(count, frame_size_ - filled_);
+		std::copy(data, data + taken, buffer_.get() + filled_);
+		filled_ += taken;
+		return taken;
+	}
+
+	// Adds count samples of silence, for a stream that has nothing to contribute to this stretch.
+	size_t write_silence(size_t count) {
+		const size_t taken = std::min(count, frame_size_ - filled_);
+		std::fill(buffer_.get() + filled_, buffer_.get() + filled_ + taken, 0.0f);
+		filled_ += taken;
+		return taken;
+	}
+
+	bool full() const { return filled_ == frame_size_; }
+	bool empty() const { return filled_ == 0; }
+	size_t pending() const { return filled_; }
+	const float* frame() const { return buffer_.get(); }
+
+	// Starts the next frame once the current one has been consumed.
+	void clear() { filled_ = 0; }
+
+private:
+	size_t frame_size_;
+	std::unique_ptr<float[]> buffer_;
+	size_t filled_ = 0;
+};
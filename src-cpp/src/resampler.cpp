@@ -0,0 +1,153 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "resampler.h"
+#include "simd.h"
+
+// Passband edge as a share of the lower Nyquist frequency; the rest is the transition band.
+constexpr double PASSBAND = 0.9;
+// Kaiser window shape for roughly 100dB of stopband attenuation, which keeps passband tones above 100dB SNR.
+constexpr double KAISER_BETA = 10.0;
+// Coefficients per phase when interpolating; decimation widens it so the filter stays as sharp.
+constexpr size_t BASE_TAPS_PER_PHASE = 40;
+
+static double bessel_i0(double x) {
+	double sum = 1.0;
+	double term = 1.0;
+	for (int k = 1; k < 32; ++k) {
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+static float dot(const float* a, const float* b, size_t count) {
+	size_t i = 0;
+	float sum = 0.0f;
+
+#if defined(SPEAKLY_HAVE_AVX)
+	__m256 accumulator_256 = _mm256_setzero_ps();
+	for (; i + 8 <= count; i += 8) {
+		accumulator_256 = _mm256_add_ps(accumulator_256, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+	}
+	alignas(32) float lanes_256[8];
+	_mm256_store_ps(lanes_256, accumulator_256);
+	for (float lane : lanes_256) {
+		sum += lane;
+	}
+#endif
+#if defined(SPEAKLY_HAVE_SSE)
+	__m128 accumulator = _mm_setzero_ps();
+	for (; i + 4 <= count; i += 4) {
+		accumulator = _mm_add_ps(accumulator, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+	}
+	alignas(16) float lanes[4];
+	_mm_store_ps(lanes, accumulator);
+	sum += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+
+	for (; i < count; ++i) {
+		sum += a[i] * b[i];
+	}
+	return sum;
+}
+
+Resampler::Resampler(int input_rate, int output_rate) : input_rate(input_rate), output_rate(output_rate) {
+	const size_t divisor = std::gcd(input_rate, output_rate);
+	up = static_cast<size_t>(output_rate) / divisor;
+	down = static_cast<size_t>(input_rate) / divisor;
+
+	if (is_passthrough()) {
+		taps = 1;
+		phases.assign(1, 1.0f);
+		window.assign(MAX_CHUNK, 0.0f);
+		return;
+	}
+
+	// Round to a multiple of 8 so every dot product runs entirely in vector lanes.
+	taps = (BASE_TAPS_PER_PHASE * std::max(up, down) / up + 7) / 8 * 8;
+	const size_t length = up * taps;
+
+	// Cutoff relative to the upsampled rate, below whichever Nyquist frequency is lower.
+	const double cutoff = PASSBAND * 0.5 / static_cast<double>(std::max(up, down));
+	const double pi = 3.14159265358979323846;
+	const double centre = (length - 1) / 2.0;
+	const double window_norm = bessel_i0(KAISER_BETA);
+
+	std::vector<double> prototype(length);
+	for (size_t n = 0; n < length; ++n) {
+		const double t = n - centre;
+		const double sinc = t == 0.0 ? 2.0 * cutoff : std::sin(2.0 * pi * cutoff * t) / (pi * t);
+		const double r = t / centre;
+		const double kaiser = bessel_i0(KAISER_BETA * std::sqrt(std::max(0.0, 1.0 - r * r))) / window_norm;
+		// Interpolation spreads each input over up outputs, so each phase needs a gain of up.
+		prototype[n] = sinc * kaiser * static_cast<double>(up);
+	}
+
+	phases.assign(up * taps, 0.0f);
+	for (size_t phase = 0; phase < up; ++phase) {
+		for (size_t k = 0; k < taps; ++k) {
+			phases[phase * taps + k] = static_cast<float>(prototype[phase + (taps - 1 - k) * up]);
+		}
+	}
+
+	window.assign(taps - 1 + MAX_CHUNK, 0.0f);
+}
+
+size_t Resampler::max_output(size_t count) const {
+	return count * up / down + 1 + (count / MAX_CHUNK + 1);
+}
+
+void Resampler::reset() {
+	std::fill(window.begin(), window.end(), 0.0f);
+	offset = 0;
+}
+
+double Resampler::latency_seconds() const {
+	if (is_passthrough()) {
+		return 0.0;
+	}
+	// Group delay of a symmetric FIR is half its length, counted at the upsampled rate.
+	const double upsampled_rate = static_cast<double>(input_rate) * static_cast<double>(up);
+	return (static_cast<double>(up * taps) - 1.0) / 2.0 / upsampled_rate;
+}
+
+double Resampler::latency_output_samples() const {
+	return latency_seconds() * output_rate;
+}
+
+size_t Resampler::process(const float* in, size_t count, float* out) {
+	if (is_passthrough()) {
+		std::copy(in, in + count, out);
+		return count;
+	}
+
+	size_t produced = 0;
+	while (count > 0) {
+		const size_t chunk = std::min(count, MAX_CHUNK);
+		produced += process_chunk(in, chunk, out + produced);
+		in += chunk;
+		count -= chunk;
+	}
+	return produced;
+}
+
+size_t Resampler::process_chunk(const float* in, size_t count, float* out) {
+	const size_t history = taps - 1;
+	std::copy(in, in + count, window.begin() + history);
+
+	size_t produced = 0;
+	const size_t end = count * up;
+	while (offset < end) {
+		const size_t input_index = offset / up;
+		const size_t phase = offset % up;
+		out[produced++] = dot(phases.data() + phase * taps, window.data() + input_index, taps);
+		offset += down;
+	}
+	offset -= end;
+
+	// Keep the newest taps - 1 inputs for the next chunk.
+	std::copy(window.begin() + count, window.begin() + count + history, window.begin());
+	return produced;
+}
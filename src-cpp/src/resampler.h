@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Streaming polyphase resampler between two integer sample rates.
+//
+// The ratio is reduced to up/down factors L/M (160/147 between 44.1kHz and 48kHz) and a Kaiser-windowed
+// sinc prototype of L * taps_per_phase coefficients is split into L phases, each stored reversed so
+// an output sample is one contiguous dot product, vectorized with AVX/SSE. All memory is allocated in
+// the constructor, so process() is safe in an audio callback.
+class Resampler {
+public:
+	Resampler(int input_rate, int output_rate);
+
+	// Resamples count input samples into out and returns how many were written. out must have room for
+	// max_output(count) samples.
+	size_t process(const float* in, size_t count, float* out);
+
+	// Upper bound on the output of process(count).
+	size_t max_output(size_t count) const;
+
+	// Clears the history, as if the stream had just started.
+	void reset();
+
+	// Exact group delay of the filter, in seconds and in output samples.
+	double latency_seconds() const;
+	double latency_output_samples() const;
+
+	bool is_passthrough() const { return up == 1 && down == 1; }
+	int get_input_rate() const { return input_rate; }
+	int get_output_rate() const { return output_rate; }
+
+private:
+	// Largest input run processed at once; longer inputs are split.
+	static constexpr size_t MAX_CHUNK = 1024;
+
+	size_t process_chunk(const float* in, size_t count, float* out);
+
+	int input_rate;
+	int output_rate;
+	size_t up;
+	size_t down;
+	size_t taps;
+	// up phases of taps coefficients each, reversed.
+	std::vector<float> phases;
+	// taps - 1 samples of history followed by the current chunk.
+	std::vector<float> window;
+	// Position of the next output in the upsampled domain, relative to the current chunk's first sample.
+	size_t offset = 0;
+};
@@ -0,0 +1,15 @@
+#pragma once
+
+// Compile-time SIMD selection shared by the DSP code. Every vectorized routine keeps a scalar
+// fallback so the tree still builds for targets without SSE.
+#if defined(__AVX__)
+#define SPEAKLY_HAVE_AVX 1
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SPEAKLY_HAVE_SSE 1
+#endif
+
+#if defined(SPEAKLY_HAVE_AVX) || defined(SPEAKLY_HAVE_SSE)
+#include <immintrin.h>
+#endif
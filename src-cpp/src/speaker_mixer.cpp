@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <opus/opus.h>
+
+#include "speaker_mixer.h"
+#include "mixer.h"
+#include "common.h"
+#include "latency_tracker.h"
+#include "metrics.h"
+
+namespace {
+	// A speaker that has not sent anything for this long gives its decoder back to the pool.
+	constexpr auto SPEAKER_IDLE_TIMEOUT = std::chrono::seconds(5);
+	constexpr auto RETIRE_CHECK_INTERVAL = std::chrono::seconds(1);
+	// Decoders created up front so the first few speakers never hit the allocator.
+	constexpr size_t PREALLOCATED_DECODERS = 8;
+
+	LatencyHistogram& decode_time_us = metrics::histogram("audio.decode_us");
+}
+
+SpeakerMixer::SpeakerMixer(int sample_rate, int channels, size_t frame_size)
+	: sample_rate(sample_rate), channels(channels), frame_size(frame_size),
+	decoder_pool(sample_rate, channels, PREALLOCATED_DECODERS, MAX_SPEAKERS),
+	speakers(std::make_unique<Speaker[]>(MAX_SPEAKERS)) {
+	for (size_t i = 0; i < MAX_SPEAKERS; ++i) {
+		speakers[i].jitter_buffer = std::make_unique<JitterBuffer>(sample_rate);
+		speakers[i].pcm = std::make_unique<float[]>(MAX_DECODE_SAMPLES * channels);
+	}
+}
+
+SpeakerMixer::~SpeakerMixer() {
+	for (size_t i = 0; i < MAX_SPEAKERS; ++i) {
+		decoder_pool.release(speakers[i].decoder);
+		speakers[i].decoder = nullptr;
+	}
+}
+
+bool SpeakerMixer::queue_packet(uint32_t speaker_id, uint16_t sequence, uint32_t timestamp, uint8_t flags, const unsigned char* data, size_t size,
+	std::chrono::steady_clock::time_point arrival) {
+	int duration = opus_packet_get_nb_samples(data, static_cast<opus_int32>(size), sample_rate);
+	if (duration <= 0) {
+		return false;
+	}
+
+	if (arrival - last_retire_check >= RETIRE_CHECK_INTERVAL) {
+		last_retire_check = arrival;
+		retire_idle_speakers(arrival);
+	}
+
+	Speaker* speaker = find_speaker(speaker_id);
+	if (speaker == nullptr) {
+		speaker = claim_speaker(speaker_id);
+		if (speaker == nullptr) {
+			return false;
+		}
+	}
+
+	speaker->last_heard.store(arrival.time_since_epoch().count(), std::memory_order_relaxed);
+	return speaker->jitter_buffer->insert(sequence, timestamp, duration, flags, data, size, arrival);
+}
+
+void SpeakerMixer::mix(float* output) {
+	const size_t sample_count = frame_size * channels;
+	std::fill(output, output + sample_count, 0.0f);
+
+	for (size_t i = 0; i < MAX_SPEAKERS; ++i) {
+		Speaker& speaker = speakers[i];
+		if (!speaker.active.load(std::memory_order_acquire)) {
+			continue;
+		}
+
+		std::lock_guard<std::mutex> lock(speaker.mutex);
+		if (!speaker.active.load(std::memory_order_relaxed)) {
+			continue;
+		}
+
+		size_t written = 0;
+		while (written < frame_size) {
+			if (speaker.pcm_available == 0) {
+				int decoded = decode(speaker, speaker.pcm.get());
+				if (decoded <= 0) {
+					break;
+				}
+				speaker.pcm_offset = 0;
+				speaker.pcm_available = static_cast<size_t>(decoded);
+			}
+
+			size_t count = std::min(frame_size - written, speaker.pcm_available);
+			mixer::accumulate(output + written * channels, speaker.pcm.get() + speaker.pcm_offset * channels, count * channels);
+			speaker.pcm_offset += count;
+			speaker.pcm_available -= count;
+			written += count;
+		}
+	}
+
+	mixer::soft_limit(output, sample_count);
+}
+
+void SpeakerMixer::set_tracked_speaker(uint32_t speaker_id) {
+	tracked_speaker_id = speaker_id;
+}
+
+bool SpeakerMixer::take_tracked_packet(uint16_t& sequence) {
+	if (!tracked_packet_decoded) {
+		return false;
+	}
+	tracked_packet_decoded = false;
+	sequence = tracked_sequence;
+	return true;
+}
+
+size_t SpeakerMixer::active_speakers() const {
+	size_t count = 0;
+	for (size_t i = 0; i < MAX_SPEAKERS; ++i) {
+		if (speakers[i].active.load(std::memory_order_relaxed)) {
+			count++;
+		}
+	}
+	return count;
+}
+
+std::vector<SpeakerStats> SpeakerMixer::get_stats() const {
+	std::vector<SpeakerStats> stats;
+
+	for (size_t i = 0; i < MAX_SPEAKERS; ++i) {
+		const Speaker& speaker = speakers[i];
+		std::lock_guard<std::mutex> lock(speaker.mutex);
+		if (speaker.active.load(std::memory_order_relaxed)) {
+			stats.push_back(SpeakerStats{ speaker.speaker_id, speaker.jitter_buffer->get_stats(), speaker.fec_recovered, speaker.concealed });
+		}
+	}
+
+	return stats;
+}
+
+SpeakerMixer::Speaker* SpeakerMixer::find_speaker(uint32_t speaker_id) {
+	for (size_t i = 0; i < MAX_SPEAKERS; ++i) {
+		Speaker& speaker = speakers[i];
+		// speaker_id is only ever written by this (network) thread, so reading it here is safe.
+		if (speaker.active.load(std::memory_order_acquire) && speaker.speaker_id == speaker_id) {
+			return &speaker;
+		}
+	}
+	return nullptr;
+}
+
+SpeakerMixer::Speaker* SpeakerMixer::claim_speaker(uint32_t speaker_id) {
+	for (size_t i = 0; i < MAX_SPEAKERS; ++i) {
+		Speaker& speaker = speakers[i];
+		if (speaker.active.load(std::memory_order_acquire)) {
+			continue;
+		}
+
+		OpusDecoder* decoder = decoder_pool.acquire();
+		if (decoder == nullptr) {
+			return nullptr;
+		}
+
+		std::lock_guard<std::mutex> lock(speaker.mutex);
+		speaker.speaker_id = speaker_id;
+		speaker.decoder = decoder;
+		speaker.jitter_buffer->reset();
+		speaker.fec_recovered = 0;
+		speaker.concealed = 0;
+		speaker.pcm_available = 0;
+		speaker.active.store(true, std::memory_order_release);
+
+		logger::Logger::get_instance().log(logger::LogLevel::L_INFO, "Speaker joined: %u", speaker_id);
+		return &speaker;
+	}
+
+	logger::Logger::get_instance().log(logger::LogLevel::L_WARNING, "Dropping speaker %u, all speaker slots in use", speaker_id);
+	return nullptr;
+}
+
+void SpeakerMixer::retire_idle_speakers(std::chrono::steady_clock::time_point now) {
+	const auto idle_before = (now - SPEAKER_IDLE_TIMEOUT).time_since_epoch().count();
+
+	for (size_t i = 0; i < MAX_SPEAKERS; ++i) {
+		Speaker& speaker = speakers[i];
+		if (!speaker.active.load(std::memory_order_acquire) || speaker.last_heard.load(std::memory_order_relaxed) > idle_before) {
+			continue;
+		}
+
+		std::lock_guard<std::mutex> lock(speaker.mutex);
+		speaker.active.store(false, std::memory_order_release);
+		decoder_pool.release(speaker.decoder);
+		speaker.decoder = nullptr;
+
+		logger::Logger::get_instance().log(logger::LogLevel::L_INFO, "Speaker left: %u", speaker.speaker_id);
+	}
+}
+
+int SpeakerMixer::decode(Speaker& speaker, float* output) {
+	const int max_samples = static_cast<int>(MAX_DECODE_SAMPLES);
+
+	switch (speaker.jitter_buffer->pop(speaker.packet)) {
+	case JitterBufferResult::PACKET: {
+		const int64_t decode_start = latency::now_ns();
+		latency::record(latency::Stage::JITTER,
+			decode_start - std::chrono::duration_cast<std::chrono::nanoseconds>(speaker.packet.arrival.time_since_epoch()).count());
+		int decoded = opus_decode_float(speaker.decoder, speaker.packet.data, static_cast<opus_int32>(speaker.packet.size), output, max_samples, 0);
+		const int64_t decode_ns = latency::now_ns() - decode_start;
+		latency::record(latency::Stage::DECODE, decode_ns);
+		decode_time_us.record(decode_ns / 1000);
+
+		if (speaker.speaker_id == tracked_speaker_id) {
+			tracked_packet_decoded = true;
+			tracked_sequence = speaker.packet.sequence;
+		}
+		return decoded;
+	}
+	case JitterBufferResult::MISSING:
+		return decode_missing(speaker, output);
+	case JitterBufferResult::GAP: {
+		// The sender paused transmission; the decoder is not involved so no concealment is heard.
+		const size_t samples = std::min(static_cast<size_t>(speaker.packet.duration), MAX_DECODE_SAMPLES);
+		std::fill(output, output + samples * channels, 0.0f);
+		return static_cast<int>(samples);
+	}
+	case JitterBufferResult::BUFFERING:
+	default:
+		return 0;
+	}
+}
+
+int SpeakerMixer::decode_missing(Speaker& speaker, float* output) {
+	// FEC and PLC must be asked for exactly the duration of the lost audio.
+	const int duration = std::min(static_cast<int>(speaker.packet.duration), static_cast<int>(MAX_DECODE_SAMPLES));
+	const uint16_t next_sequence = static_cast<uint16_t>(speaker.packet.sequence + 1);
+
+	if (speaker.jitter_buffer->peek(next_sequence, speaker.next_packet)) {
+		int decoded = opus_decode_float(speaker.decoder, speaker.next_packet.data, static_cast<opus_int32>(speaker.next_packet.size),
+			output, duration, 1);
+		if (decoded > 0) {
+			speaker.fec_recovered++;
+			return decoded;
+		}
+	}
+
+	speaker.concealed++;
+	return opus_decode_float(speaker.decoder, nullptr, 0, output, duration, 0);
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "decoder_pool.h"
+#include "jitter_buffer.h"
+
+// Upper bound on simultaneous remote speakers; each holds a jitter buffer and a decoder.
+constexpr size_t MAX_SPEAKERS = 64;
+// Longest packet duration a speaker may send (60ms at 48kHz).
+constexpr size_t MAX_DECODE_SAMPLES = 2880;
+
+struct SpeakerStats {
+	uint32_t speaker_id;
+	JitterBufferStats jitter;
+	// Lost frames rebuilt from the in-band FEC carried by the following packet.
+	uint64_t fec_recovered;
+	// Lost frames synthesised by Opus packet-loss concealment.
+	uint64_t concealed;
+};
+
+// Receives packets for every remote speaker in the room and mixes them into one output frame.
+//
+// Each speaker gets its own jitter buffer and its own Opus decoder drawn from a DecoderPool, so
+// streams never share decoder state. Packets are queued from the network thread; mix() is called
+// once per device period from the playout thread and never allocates.
+class SpeakerMixer {
+public:
+	SpeakerMixer(int sample_rate, int channels, size_t frame_size);
+	~SpeakerMixer();
+
+	SpeakerMixer(const SpeakerMixer&) = delete;
+	SpeakerMixer& operator=(const SpeakerMixer&) = delete;
+
+	// Network thread only.
+	bool queue_packet(uint32_t speaker_id, uint16_t sequence, uint32_t timestamp, uint8_t flags, const unsigned char* data, size_t size,
+		std::chrono::steady_clock::time_point arrival);
+
+	// Playout thread only. Writes exactly frame_size samples.
+	void mix(float* output);
+
+	// Marks whose packets to report through take_tracked_packet; used to time our own looped-back audio.
+	// Call before playout starts.
+	void set_tracked_speaker(uint32_t speaker_id);
+	// Playout thread only. True when the last mix() started a packet from the tracked speaker.
+	bool take_tracked_packet(uint16_t& sequence);
+
+	size_t active_speakers() const;
+	std::vector<SpeakerStats> get_stats() const;
+
+private:
+	struct Speaker {
+		mutable std::mutex mutex;
+		std::atomic<bool> active{ false };
+		std::atomic<int64_t> last_heard{ 0 };
+		uint32_t speaker_id = 0;
+		OpusDecoder* decoder = nullptr;
+		std::unique_ptr<JitterBuffer> jitter_buffer;
+		JitterBufferPacket packet;
+		JitterBufferPacket next_packet;
+		// Decoded audio not yet mixed; packets longer than one output frame are played out over several mix() calls.
+		std::unique_ptr<float[]> pcm;
+		size_t pcm_offset = 0;
+		size_t pcm_available = 0;
+		uint64_t fec_recovered = 0;
+		uint64_t concealed = 0;
+	};
+
+	Speaker* find_speaker(uint32_t speaker_id);
+	Speaker* claim_speaker(uint32_t speaker_id);
+	void retire_idle_speakers(std::chrono::steady_clock::time_point now);
+	int decode(Speaker& speaker, float* output);
+	int decode_missing(Speaker& speaker, float* output);
+
+	const int sample_rate;
+	const int channels;
+	const size_t frame_size;
+
+	uint32_t tracked_speaker_id = 0;
+	bool tracked_packet_decoded = false;
+	uint16_t tracked_sequence = 0;
+
+	DecoderPool decoder_pool;
+	std::unique_ptr<Speaker[]> speakers;
+	std::chrono::steady_clock::time_point last_retire_check;
+};
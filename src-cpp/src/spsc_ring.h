@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <algorithm>
+
+// Wait-free single-producer/single-consumer ring buffer.
+//
+// The producer (typically a PortAudio callback) only ever calls write(), the consumer only ever
+// calls read(). Neither side takes a lock or allocates; all storage is reserved up front.
+// Capacity is rounded up to a power of two so indices can be masked instead of divided.
+template <typename T>
+class SpscRing {
+public:
+	explicit SpscRing(size_t min_capacity) {
+		capacity_ = 1;
+		while (capacity_ < min_capacity) {
+			capacity_ <<= 1;
+		}
+		mask_ = capacity_ - 1;
+		buffer_ = std::make_unique<T[]>(capacity_);
+	}
+
+	SpscRing(const SpscRing&) = delete;
+	SpscRing& operator=(const SpscRing&) = delete;
+
+	// Producer side. Writes as many elements as fit and returns how many were written.
+	// Elements that do not fit are counted as overruns.
+	size_t write(const T* data, size_t count) {
+		const size_t head = head_.load(std::memory_order_relaxed);
+		const size_t tail = tail_.load(std::memory_order_acquire);
+		const size_t free_space = capacity_ - (head - tail);
+		const size_t to_write = std::min(count, free_space);
+
+		const size_t start = head & mask_;
+		const size_t first = std::min(to_write, capacity_ - start);
+		std::copy(data, data + first, buffer_.get() + start);
+		std::copy(data + first, data + to_write, buffer_.get());
+
+		head_.store(head + to_write, std::memory_order_release);
+
+		if (to_write < count) {
+			overruns_.fetch_add(count - to_write, std::memory_order_relaxed);
+		}
+
+		const size_t depth = head + to_write - tail;
+		if (depth > high_water_mark_.load(std::memory_order_relaxed)) {
+			high_water_mark_.store(depth, std::memory_order_relaxed);
+		}
+
+		return to_write;
+	}
+
+	// Consumer side. Reads up to count elements and returns how many were read.
+	size_t read(T* data, size_t count) {
+		const size_t tail = tail_.load(std::memory_order_relaxed);
+		const size_t head = head_.load(std::memory_order_acquire);
+		const size_t to_read = std::min(count, head - tail);
+
+		const size_t start = tail & mask_;
+		const size_t first = std::min(to_read, capacity_ - start);
+		std::copy(buffer_.get() + start, buffer_.get() + start + first, data);
+		std::copy(buffer_.get(), buffer_.get() + (to_read - first), data + first);
+
+		tail_.store(tail + to_read, std::memory_order_release);
+		return to_read;
+	}
+
+	// Consumer side. Drops everything currently queued.
+	void clear() {
+		tail_.store(head_.load(std::memory_order_acquire), std::memory_order_release);
+	}
+
+	// Consumer side. Drops the oldest elements until at most keep remain.
+	void trim(size_t keep) {
+		const size_t tail = tail_.load(std::memory_order_relaxed);
+		const size_t head = head_.load(std::memory_order_acquire);
+		if (head - tail > keep) {
+			tail_.store(head - keep, std::memory_order_release);
+		}
+	}
+
+	// Number of elements currently queued. Exact from either side, approximate from any other thread.
+	size_t size() const {
+		return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+	}
+
+	size_t capacity() const {
+		return capacity_;
+	}
+
+	// Deepest the ring has been since construction (or the last reset).
+	size_t high_water_mark() const {
+		return high_water_mark_.load(std::memory_order_relaxed);
+	}
+
+	void reset_high_water_mark() {
+		high_water_mark_.store(0, std::memory_order_relaxed);
+	}
+
+	// Total number of elements dropped because the ring was full.
+	uint64_t overruns() const {
+		return overruns_.load(std::memory_order_relaxed);
+	}
+
+private:
+	size_t capacity_;
+	size_t mask_;
+	std::unique_ptr<T[]> buffer_;
+
+	// Producer and consumer indices live on separate cache lines to avoid false sharing.
+	alignas(64) std::atomic<size_t> head_{ 0 };
+	alignas(64) std::atomic<size_t> tail_{ 0 };
+	alignas(64) std::atomic<size_t> high_water_mark_{ 0 };
+	std::atomic<uint64_t> overruns_{ 0 };
+};
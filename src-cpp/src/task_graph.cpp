@@ -0,0 +1,68 @@
+#include "task_graph.h"
+
+#include <future>
+#include <stdexcept>
+
+#include "common.h"
+
+TaskGraph::TaskId TaskGraph::add(const std::string& name, std::function<bool()> task, const std::vector<TaskId>& dependencies) {
+	for (TaskId dependency : dependencies) {
+		if (dependency >= tasks_.size()) {
+			throw std::invalid_argument("Task " + name + " depends on a task that was not added yet");
+		}
+	}
+
+	tasks_.push_back(Task{ std::move(task), dependencies });
+	timings_.push_back(TaskTiming{ name, false, false, 0.0, 0.0 });
+	return tasks_.size() - 1;
+}
+
+bool TaskGraph::run() {
+	const auto start = std::chrono::steady_clock::now();
+	auto elapsed_ms = [start]() {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	};
+
+	// Tasks are added after their dependencies, so every future a task waits on already exists. Each task
+	// writes only its own timing slot, and all of them are read after every future has been waited on.
+	std::vector<std::shared_future<bool>> results;
+	results.reserve(tasks_.size());
+	for (TaskId id = 0; id < tasks_.size(); id++) {
+		std::vector<std::shared_future<bool>> dependencies;
+		for (TaskId dependency : tasks_[id].dependencies) {
+			dependencies.push_back(results[dependency]);
+		}
+
+		results.push_back(std::async(std::launch::async, [this, id, dependencies, elapsed_ms]() {
+			TaskTiming& timing = timings_[id];
+			for (const auto& dependency : dependencies) {
+				if (!dependency.get()) {
+					timing.skipped = true;
+					timing.started_ms = timing.finished_ms = elapsed_ms();
+					return false;
+				}
+			}
+
+			timing.started_ms = elapsed_ms();
+			try {
+				timing.succeeded = tasks_[id].run();
+			}
+			catch (const std::exception& e) {
+				logger::Logger::get_instance().log(logger::LogLevel::L_ERROR, "Startup task " + timing.name + " threw: " + e.what());
+				timing.succeeded = false;
+			}
+			timing.finished_ms = elapsed_ms();
+			return timing.succeeded;
+		}).share());
+	}
+
+	bool succeeded = true;
+	for (const auto& result : results) {
+		succeeded = result.get() && succeeded;
+	}
+	return succeeded;
+}
+
+const std::vector<TaskGraph::TaskTiming>& TaskGraph::get_timings() const {
+	return timings_;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Runs a fixed set of tasks concurrently, each starting as soon as everything it depends on has finished.
+//
+// Meant for startup work that mostly waits (devices, network round trips), so every task gets its own
+// thread. Tasks report success; anything depending on a failed task is skipped and counts as failed.
+class TaskGraph {
+public:
+	using TaskId = size_t;
+
+	struct TaskTiming {
+		std::string name;
+		bool succeeded;
+		bool skipped;
+		// Relative to the start of run().
+		double started_ms;
+		double finished_ms;
+	};
+
+	// Dependencies must already have been added, so the graph can never contain a cycle.
+	TaskId add(const std::string& name, std::function<bool()> task, const std::vector<TaskId>& dependencies = {});
+
+	// Runs every task and waits for all of them; returns whether all succeeded.
+	bool run();
+
+	// Valid once run() has returned, in the order the tasks were added.
+	const std::vector<TaskTiming>& get_timings() const;
+
+private:
+	struct Task {
+		std::function<bool()> run;
+		std::vector<TaskId> dependencies;
+	};
+
+	std::vector<Task> tasks_;
+	std::vector<TaskTiming> timings_;
+};
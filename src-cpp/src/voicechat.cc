@@ -1,4 +1,9 @@
-#include <future>
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 #include <rtc/global.hpp>
 
 #include "voicechat.hpp"
@@ -7,22 +12,30 @@
 #include "networking.h"
 #include "common.h"
 #include "audio_capture.h"
+#include "bitrate_controller.h"
 #include "logger.h"
+#include "latency_tracker.h"
+#include "metrics.h"
+#include "task_graph.h"
 
-auto connect_to_websocket() {
+// Signaling and the peer connection give up after this long, so a dead server never hangs startup.
+constexpr auto CONNECT_TIMEOUT = std::chrono::seconds(15);
+
+// Set before the startup graph runs; time to first audio is measured from here.
+std::chrono::steady_clock::time_point startup_started;
+std::atomic<bool> first_audio_sent{ false };
+std::shared_ptr<rtc::DataChannel> voip_channel;
+
+std::string fetch_token() {
 	// Make an HTTP GET request to obtain the JSON token
 	HttpResponse response = http_get("http://localhost:9000/connect/token");
 
 	if (response.status_code == CURLE_OK && !response.body.is_discarded()) {
 		try {
 			if (response.body.contains("token") && response.body["token"].is_string()) {
-
 				std::string uuid = response.body["token"].get<std::string>();
 				logger::Logger::get_instance().log(logger::LogLevel::L_INFO, "Acquired UUID: " + uuid);
-				// Use the acquired UUID when connecting to the WebSocket
-				auto websocket = websocket::initialize_websocket("ws:/localhost:9000/connect?token=" + uuid);
-
-				return websocket;
+				return uuid;
 			}
 			else {
 				logger::Logger::get_instance().log(logger::LogLevel::L_ERROR, "JSON token does not contain 'token' field");
@@ -34,18 +47,14 @@ auto connect_to_websocket() {
 		}
 	}
 
-	return std::shared_ptr<rtc::WebSocket>();
+	return std::string();
 }
 
-void begin_connections() {
-	auto websocket = connect_to_websocket();
+bool connect_websocket(const std::string& token) {
+	// Use the acquired UUID when connecting to the WebSocket
+	auto websocket = websocket::initialize_websocket("ws:/localhost:9000/connect?token=" + token);
 
-	if (!websocket) {
-		logger::Logger::get_instance().log(logger::LogLevel::L_FATAL, "Failed to connect to WebSocket");
-		return;
-	}
-
-	websocket->onMessage([&](std::variant<rtc::binary, rtc::string> message) {
+	websocket->onMessage([](std::variant<rtc::binary, rtc::string> message) {
 		if (std::holds_alternative<rtc::string>(message)) {
 			try {
 				json json_message = json::parse(std::get<std::string>(message));
@@ -55,7 +64,8 @@ void begin_connections() {
 					return;
 				}
 
-				logger::Logger::get_instance().log(logger::LogLevel::L_INFO, "Websocket Message Received: " + json_message.dump());
+				// Signaling traffic is verbose; the dump is only built when debug logging is on.
+				SPEAKLY_LOG(logger::LogLevel::L_DEBUG, "Websocket Message Received: " + json_message.dump());
 
 				if (json_message.contains("type") && json_message.contains("data")) {
 					std::string type = json_message["type"].get<std::string>();
@@ -75,82 +85,211 @@ void begin_connections() {
 		}
 	});
 
-	websocket->onClosed([]() {
-		logger::Logger::get_instance().log(logger::LogLevel::L_INFO, "Websocket closed");
-	});
+	if (!websocket::wait_until_open(CONNECT_TIMEOUT)) {
+		logger::Logger::get_instance().log(logger::LogLevel::L_FATAL, "Failed to connect to WebSocket");
+		return false;
+	}
+	return true;
+}
 
-	std::promise<void> promise;
-	std::shared_future<void> websocket_future = promise.get_future().share();
+// Creating the channels produces the offer and starts ICE gathering; neither needs the websocket to be open yet.
+bool create_peer_connection() {
+	webrtc::init_peer_connection();
+	webrtc::create_data_channel("myDataChannel");
+	voip_channel = webrtc::create_voip_channel("voip");
+	return voip_channel != nullptr;
+}
 
-	std::thread([&]() {
-		websocket->onOpen([&]() {
-			std::cout << "WebSocket opened" << std::endl;
-			promise.set_value();
-		});
-	}).detach();
+bool start_audio() {
+	if (audio_capture::init() != audio_capture::InitializeState::INITIALIZED) {
+		logger::Logger::get_instance().log(logger::LogLevel::L_ERROR, "Failed to initialize audio");
+		return false;
+	}
+	audio_capture::get_device_info();
+	return true;
+}
 
-	websocket_future.get();
+void set_loopback(bool enabled) {
+	WebSocketMessage message;
+	message.type = "loopback";
+	message.data = enabled ? "on" : "off";
+	if (!websocket::send_message(message)) {
+		logger::Logger::get_instance().log(logger::LogLevel::L_WARNING, "Cannot change loopback, websocket closed");
+	}
+}
 
-	auto pc = webrtc::init_peer_connection(websocket);
-	auto dc = webrtc::create_data_channel("myDataChannel");
-	auto voip_dc = webrtc::create_data_channel("voip");
+auto voip_listener = std::make_shared<EncodedListener>(
+	[](const unsigned char* data, size_t size) {
+	// Handle encoded data
+	if (webrtc::get_state() == rtc::PeerConnection::State::Connected) {
+		webrtc::send_voip_packet(data, size);
 
-	voip_dc->onMessage([](std::variant<rtc::binary, rtc::string> data) {
-		if (!std::holds_alternative<rtc::binary>(data)) {
-			logger::Logger::get_instance().log(logger::LogLevel::L_WARNING, "Received non-binary data on voip channel");
-			return;
+		if (!first_audio_sent.load(std::memory_order_relaxed) && !first_audio_sent.exchange(true)) {
+			const double first_audio_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startup_started).count();
+			metrics::gauge("startup.first_audio_ms").set(first_audio_ms);
+			logger::Logger::get_instance().log(logger::LogLevel::L_INFO, "Time to first audio: %.1f ms", first_audio_ms);
 		}
+	}
+});
 
-		audio_capture::decode_output_audio(std::get<rtc::binary>(data));
-	});
+constexpr auto BITRATE_CONTROLLER_INTERVAL = std::chrono::seconds(1);
 
-	std::promise<void> pc_promise;
-	std::shared_future<void> pc_future = pc_promise.get_future().share();
+std::thread bitrate_controller_thread;
+std::atomic<bool> bitrate_controller_running{ false };
+std::mutex bitrate_controller_mutex;
+std::condition_variable bitrate_controller_cv;
 
-	std::thread([&]() {
-		pc->onStateChange([&](rtc::PeerConnection::State state) {
-			if (state == rtc::PeerConnection::State::Connected) {
-				pc_promise.set_value();
-			}
-		});
-	}).detach();
+void run_bitrate_controller() {
+	BitrateController controller;
+	audio_capture::set_encoder_settings(controller.get_settings());
+
+	uint64_t last_lost = 0;
+	uint64_t last_received = 0;
+	uint64_t last_send_drops = 0;
+
+	while (bitrate_controller_running.load()) {
+		{
+			std::unique_lock<std::mutex> lock(bitrate_controller_mutex);
+			bitrate_controller_cv.wait_for(lock, BITRATE_CONTROLLER_INTERVAL, []() {
+				return !bitrate_controller_running.load();
+			});
+		}
+
+		if (!bitrate_controller_running.load()) {
+			break;
+		}
 
-	pc_future.get();
+		// The SFU sends no receiver reports, so what we lose receiving from it stands in for loss on our uplink.
+		// Downstream loss can come from another speaker's link, and uplink trouble that spares the downstream
+		// goes unseen here; the send-side congestion signals below back off on their own either way.
+		uint64_t lost = 0;
+		uint64_t received = 0;
+		for (const auto& speaker : audio_capture::get_speaker_stats()) {
+			lost += speaker.jitter.lost;
+			received += speaker.jitter.received;
+		}
+
+		// Counters restart when speakers come and go, so a shrinking total resets the baseline.
+		uint64_t lost_delta = lost >= last_lost ? lost - last_lost : 0;
+		uint64_t received_delta = received >= last_received ? received - last_received : 0;
+		last_lost = lost;
+		last_received = received;
+
+		auto send_stats = webrtc::get_voip_send_stats();
+		auto rtt = webrtc::get_rtt();
+
+		NetworkConditions conditions;
+		conditions.loss_percent = lost_delta + received_delta > 0 ? 100.0 * lost_delta / (lost_delta + received_delta) : 0.0;
+		conditions.rtt_ms = rtt ? std::optional<double>(static_cast<double>(rtt->count())) : std::nullopt;
+		conditions.buffered_amount = send_stats.buffered_amount;
+		conditions.send_drops = send_stats.packets_dropped - last_send_drops;
+		conditions.average_encode_us = audio_capture::get_send_path_stats().average_encode_us;
+		last_send_drops = send_stats.packets_dropped;
+
+		audio_capture::set_encoder_settings(controller.update(conditions));
+	}
 }
 
-auto voip_listener = std::make_shared<EncodedListener>(
-	[](const unsigned char* data, size_t size) {
-	// Handle encoded data
-	if (webrtc::get_state() == rtc::PeerConnection::State::Connected) {
-		webrtc::send_voip_packet(data, size);
+void start_bitrate_controller() {
+	if (bitrate_controller_running.exchange(true)) {
+		return;
 	}
-});
+	bitrate_controller_thread = std::thread(run_bitrate_controller);
+}
+
+void stop_bitrate_controller() {
+	if (!bitrate_controller_running.exchange(false)) {
+		return;
+	}
+
+	bitrate_controller_cv.notify_one();
+	if (bitrate_controller_thread.joinable()) {
+		bitrate_controller_thread.join();
+	}
+}
+
+std::mutex exit_mutex;
+std::condition_variable exit_cv;
+bool exit_requested = false;
+
+void request_exit() {
+	{
+		std::lock_guard<std::mutex> lock(exit_mutex);
+		exit_requested = true;
+	}
+	exit_cv.notify_all();
+}
 
 void init_all() {
 	rtc::InitLogger(rtc::LogLevel::Info);
 	logger::Logger::get_instance().set_log_file("voicechat.log");
 
-	begin_connections();
+	// Audio devices and codecs come up while signaling is in flight; only sending needs both.
+	startup_started = std::chrono::steady_clock::now();
+	std::string token;
+	TaskGraph startup;
+	auto audio = startup.add("audio", start_audio);
+	auto token_fetched = startup.add("token", [&token]() {
+		token = fetch_token();
+		return !token.empty();
+	});
+	auto signaling = startup.add("websocket", [&token]() {
+		return connect_websocket(token);
+	}, { token_fetched });
+	auto peer = startup.add("peer", create_peer_connection);
+	auto connected = startup.add("connected", []() {
+		return webrtc::wait_until_connected(CONNECT_TIMEOUT);
+	}, { signaling, peer });
+	startup.add("sending", []() {
+		// Received voice queues inside the channel until the decoders exist.
+		voip_channel->onMessage([](std::variant<rtc::binary, rtc::string> data) {
+			if (!std::holds_alternative<rtc::binary>(data)) {
+				logger::Logger::get_instance().log(logger::LogLevel::L_WARNING, "Received non-binary data on voip channel");
+				return;
+			}
 
-	audio_capture::init();
-	audio_capture::attach_encoded_listener(voip_listener);
-	audio_capture::get_device_info();
+			audio_capture::queue_output_audio(std::get<rtc::binary>(data));
+		});
+		audio_capture::attach_encoded_listener(voip_listener);
+		start_bitrate_controller();
+		return true;
+	}, { audio, connected });
+
+	startup.run();
+	for (const auto& timing : startup.get_timings()) {
+		metrics::gauge("startup." + timing.name + "_ms").set(timing.finished_ms);
+		logger::Logger::get_instance().log(timing.succeeded ? logger::LogLevel::L_INFO : logger::LogLevel::L_WARNING,
+			"Startup " + timing.name + (timing.skipped ? " skipped" : timing.succeeded ? " done" : " failed")
+			+ " at " + std::to_string(static_cast<int>(timing.finished_ms)) + " ms");
+	}
 
-	while (true) {
+	// Reading the console blocks and cannot be interrupted, so it gets a thread of its own that is left behind
+	// at exit. Without a console the read fails straight away and only request_exit ends the session.
+	std::thread([]() {
 		std::string input;
-		std::cin >> input;
-
-		if (input == "exit") {
-            break;
+		while (std::cin >> input) {
+			if (input == "exit") {
+				request_exit();
+				return;
+			}
 		}
-	}
+	}).detach();
 
+	{
+		std::unique_lock<std::mutex> lock(exit_mutex);
+		exit_cv.wait(lock, []() { return exit_requested; });
+	}
 
+	stop_bitrate_controller();
 	websocket::close();
 	webrtc::close();
 	audio_capture::terminate_portaudio();
 	audio_capture::terminate_opus();
 	audio_capture::terminate_models();
 
+	// Keep the session's latency breakdown next to the log.
+	std::ofstream latency_report("latency.json");
+	latency_report << latency::to_json();
+
 	logger::Logger::get_instance().close_log_file();
 }
\ No newline at end of file
@@ -1,3 +1,8 @@
 #pragma once
 
-void init_all();
\ No newline at end of file
+// Runs the session until request_exit is called or "exit" is typed on the console, then tears it down.
+void init_all();
+// Any thread; init_all returns once teardown is done.
+void request_exit();
+// Ask the server to send our own voice back to us, so the full round trip can be timed.
+void set_loopback(bool enabled);
\ No newline at end of file
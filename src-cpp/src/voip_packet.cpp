@@ -0,0 +1,51 @@
+#include "voip_packet.h"
+
+namespace {
+	void write_u16(unsigned char* out, uint16_t value) {
+		out[0] = static_cast<unsigned char>(value >> 8);
+		out[1] = static_cast<unsigned char>(value);
+	}
+
+	void write_u32(unsigned char* out, uint32_t value) {
+		out[0] = static_cast<unsigned char>(value >> 24);
+		out[1] = static_cast<unsigned char>(value >> 16);
+		out[2] = static_cast<unsigned char>(value >> 8);
+		out[3] = static_cast<unsigned char>(value);
+	}
+
+	uint16_t read_u16(const unsigned char* in) {
+		return static_cast<uint16_t>((in[0] << 8) | in[1]);
+	}
+
+	uint32_t read_u32(const unsigned char* in) {
+		return (static_cast<uint32_t>(in[0]) << 24) | (static_cast<uint32_t>(in[1]) << 16) |
+			(static_cast<uint32_t>(in[2]) << 8) | static_cast<uint32_t>(in[3]);
+	}
+}
+
+void write_voip_header(unsigned char* buffer, const VoipPacketHeader& header) {
+	buffer[0] = header.version;
+	buffer[1] = header.flags;
+	write_u16(buffer + 2, header.sequence);
+	write_u32(buffer + 4, header.timestamp);
+	write_u32(buffer + 8, header.speaker_id);
+}
+
+bool parse_voip_packet(const unsigned char* data, size_t size, VoipPacketView& view) {
+	if (data == nullptr || size <= VOIP_HEADER_SIZE) {
+		return false;
+	}
+
+	if (data[0] != VOIP_PACKET_VERSION) {
+		return false;
+	}
+
+	view.header.version = data[0];
+	view.header.flags = data[1];
+	view.header.sequence = read_u16(data + 2);
+	view.header.timestamp = read_u32(data + 4);
+	view.header.speaker_id = read_u32(data + 8);
+	view.payload = data + VOIP_HEADER_SIZE;
+	view.payload_size = size - VOIP_HEADER_SIZE;
+	return true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Wire format of every packet on the voip data channel:
+//
+//   0       1       2       3
+//   +-------+-------+-------+-------+
+//   |version| flags |   sequence    |
+//   +-------+-------+-------+-------+
+//   |      timestamp (samples)      |
+//   +-------+-------+-------+-------+
+//   |      speaker ID (SSRC)        |
+//   +-------+-------+-------+-------+
+//   |  Opus payload ...
+//
+// All multi-byte fields are big-endian. The timestamp counts samples at SAMPLE_RATE.
+constexpr uint8_t VOIP_PACKET_VERSION = 1;
+constexpr size_t VOIP_HEADER_SIZE = 12;
+
+enum VoipPacketFlags : uint8_t {
+	// The sender's voice activity detector considered this frame speech.
+	VOIP_FLAG_VAD = 0x01,
+	// The payload carries in-band FEC for the previous frame.
+	VOIP_FLAG_FEC = 0x02,
+};
+
+struct VoipPacketHeader {
+	uint8_t version;
+	uint8_t flags;
+	uint16_t sequence;
+	uint32_t timestamp;
+	uint32_t speaker_id;
+};
+
+// A parsed packet. payload points into the buffer that was parsed; nothing is copied.
+struct VoipPacketView {
+	VoipPacketHeader header;
+	const unsigned char* payload;
+	size_t payload_size;
+};
+
+// Writes the header into the first VOIP_HEADER_SIZE bytes of buffer, in front of a payload
+// that the encoder has already placed at buffer + VOIP_HEADER_SIZE.
+void write_voip_header(unsigned char* buffer, const VoipPacketHeader& header);
+
+// Returns false for truncated packets, unknown versions and empty payloads.
+bool parse_voip_packet(const unsigned char* data, size_t size, VoipPacketView& view);
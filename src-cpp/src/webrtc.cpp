@@ -1,12 +1,45 @@
+#include <iostream>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
 #include "webrtc.h"
 #include "websocket.h"
 #include "common.h"
+#include "ice_signaling.h"
+#include "metrics.h"
 
 namespace webrtc {
 	rtc::Configuration config;
 	std::shared_ptr<rtc::PeerConnection> pc;
 	std::unordered_map <std::string, std::shared_ptr<rtc::DataChannel>> data_channels;
 
+	// Mirrors the peer connection state for threads waiting on it.
+	std::mutex state_mutex;
+	std::condition_variable state_cv;
+	rtc::PeerConnection::State connection_state_seen = rtc::PeerConnection::State::New;
+
+	// Candidates can trickle in ahead of the answer; they are held until the remote description is set.
+	ice_signaling::RemoteCandidateQueue remote_candidates;
+
+	// Connection setup milestones, in ms since the peer connection was created, go to "ice.<milestone>_ms".
+	std::chrono::steady_clock::time_point setup_started;
+	std::atomic<bool> first_local_candidate{ true };
+	std::atomic<bool> first_remote_candidate{ true };
+
+	// Once this much voice is waiting in the SCTP buffer (about 100ms of frames), new frames are dropped
+	// rather than queued behind stale ones. Sending resumes when the buffer drains to the low mark.
+	constexpr size_t VOIP_BUFFERED_HIGH = 16 * 1024;
+	constexpr size_t VOIP_BUFFERED_LOW = 4 * 1024;
+
+	std::atomic<bool> voip_congested{ false };
+	metrics::Counter& voip_packets_sent = metrics::counter("voip.packets_sent");
+	metrics::Counter& voip_bytes_sent = metrics::counter("voip.bytes_sent");
+	metrics::Counter& voip_packets_dropped = metrics::counter("voip.packets_dropped");
+	// rtc::PeerConnection::State as a number: New, Connecting, Connected, Disconnected, Failed, Closed.
+	metrics::Gauge& connection_state = metrics::gauge("webrtc.connection_state");
+
 	rtc::Configuration get_config() {
 		return config;
 	}
@@ -15,60 +48,126 @@ namespace webrtc {
 		return pc->state();
 	}
 
-	void send_network_packet(const std::weak_ptr<rtc::DataChannel>& data_channel, const unsigned char* packet, int current_packet_size) {
-		if (auto dc = data_channel.lock()) {
-			std::vector<std::byte> byte_packet(current_packet_size);
+	bool wait_until_connected(std::chrono::milliseconds timeout) {
+		std::unique_lock<std::mutex> lock(state_mutex);
+		state_cv.wait_for(lock, timeout, []() {
+			return connection_state_seen == rtc::PeerConnection::State::Connected
+				|| connection_state_seen == rtc::PeerConnection::State::Failed
+				|| connection_state_seen == rtc::PeerConnection::State::Closed;
+		});
+		return connection_state_seen == rtc::PeerConnection::State::Connected;
+	}
 
-			for (int i = 0; i < current_packet_size; i++) {
-				byte_packet[i] = static_cast<std::byte>(packet[i]);
-			}
+	double record_setup_time(const std::string& milestone) {
+		const double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - setup_started).count();
+		metrics::gauge("ice." + milestone + "_ms").set(elapsed_ms);
+		return elapsed_ms;
+	}
+
+	void send_ice_candidate(const std::string& data) {
+		WebSocketMessage message;
+		message.type = "iceCandidate";
+		message.data = data;
+
+		if (!websocket::send_message(message)) {
+			logger::Logger::get_instance().log(logger::LogLevel::L_WARNING, "Cannot send ice candidate, websocket closed");
+		}
+	}
+
+	std::optional<std::chrono::milliseconds> get_rtt() {
+		if (pc == nullptr) {
+			return std::nullopt;
+		}
+		return pc->rtt();
+	}
 
-			// Send the byte packet
-			dc->send(byte_packet.data(), byte_packet.size());
+	void send_network_packet(const std::weak_ptr<rtc::DataChannel>& data_channel, const unsigned char* packet, int current_packet_size) {
+		if (auto dc = data_channel.lock()) {
+			// No copy on our side; libdatachannel copies the bytes into a heap-allocated message of its own.
+			dc->send(reinterpret_cast<const std::byte*>(packet), current_packet_size);
 		}
 	}
 
 	void send_voip_packet(const unsigned char* packet, int current_packet_size) {
-		if (auto dc = data_channels["voip"]) {
+		// find() rather than operator[] so the hot path never inserts into the map.
+		auto it = data_channels.find("voip");
+		if (it == data_channels.end()) {
+			return;
+		}
+
+		if (auto& dc = it->second) {
 			if (!dc->isOpen()) {
 				return;
 			}
 
-			std::vector<std::byte> byte_packet(current_packet_size);
-
-			for (int i = 0; i < current_packet_size; i++) {
-				byte_packet[i] = static_cast<std::byte>(packet[i]);
+			if (voip_congested.load(std::memory_order_relaxed) || dc->bufferedAmount() >= VOIP_BUFFERED_HIGH) {
+				if (!voip_congested.exchange(true)) {
+					logger::Logger::get_instance().log(logger::LogLevel::L_WARNING, "Voip send buffer backed up, dropping frames");
+				}
+				voip_packets_dropped.add();
+				return;
 			}
 
-			// Send the byte packet
-			dc->send(byte_packet.data(), byte_packet.size());
+			dc->send(reinterpret_cast<const std::byte*>(packet), current_packet_size);
+			voip_packets_sent.add();
+			voip_bytes_sent.add(static_cast<uint64_t>(current_packet_size));
 		}
 	}
 
+	VoipSendStats get_voip_send_stats() {
+		size_t buffered_amount = 0;
+		auto it = data_channels.find("voip");
+		if (it != data_channels.end() && it->second != nullptr) {
+			buffered_amount = it->second->bufferedAmount();
+		}
 
-	void handle_sdp_answer(const std::string& data) {
-		pc->setRemoteDescription(data);
+		return VoipSendStats{
+			voip_packets_sent.value(),
+			voip_packets_dropped.value(),
+			buffered_amount,
+			voip_congested.load(std::memory_order_relaxed)
+		};
 	}
 
-	void handle_ice_candidate(const std::string& data) {
-		try {
-			json json_data = json::parse(data);
 
-			if (!json_data.contains("candidate")) {
-				return;
-			}
-
-			rtc::Candidate candidate(json_data["candidate"].get<std::string>());
+	void add_remote_candidate(const ice_signaling::Candidate& candidate) {
+		try {
+			pc->addRemoteCandidate(rtc::Candidate(candidate.candidate, candidate.mid));
+		}
+		catch (const std::exception& e) {
+			logger::Logger::get_instance().log(logger::LogLevel::L_ERROR, "Error adding ice candidate: " + std::string(e.what()));
+		}
+	}
 
-			pc->addRemoteCandidate(candidate);
+	void handle_sdp_answer(const std::string& data) {
+		record_setup_time("answer_received");
+		pc->setRemoteDescription(rtc::Description(data, rtc::Description::Type::Answer));
+		remote_candidates.description_applied(add_remote_candidate);
+	}
 
+	void handle_ice_candidate(const std::string& data) {
+		ice_signaling::Candidate candidate;
+		switch (ice_signaling::decode(data, candidate)) {
+		case ice_signaling::MessageKind::INVALID:
+			logger::Logger::get_instance().log(logger::LogLevel::L_WARNING, "Ignoring malformed ice candidate message");
+			return;
+		case ice_signaling::MessageKind::END_OF_CANDIDATES:
+			// libdatachannel has no end-of-candidates call; connectivity checks simply run out of new pairs.
+			if (remote_candidates.end_received()) {
+				logger::Logger::get_instance().log(logger::LogLevel::L_INFO, "Remote end of candidates at %.1f ms", record_setup_time("remote_gathering_complete"));
+			}
+			return;
+		case ice_signaling::MessageKind::CANDIDATE:
+			break;
 		}
-		catch (const json::parse_error& e) {
-			logger::Logger::get_instance().log(logger::LogLevel::L_ERROR, "Error parsing JSON: " + std::string(e.what()));
+
+		if (first_remote_candidate.exchange(false)) {
+			record_setup_time("first_remote_candidate");
 		}
+		remote_candidates.add(std::move(candidate), add_remote_candidate);
 	}
 
-	std::shared_ptr<rtc::DataChannel> create_data_channel(const std::string& label) {
+	std::shared_ptr<rtc::DataChannel> create_data_channel(const std::string& label, const rtc::DataChannelInit& init) {
 		if (pc == nullptr || pc->state() == rtc::PeerConnection::State::Failed || pc->state() == rtc::PeerConnection::State::Disconnected) {
 			return nullptr;
 		}
@@ -78,7 +177,7 @@ namespace webrtc {
 		}
 
 		logger::Logger::get_instance().log(logger::LogLevel::L_INFO, "Creating data channel: " + label);
-		auto data_channel = pc->createDataChannel(label);
+		auto data_channel = pc->createDataChannel(label, init);
 		if (data_channel == nullptr) {
 			logger::Logger::get_instance().log(logger::LogLevel::L_ERROR, "Error creating data channel: " + label);
 			return nullptr;
@@ -88,37 +187,68 @@ namespace webrtc {
 		return data_channel;
 	}
 
-	std::shared_ptr<rtc::PeerConnection> init_peer_connection(const std::weak_ptr <rtc::WebSocket>& websocket) {
+	std::shared_ptr<rtc::DataChannel> create_voip_channel(const std::string& label) {
+		rtc::DataChannelInit init;
+		init.reliability.type = rtc::Reliability::Type::Rexmit;
+		init.reliability.unordered = true;
+		init.reliability.rexmit = 0;
+
+		auto data_channel = create_data_channel(label, init);
+		if (data_channel == nullptr) {
+			return nullptr;
+		}
+
+		data_channel->setBufferedAmountLowThreshold(VOIP_BUFFERED_LOW);
+		data_channel->onBufferedAmountLow([]() {
+			if (voip_congested.exchange(false)) {
+				logger::Logger::get_instance().log(logger::LogLevel::L_INFO, "Voip send buffer drained, resuming");
+			}
+		});
+
+		return data_channel;
+	}
+
+	std::shared_ptr<rtc::PeerConnection> init_peer_connection() {
 		//config.iceServers.emplace_back("stun:stun.l.google.com:19302");
+		setup_started = std::chrono::steady_clock::now();
+		first_local_candidate.store(true);
+		first_remote_candidate.store(true);
+		remote_candidates.reset();
 		pc = std::make_shared<rtc::PeerConnection>(config);
 		logger::Logger::get_instance().log(logger::LogLevel::L_INFO, "Created peer connection");
 
-		pc->onLocalDescription([websocket](const rtc::Description& sdp) {
+		pc->onLocalDescription([](const rtc::Description& sdp) {
 			logger::Logger::get_instance().log(logger::LogLevel::L_INFO, "Received local description");
 
 			WebSocketMessage message;
 			message.type = "sdpOffer";
 			message.data = sdp.generateSdp();
 
-			// Convert the message to JSON using nlohmann/json
-			json jsonMessage = message.toJson();
-			std::string jsonString = jsonMessage.dump();
-
-			if (auto ws = websocket.lock()) {
-				ws->send(jsonString);
+			// Sent straight away rather than after gathering; candidates trickle after it. The websocket may
+			// still be connecting, in which case it holds the offer until it opens.
+			if (!websocket::send_message(message)) {
+				logger::Logger::get_instance().log(logger::LogLevel::L_ERROR, "Cannot send offer, websocket closed");
 			}
+			record_setup_time("offer_sent");
 		});
 
 
-		pc->onLocalCandidate([websocket](const rtc::Candidate& candidate) {
+		pc->onLocalCandidate([](const rtc::Candidate& candidate) {
 			logger::Logger::get_instance().log(logger::LogLevel::L_INFO, "Received local ice candidate");
-			if (auto ws = websocket.lock()) {
-				//ws->send(candidate.candidate(), candidate.mid());
+			if (first_local_candidate.exchange(false)) {
+				record_setup_time("first_local_candidate");
 			}
+			send_ice_candidate(ice_signaling::encode_candidate({ candidate.candidate(), candidate.mid() }));
 		});
 
 		pc->onStateChange([](rtc::PeerConnection::State state) {
-			std::string state_str;
+			connection_state.set(static_cast<double>(state));
+			{
+				std::lock_guard<std::mutex> lock(state_mutex);
+				connection_state_seen = state;
+			}
+			state_cv.notify_all();
+			const char* state_str;
 
 			switch (state) {
 			case rtc::PeerConnection::State::New:
@@ -144,11 +274,15 @@ namespace webrtc {
 				break;
 			}
 
-			logger::Logger::get_instance().log(logger::LogLevel::L_INFO, "WebRTC State: " + state_str);
+			logger::Logger::get_instance().log(logger::LogLevel::L_INFO, "WebRTC State: %s", logger::StaticText(state_str));
+
+			if (state == rtc::PeerConnection::State::Connected) {
+				logger::Logger::get_instance().log(logger::LogLevel::L_INFO, "Connection setup took %.1f ms", record_setup_time("connected"));
+			}
 		});
 
 		pc->onGatheringStateChange([](rtc::PeerConnection::GatheringState state) {
-			std::string state_str;
+			const char* state_str;
 			switch (state) {
 			case rtc::PeerConnection::GatheringState::New:
 				state_str = "New";
@@ -164,16 +298,21 @@ namespace webrtc {
 				break;
 			}
 
-			logger::Logger::get_instance().log(logger::LogLevel::L_INFO, "WebRTC Gathering State: " + state_str);
+			logger::Logger::get_instance().log(logger::LogLevel::L_INFO, "WebRTC Gathering State: %s", logger::StaticText(state_str));
+
+			if (state == rtc::PeerConnection::GatheringState::Complete) {
+				record_setup_time("local_gathering_complete");
+				send_ice_candidate(ice_signaling::encode_end_of_candidates());
+			}
 		});
 
 		pc->onDataChannel([](const std::shared_ptr<rtc::DataChannel>& dc) {
 			dc->onOpen([dc]() {
-				logger::Logger::get_instance().log(logger::LogLevel::L_INFO, "Data channel open " + std::to_string(dc->id().value()));
+				logger::Logger::get_instance().log(logger::LogLevel::L_INFO, "Data channel open %d", static_cast<int>(dc->id().value()));
 			});
 
 			dc->onClosed([dc]() {
-				logger::Logger::get_instance().log(logger::LogLevel::L_INFO, "Data channel closed " + std::to_string(dc->id().value()));
+				logger::Logger::get_instance().log(logger::LogLevel::L_INFO, "Data channel closed %d", static_cast<int>(dc->id().value()));
 			});
 
 			/*	dc->onMessage([dc](auto data) {
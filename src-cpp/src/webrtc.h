@@ -1,23 +1,48 @@
 #pragma once
 
 #include <memory>
+#include <cstdint>
+#include <chrono>
+#include <optional>
 #include <rtc/peerconnection.hpp>
 #include <rtc/websocket.hpp>
 
 namespace webrtc {
-	// Initialize the WebRTC peer connection. Requires a websocket to send the local description
-	// once it has been established.
-	std::shared_ptr<rtc::PeerConnection> init_peer_connection(const std::weak_ptr <rtc::WebSocket>& websocket);
+	// Initialize the WebRTC peer connection. The local description goes out through the websocket module,
+	// which holds it until the websocket is open, so this need not wait for signaling.
+	std::shared_ptr<rtc::PeerConnection> init_peer_connection();
 
 	rtc::Configuration get_config();
 
 	rtc::PeerConnection::State get_state();
 
+	// Blocks until the peer connection is connected, or returns false once it failed, closed or timed out.
+	bool wait_until_connected(std::chrono::milliseconds timeout);
+
+	// Round-trip time measured by the SCTP transport, if one is available yet.
+	std::optional<std::chrono::milliseconds> get_rtt();
+
+	// Applies the answer, then any remote candidates that arrived ahead of it.
 	void handle_sdp_answer(const std::string& data);
 
+	// Trickled remote candidate; an empty candidate marks the end of candidates.
 	void handle_ice_candidate(const std::string& data);
 
-	std::shared_ptr<rtc::DataChannel> create_data_channel(const std::string& label);
+	struct VoipSendStats {
+		uint64_t packets_sent;
+		// Packets dropped instead of queued because the SCTP send buffer was backed up.
+		uint64_t packets_dropped;
+		size_t buffered_amount;
+		bool congested;
+	};
+
+	std::shared_ptr<rtc::DataChannel> create_data_channel(const std::string& label, const rtc::DataChannelInit& init = {});
+
+	// Creates the voice channel: unordered with zero retransmits, so a lost frame is skipped instead of
+	// head-of-line blocking every frame behind it. Its send buffer is watched to drop stale audio.
+	std::shared_ptr<rtc::DataChannel> create_voip_channel(const std::string& label);
+
+	VoipSendStats get_voip_send_stats();
 
 	void send_network_packet(const std::weak_ptr<rtc::DataChannel>& data_channel, const unsigned char* packet, int current_packet_size);
 
@@ -1,4 +1,7 @@
 #include <rtc/rtc.hpp>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
 
 #include "websocket.h"
 #include "common.h"
@@ -7,21 +10,76 @@
 namespace websocket {
     std::shared_ptr<rtc::WebSocket> websocket;
 
+    // Messages sent before the socket opened, flushed in order once it does.
+    std::mutex state_mutex;
+    std::condition_variable state_cv;
+    std::vector<std::string> pending_messages;
+    bool opened = false;
+    bool closed = false;
+
     rtc::WebSocket::State get_websocket_state() {
         return websocket->readyState();
     }
 
     std::shared_ptr<rtc::WebSocket> initialize_websocket(const std::string &uri) {
         websocket = std::make_shared<rtc::WebSocket>();
+
+        // Registered before open() so the callbacks cannot miss a fast connection.
+        websocket->onOpen([]() {
+            logger::Logger::get_instance().log(logger::LogLevel::L_INFO, "WebSocket opened");
+            std::lock_guard<std::mutex> lock(state_mutex);
+            opened = true;
+            for (const auto& message : pending_messages) {
+                websocket->send(message);
+            }
+            pending_messages.clear();
+            state_cv.notify_all();
+        });
+
+        websocket->onError([](const std::string& error) {
+            logger::Logger::get_instance().log(logger::LogLevel::L_ERROR, "WebSocket error: " + error);
+            std::lock_guard<std::mutex> lock(state_mutex);
+            closed = true;
+            state_cv.notify_all();
+        });
+
+        websocket->onClosed([]() {
+            logger::Logger::get_instance().log(logger::LogLevel::L_INFO, "Websocket closed");
+            std::lock_guard<std::mutex> lock(state_mutex);
+            closed = true;
+            pending_messages.clear();
+            state_cv.notify_all();
+        });
+
         websocket->open(uri);
 
         return websocket;
     }
 
+    bool wait_until_open(std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(state_mutex);
+        state_cv.wait_for(lock, timeout, []() {
+            return opened || closed;
+        });
+        return opened && !closed;
+    }
+
+    bool send_message(const WebSocketMessage& message) {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        if (closed) {
+            return false;
+        }
+        if (!opened) {
+            pending_messages.push_back(message.toJson().dump());
+            return true;
+        }
+        return websocket->send(message.toJson().dump());
+    }
+
     void close() {
         if (websocket != nullptr) {
             logger::Logger::get_instance().log(logger::LogLevel::L_INFO, "Closing websocket");
             websocket->close();
         }
     }
-}
\ No newline at end of file
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <chrono>
 #include <string>
 #include <nlohmann/json.hpp>
 #include <rtc/rtc.hpp>
@@ -20,5 +21,10 @@ struct WebSocketMessage {
 
 namespace websocket {
 	std::shared_ptr<rtc::WebSocket> initialize_websocket(const std::string& uri);
+	// Blocks until the socket opened, or returns false once it failed, closed or timed out.
+	bool wait_until_open(std::chrono::milliseconds timeout);
+	// Sends a signaling message, holding it until the socket opens if it is not open yet, so signaling can
+	// start before the connection is up. Returns false once the socket has been closed.
+	bool send_message(const WebSocketMessage& message);
 	void close();
 };
@@ -0,0 +1,67 @@
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "plugins/agc_plugin.h"
+#include "plugins/high_pass_plugin.h"
+#include "plugins/noise_gate_plugin.h"
+#include "plugins/static_audio_chain.h"
+#include "test.h"
+
+namespace {
+	constexpr int SAMPLE_RATE = 48000;
+	constexpr int FRAME_SIZE = 480;
+
+	// White noise at rms_db dBFS.
+	std::vector<float> make_noise(std::mt19937& rng, size_t length, double rms_db) {
+		std::normal_distribution<float> noise(0.0f, static_cast<float>(std::pow(10.0, rms_db / 20.0)));
+		std::vector<float> signal(length);
+		for (float& sample : signal) {
+			sample = noise(rng);
+		}
+		return signal;
+	}
+}
+
+// Room noise between the AGC's noise floor and the gate threshold. Behind the AGC the gate would see it
+// raised toward the -18dBFS target and open; in front it keeps it shut and the AGC never adapts to it.
+TEST(agc, room_noise_does_not_open_the_gate) {
+	std::mt19937 rng(31);
+	std::vector<float> signal = make_noise(rng, SAMPLE_RATE * 10, -45.0);
+
+	StaticAudioChain<HighPassPlugin, NoiseGatePlugin, AgcPlugin> chain(HighPassPlugin(80.0f, SAMPLE_RATE), NoiseGatePlugin(SAMPLE_RATE), AgcPlugin(SAMPLE_RATE));
+	bool ever_open = false;
+	for (size_t offset = 0; offset < signal.size(); offset += FRAME_SIZE) {
+		chain.process(signal.data() + offset, FRAME_SIZE);
+		ever_open = ever_open || chain.voice_activity() == VoiceActivity::SPEECH;
+	}
+
+	CHECK(!ever_open);
+	CHECK_NEAR(chain.get<2>().get_levels().gain_db, 0.0, 1e-6);
+}
+
+TEST(agc, steers_speech_to_the_target) {
+	std::mt19937 rng(32);
+	std::vector<float> signal = make_noise(rng, SAMPLE_RATE * 10, -30.0);
+
+	AgcPlugin agc(SAMPLE_RATE);
+	for (size_t offset = 0; offset < signal.size(); offset += FRAME_SIZE) {
+		agc.process(signal.data() + offset, FRAME_SIZE);
+	}
+
+	// 12dB up at 6dB per second takes two seconds; ten is plenty.
+	const AgcLevels levels = agc.get_levels();
+	CHECK_NEAR(levels.gain_db, 12.0, 0.5);
+	CHECK_NEAR(levels.output_rms_db, -18.0, 0.5);
+}
+
+TEST(agc, holds_gain_below_the_noise_floor) {
+	std::mt19937 rng(33);
+	std::vector<float> signal = make_noise(rng, SAMPLE_RATE * 5, -60.0);
+
+	AgcPlugin agc(SAMPLE_RATE);
+	for (size_t offset = 0; offset < signal.size(); offset += FRAME_SIZE) {
+		agc.process(signal.data() + offset, FRAME_SIZE);
+	}
+	CHECK_NEAR(agc.get_levels().gain_db, 0.0, 1e-6);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+// Minimal self-registering benchmarks. speakly_benchmarks runs the benchmarks named on its command line, or
+// all of them; --quick cuts every iteration count down so CTest can smoke-run them in a debug build.
+namespace bench {
+	struct Benchmark {
+		const char* name;
+		void (*run)();
+	};
+
+	std::vector<Benchmark>& registry();
+
+	// Multiplies every iteration count; small under --quick.
+	double scale();
+
+	// Stores into a volatile so the optimizer cannot discard the work that produced value.
+	void keep(float value);
+
+	struct Registrar {
+		Registrar(const char* name, void (*run)()) {
+			registry().push_back(Benchmark{ name, run });
+		}
+	};
+
+	// Calls fn iterations times, three times over after a warm-up, and prints the fastest run as ns per call
+	// and, when samples_per_call is set, millions of samples per second. Returns the ns per call.
+	template <typename Fn>
+	double measure(const char* label, size_t iterations, size_t samples_per_call, Fn&& fn) {
+		iterations = static_cast<size_t>(static_cast<double>(iterations) * scale());
+		if (iterations == 0) {
+			iterations = 1;
+		}
+
+		for (size_t i = 0; i < iterations / 10 + 1; i++) {
+			fn();
+		}
+
+		double best_ns = 0.0;
+		for (int run = 0; run < 3; run++) {
+			const auto start = std::chrono::steady_clock::now();
+			for (size_t i = 0; i < iterations; i++) {
+				fn();
+			}
+			const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+			if (run == 0 || ns < best_ns) {
+				best_ns = ns;
+			}
+		}
+
+		const double ns_per_call = best_ns / static_cast<double>(iterations);
+		if (samples_per_call > 0) {
+			std::printf("  %-44s %10.1f ns/call %9.1f Msamples/s\n", label, ns_per_call, static_cast<double>(samples_per_call) * 1e3 / ns_per_call);
+		}
+		else {
+			std::printf("  %-44s %10.1f ns/call\n", label, ns_per_call);
+		}
+		return ns_per_call;
+	}
+}
+
+#define BENCHMARK(name) \
+	static void name##_benchmark(); \
+	static bench::Registrar name##_benchmark_registrar(#name, name##_benchmark); \
+	static void name##_benchmark()
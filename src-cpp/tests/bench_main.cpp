@@ -0,0 +1,55 @@
+#include <cstdio>
+#include <cstring>
+
+#include "bench.h"
+
+namespace bench {
+	double iteration_scale = 1.0;
+	volatile float sink = 0.0f;
+
+	std::vector<Benchmark>& registry() {
+		static std::vector<Benchmark> benchmarks;
+		return benchmarks;
+	}
+
+	double scale() {
+		return iteration_scale;
+	}
+
+	void keep(float value) {
+		sink = value;
+	}
+}
+
+int main(int argc, char** argv) {
+	std::vector<const char*> names;
+	for (int i = 1; i < argc; i++) {
+		if (std::strcmp(argv[i], "--quick") == 0) {
+			bench::iteration_scale = 0.01;
+		}
+		else {
+			names.push_back(argv[i]);
+		}
+	}
+
+	int ran = 0;
+	for (const bench::Benchmark& benchmark : bench::registry()) {
+		bool selected = names.empty();
+		for (const char* name : names) {
+			selected = selected || std::strcmp(name, benchmark.name) == 0;
+		}
+		if (!selected) {
+			continue;
+		}
+
+		std::printf("%s\n", benchmark.name);
+		benchmark.run();
+		ran++;
+	}
+
+	if (ran == 0) {
+		std::printf("no benchmarks selected\n");
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,95 @@
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "biquad.h"
+
+namespace {
+	constexpr double SAMPLE_RATE = 48000.0;
+	constexpr size_t FRAME_SIZE = 480;
+	constexpr size_t ITERATIONS = 50000;
+
+	// The plain per-section loop the cascade falls back to without SSE.
+	struct ScalarCascade {
+		std::vector<BiquadCoefficients> sections;
+		std::vector<float> s1;
+		std::vector<float> s2;
+
+		explicit ScalarCascade(std::vector<BiquadCoefficients> coefficients)
+			: sections(std::move(coefficients)), s1(sections.size(), 0.0f), s2(sections.size(), 0.0f) {}
+
+		void process(float* buffer, size_t count) {
+			for (size_t i = 0; i < count; i++) {
+				float sample = buffer[i];
+				for (size_t k = 0; k < sections.size(); k++) {
+					const BiquadCoefficients& c = sections[k];
+					const float output = c.b0 * sample + s1[k];
+					s1[k] = c.b1 * sample - c.a1 * output + s2[k];
+					s2[k] = c.b2 * sample - c.a2 * output;
+					sample = output;
+				}
+				buffer[i] = sample;
+			}
+		}
+	};
+
+	// The recurrence HighPassPlugin ran before the biquad cascade replaced it, with the 0.01 time constant
+	// the capture chain gave it: one multiply-add per sample in double, but a serial dependency all the same.
+	struct OnePoleHighPass {
+		double time_constant = 0.01;
+		double previous = 0.0;
+
+		void process(float* buffer, size_t count) {
+			for (size_t i = 0; i < count; i++) {
+				const double filtered = static_cast<double>(buffer[i]) - previous + time_constant * previous;
+				previous = filtered;
+				buffer[i] = static_cast<float>(filtered);
+			}
+		}
+	};
+}
+
+// One 10 ms frame through cascades of one to four sections. The pipelined step costs the same whatever
+// the depth, since it always runs four lanes, so short cascades gain less over the scalar loop. The old
+// one-pole filter is the baseline for what the capture chain's high-pass used to cost.
+BENCHMARK(biquad_cascade) {
+	std::mt19937 rng(3);
+	std::uniform_real_distribution<float> sample(-1.0f, 1.0f);
+	std::vector<float> input(FRAME_SIZE);
+	for (float& value : input) {
+		value = sample(rng);
+	}
+	std::vector<float> frame(FRAME_SIZE);
+
+	OnePoleHighPass one_pole;
+	bench::measure("old one-pole HighPassPlugin", ITERATIONS, FRAME_SIZE, [&]() {
+		frame = input;
+		one_pole.process(frame.data(), frame.size());
+		bench::keep(frame.back());
+	});
+
+	for (size_t count = 1; count <= MAX_BIQUAD_SECTIONS; count++) {
+		std::vector<BiquadCoefficients> sections;
+		for (size_t k = 0; k < count; k++) {
+			sections.push_back(biquad::design(BiquadType::HIGH_PASS, SAMPLE_RATE, 80.0, biquad::butterworth_q(static_cast<int>(count) * 2, static_cast<int>(k))));
+		}
+
+		ScalarCascade scalar(sections);
+		const std::string scalar_label = std::to_string(count) + " sections, scalar loop";
+		bench::measure(scalar_label.c_str(), ITERATIONS, FRAME_SIZE, [&]() {
+			frame = input;
+			scalar.process(frame.data(), frame.size());
+			bench::keep(frame.back());
+		});
+
+		BiquadCascade cascade;
+		cascade.set_sections(sections.data(), sections.size());
+		const std::string cascade_label = std::to_string(count) + " sections, BiquadCascade";
+		bench::measure(cascade_label.c_str(), ITERATIONS, FRAME_SIZE, [&]() {
+			frame = input;
+			cascade.process(frame.data(), frame.size());
+			bench::keep(frame.back());
+		});
+	}
+}
@@ -0,0 +1,166 @@
+#include <optional>
+
+#include "bitrate_controller.h"
+#include "logger.h"
+#include "test.h"
+
+namespace {
+	// A quiet interval: nothing lost, short RTT, empty send buffer, and no encode cost measured yet.
+	NetworkConditions clean() {
+		NetworkConditions conditions;
+		conditions.loss_percent = 0.0;
+		conditions.rtt_ms = 50.0;
+		conditions.buffered_amount = 0;
+		conditions.send_drops = 0;
+		conditions.average_encode_us = 0.0;
+		return conditions;
+	}
+
+	NetworkConditions with_loss(double loss_percent) {
+		NetworkConditions conditions = clean();
+		conditions.loss_percent = loss_percent;
+		return conditions;
+	}
+
+	// Every settings change is logged; keep the test output to results.
+	struct QuietLog {
+		QuietLog() {
+			logger::Logger::get_instance().set_console_output(false);
+		}
+		~QuietLog() {
+			logger::Logger::get_instance().flush();
+			logger::Logger::get_instance().set_console_output(true);
+		}
+	};
+}
+
+TEST(bitrate_controller, starts_high_with_short_frames) {
+	BitrateController controller;
+	const audio_capture::EncoderSettings& settings = controller.get_settings();
+	CHECK_EQ(settings.bitrate, 64000);
+	CHECK_EQ(settings.complexity, 10);
+	CHECK_EQ(settings.packet_loss_percent, 10);
+	CHECK_EQ(settings.frame_duration_ms, 10);
+}
+
+// Loss is smoothed 0.7/0.3 and backs off at 10%: one interval at 30% smooths to 9% and holds, a second
+// reaches 15.3% and cuts the bitrate by 30%.
+TEST(bitrate_controller, backs_off_on_loss_down_to_the_floor) {
+	QuietLog quiet;
+	BitrateController controller;
+	audio_capture::EncoderSettings settings = controller.update(with_loss(30.0));
+	CHECK_EQ(settings.bitrate, 64000);
+	CHECK_EQ(settings.frame_duration_ms, 10);
+	// Expected loss follows 1.5x the smoothed loss, rounded up.
+	CHECK_EQ(settings.packet_loss_percent, 14);
+
+	settings = controller.update(with_loss(30.0));
+	CHECK_EQ(settings.bitrate, 44800);
+	CHECK_EQ(settings.frame_duration_ms, 20);
+
+	for (int i = 0; i < 10; i++) {
+		settings = controller.update(with_loss(60.0));
+	}
+	CHECK_EQ(settings.bitrate, 12000);
+	CHECK_EQ(settings.frame_duration_ms, 60);
+	CHECK_EQ(settings.packet_loss_percent, 30);
+}
+
+TEST(bitrate_controller, backs_off_on_send_side_congestion) {
+	QuietLog quiet;
+	BitrateController dropping;
+	NetworkConditions conditions = clean();
+	conditions.send_drops = 1;
+	CHECK_EQ(dropping.update(conditions).bitrate, 44800);
+
+	BitrateController backed_up;
+	conditions = clean();
+	conditions.buffered_amount = 8 * 1024;
+	CHECK_EQ(backed_up.update(conditions).bitrate, 44800);
+	conditions.buffered_amount = 8 * 1024 - 1;
+	CHECK_EQ(backed_up.update(conditions).bitrate, 44800);
+}
+
+// Three clean intervals in a row raise the bitrate by 15% and shorten frames a step; anything in between
+// that is not clean starts the count over.
+TEST(bitrate_controller, probes_up_after_three_clean_intervals) {
+	QuietLog quiet;
+	BitrateController controller;
+	for (int i = 0; i < 10; i++) {
+		controller.update(with_loss(60.0));
+	}
+	audio_capture::EncoderSettings settings = controller.get_settings();
+	CHECK_EQ(settings.bitrate, 12000);
+	CHECK_EQ(settings.frame_duration_ms, 60);
+
+	// The smoothed loss, about 58%, takes ten clean intervals to fall below 2%; the probe comes three later.
+	int clean_updates = 0;
+	while (controller.get_settings().bitrate == 12000 && clean_updates < 20) {
+		settings = controller.update(clean());
+		clean_updates++;
+	}
+	CHECK_EQ(clean_updates, 12);
+	// 15% up, truncated: 12000 * 1.15 rounds just below 13800 in double.
+	CHECK_EQ(settings.bitrate, 13799);
+	CHECK_EQ(settings.frame_duration_ms, 40);
+
+	// Two clean, one high-RTT, then the count needs three more.
+	controller.update(clean());
+	controller.update(clean());
+	NetworkConditions slow = clean();
+	slow.rtt_ms = 400.0;
+	CHECK_EQ(controller.update(slow).bitrate, 13799);
+	controller.update(clean());
+	controller.update(clean());
+	CHECK_EQ(controller.get_settings().bitrate, 13799);
+	settings = controller.update(clean());
+	CHECK_EQ(settings.bitrate, 15868);
+	CHECK_EQ(settings.frame_duration_ms, 20);
+
+	// An RTT not measured yet does not hold probing back, and the ceiling holds.
+	NetworkConditions unmeasured = clean();
+	unmeasured.rtt_ms = std::nullopt;
+	for (int i = 0; i < 60; i++) {
+		settings = controller.update(unmeasured);
+	}
+	CHECK_EQ(settings.bitrate, 96000);
+	CHECK_EQ(settings.frame_duration_ms, 10);
+	CHECK_EQ(settings.packet_loss_percent, 2);
+}
+
+// Complexity steps down while encoding takes over 15% of the previous frame duration and back up below 5%,
+// between 3 and 10. No measurement leaves it alone.
+TEST(bitrate_controller, complexity_follows_encode_cost) {
+	QuietLog quiet;
+	BitrateController controller;
+	NetworkConditions expensive = clean();
+	expensive.average_encode_us = 2000.0;
+	for (int i = 0; i < 10; i++) {
+		controller.update(expensive);
+	}
+	CHECK_EQ(controller.get_settings().complexity, 3);
+
+	NetworkConditions unmeasured = clean();
+	CHECK_EQ(controller.update(unmeasured).complexity, 3);
+
+	// 1000us is 10% of a 10ms frame: inside the band, so nothing moves.
+	NetworkConditions moderate = clean();
+	moderate.average_encode_us = 1000.0;
+	CHECK_EQ(controller.update(moderate).complexity, 3);
+
+	NetworkConditions cheap = clean();
+	cheap.average_encode_us = 200.0;
+	for (int i = 0; i < 10; i++) {
+		controller.update(cheap);
+	}
+	CHECK_EQ(controller.get_settings().complexity, 10);
+
+	// The cost is judged against the frame it was measured on: 2000us of a 20ms frame is within budget
+	// even though the same interval also lengthens frames.
+	BitrateController lossy;
+	lossy.update(with_loss(60.0));
+	CHECK_EQ(lossy.get_settings().frame_duration_ms, 20);
+	NetworkConditions long_frames = with_loss(60.0);
+	long_frames.average_encode_us = 2000.0;
+	CHECK_EQ(lossy.update(long_frames).complexity, 10);
+}
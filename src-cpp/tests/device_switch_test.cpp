@@ -0,0 +1,311 @@
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "device_switch.h"
+#include "spsc_ring.h"
+#include "test.h"
+
+namespace {
+	constexpr size_t BLOCK = 480;
+
+	// Stands in for a PortAudio stream: once started, a thread calls the callback every millisecond until
+	// it returns false (paComplete) or the stream is stopped. A stalled stream never calls back, like an
+	// unplugged device.
+	struct MockStream {
+		std::function<bool()> callback;
+		bool fail_start = false;
+		bool stalled = false;
+
+		std::thread thread;
+		std::atomic<bool> stop_requested{ false };
+		int starts = 0;
+		int stops = 0;
+		int aborts = 0;
+		int closes = 0;
+
+		void join() {
+			stop_requested.store(true);
+			if (thread.joinable()) {
+				thread.join();
+			}
+		}
+
+		~MockStream() {
+			join();
+		}
+	};
+
+	struct MockBackend {
+		using Error = int;
+		static constexpr int OK = 0;
+		static constexpr int START_FAILED = -1;
+
+		int start(MockStream* stream) {
+			if (stream->fail_start) {
+				return START_FAILED;
+			}
+			stream->starts++;
+			stream->thread = std::thread([stream]() {
+				while (!stream->stop_requested.load()) {
+					if (!stream->stalled && !stream->callback()) {
+						return;
+					}
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+			});
+			return OK;
+		}
+
+		int stop(MockStream* stream) {
+			stream->stops++;
+			stream->join();
+			return OK;
+		}
+
+		int abort(MockStream* stream) {
+			stream->aborts++;
+			stream->join();
+			return OK;
+		}
+
+		int close(MockStream* stream) {
+			stream->closes++;
+			return OK;
+		}
+	};
+
+	struct InputStream {
+		MockStream* stream;
+		float value;
+		SpscRing<float> staging{ 4 * BLOCK };
+		float faded[BLOCK];
+	};
+
+	struct OutputStream {
+		MockStream* stream;
+		float value;
+		std::atomic<bool> running{ false };
+		bool fade_in = false;
+	};
+
+	// Everything the send path was handed, in order. Only the active stream delivers, and the hand-over
+	// orders one stream's deliveries before the next one's.
+	struct Delivered {
+		std::vector<float> samples;
+		std::atomic<size_t> blocks{ 0 };
+	};
+
+	void wait_for(const std::atomic<size_t>& counter, size_t at_least) {
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+		while (counter.load() < at_least && std::chrono::steady_clock::now() < deadline) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	struct InputFixture {
+		MockBackend backend;
+		MockStream old_stream;
+		MockStream new_stream;
+		std::unique_ptr<InputStream> current = std::make_unique<InputStream>();
+		std::unique_ptr<InputStream> next = std::make_unique<InputStream>();
+		std::atomic<InputStream*> active{ nullptr };
+		std::atomic<InputStream*> pending{ nullptr };
+		Delivered delivered;
+
+		InputFixture() {
+			current->stream = &old_stream;
+			current->value = 1.0f;
+			next->stream = &new_stream;
+			next->value = 2.0f;
+			old_stream.callback = callback_for(current.get());
+			new_stream.callback = callback_for(next.get());
+			active.store(current.get());
+		}
+
+		// Each stream captures a constant level, so the delivered samples show whose they were.
+		std::function<bool()> callback_for(InputStream* device) {
+			return [this, device]() {
+				const std::vector<float> block(BLOCK, device->value);
+				return device_switch::route_capture(device, block.data(), BLOCK, active, pending, [this](const float* samples, size_t count, size_t) {
+					delivered.samples.insert(delivered.samples.end(), samples, samples + count);
+					delivered.blocks++;
+				});
+			};
+		}
+	};
+}
+
+TEST(device_switch, input_cross_fades_into_the_next_device) {
+	InputFixture fixture;
+	CHECK_EQ(fixture.backend.start(&fixture.old_stream), MockBackend::OK);
+	wait_for(fixture.delivered.blocks, 5);
+
+	InputStream* replacement = fixture.next.get();
+	const auto result = device_switch::hand_over(fixture.backend, fixture.current, std::move(fixture.next), fixture.active, fixture.pending);
+	CHECK_EQ(result.error, MockBackend::OK);
+	CHECK(result.cross_faded);
+	CHECK(fixture.current.get() == replacement);
+	CHECK(fixture.active.load() == replacement);
+	CHECK(fixture.pending.load() == nullptr);
+	CHECK_EQ(fixture.old_stream.stops, 1);
+	CHECK_EQ(fixture.old_stream.aborts, 0);
+	CHECK_EQ(fixture.old_stream.closes, 1);
+
+	const size_t blocks_at_switch = fixture.delivered.blocks.load();
+	wait_for(fixture.delivered.blocks, blocks_at_switch + 5);
+	fixture.backend.stop(&fixture.new_stream);
+
+	// Old device, exactly one cross-faded block, then only the new device: no gap and no overlap.
+	const std::vector<float>& samples = fixture.delivered.samples;
+	size_t fade_start = 0;
+	while (fade_start < samples.size() && samples[fade_start] == 1.0f) {
+		fade_start++;
+	}
+	CHECK(fade_start > 0 && fade_start % BLOCK == 0);
+	CHECK(fade_start + BLOCK < samples.size());
+	for (size_t i = 0; i < BLOCK && fade_start + i < samples.size(); i++) {
+		const float expected = 1.0f * device_switch::fade_out_gain(i, BLOCK) + 2.0f * device_switch::fade_in_gain(i, BLOCK);
+		CHECK_NEAR(samples[fade_start + i], expected, 1e-6);
+	}
+	for (size_t i = fade_start + BLOCK; i < samples.size(); i++) {
+		CHECK_EQ(samples[i], 2.0f);
+	}
+}
+
+TEST(device_switch, stalled_input_is_aborted_after_the_timeout) {
+	InputFixture fixture;
+	fixture.old_stream.stalled = true;
+	CHECK_EQ(fixture.backend.start(&fixture.old_stream), MockBackend::OK);
+
+	InputStream* replacement = fixture.next.get();
+	const auto start = std::chrono::steady_clock::now();
+	const auto result = device_switch::hand_over(fixture.backend, fixture.current, std::move(fixture.next), fixture.active, fixture.pending);
+	const auto waited = std::chrono::steady_clock::now() - start;
+
+	CHECK_EQ(result.error, MockBackend::OK);
+	CHECK(!result.cross_faded);
+	CHECK(waited >= device_switch::TIMEOUT);
+	CHECK(waited < device_switch::TIMEOUT + std::chrono::milliseconds(400));
+	CHECK_EQ(fixture.old_stream.aborts, 1);
+	CHECK_EQ(fixture.old_stream.stops, 0);
+	CHECK_EQ(fixture.old_stream.closes, 1);
+	CHECK(fixture.current.get() == replacement);
+	CHECK(fixture.active.load() == replacement);
+	CHECK(fixture.pending.load() == nullptr);
+
+	// Forced over without a fade, the new device delivers straight away, its staged audio first.
+	wait_for(fixture.delivered.blocks, 3);
+	fixture.backend.stop(&fixture.new_stream);
+	CHECK(!fixture.delivered.samples.empty());
+	for (float sample : fixture.delivered.samples) {
+		CHECK_EQ(sample, 2.0f);
+	}
+}
+
+TEST(device_switch, failed_start_keeps_the_current_device) {
+	InputFixture fixture;
+	fixture.new_stream.fail_start = true;
+	CHECK_EQ(fixture.backend.start(&fixture.old_stream), MockBackend::OK);
+
+	InputStream* original = fixture.current.get();
+	const auto result = device_switch::hand_over(fixture.backend, fixture.current, std::move(fixture.next), fixture.active, fixture.pending);
+	CHECK_EQ(result.error, MockBackend::START_FAILED);
+	CHECK(fixture.current.get() == original);
+	CHECK(fixture.active.load() == original);
+	CHECK(fixture.pending.load() == nullptr);
+	CHECK_EQ(fixture.new_stream.closes, 1);
+	CHECK_EQ(fixture.old_stream.stops + fixture.old_stream.aborts + fixture.old_stream.closes, 0);
+
+	// The current device carries on delivering.
+	const size_t blocks = fixture.delivered.blocks.load();
+	wait_for(fixture.delivered.blocks, blocks + 3);
+	CHECK(fixture.delivered.blocks.load() >= blocks + 3);
+	fixture.backend.stop(&fixture.old_stream);
+}
+
+TEST(device_switch, output_fades_out_then_in) {
+	MockBackend backend;
+	MockStream old_stream;
+	MockStream new_stream;
+	auto current = std::make_unique<OutputStream>();
+	auto next = std::make_unique<OutputStream>();
+	current->stream = &old_stream;
+	current->value = 1.0f;
+	next->stream = &new_stream;
+	next->value = 2.0f;
+	std::atomic<OutputStream*> active{ current.get() };
+	std::atomic<OutputStream*> pending{ nullptr };
+
+	// What reached the speakers from the active stream, and whether the standby stream only played silence.
+	Delivered played;
+	std::atomic<bool> standby_silent{ true };
+	auto callback_for = [&](OutputStream* device) {
+		return [&, device]() {
+			std::vector<float> out(BLOCK, device->value);
+			bool keep_running;
+			if (!device_switch::output_is_active(device, out.data(), BLOCK, active, pending, keep_running)) {
+				for (float sample : out) {
+					if (sample != 0.0f) {
+						standby_silent.store(false);
+					}
+				}
+				return keep_running;
+			}
+
+			OutputStream* replacement = device_switch::fade_output(device, out.data(), BLOCK, pending);
+			played.samples.insert(played.samples.end(), out.begin(), out.end());
+			played.blocks++;
+			if (replacement != nullptr) {
+				device_switch::complete_output_hand_over(replacement, active);
+				return false;
+			}
+			return true;
+		};
+	};
+	old_stream.callback = callback_for(current.get());
+	new_stream.callback = callback_for(next.get());
+
+	CHECK_EQ(backend.start(&old_stream), MockBackend::OK);
+	wait_for(played.blocks, 5);
+	const auto result = device_switch::hand_over(backend, current, std::move(next), active, pending);
+	CHECK_EQ(result.error, MockBackend::OK);
+	CHECK(result.cross_faded);
+	CHECK_EQ(old_stream.stops, 1);
+	CHECK_EQ(old_stream.aborts, 0);
+
+	const size_t blocks_at_switch = played.blocks.load();
+	wait_for(played.blocks, blocks_at_switch + 5);
+	backend.stop(&new_stream);
+	CHECK(standby_silent.load());
+
+	// The old device's last block fades out, the new device's first block fades in, then full level.
+	const std::vector<float>& samples = played.samples;
+	size_t fade_start = 0;
+	while (fade_start < samples.size() && samples[fade_start] == 1.0f) {
+		fade_start++;
+	}
+	CHECK(fade_start > 0 && fade_start % BLOCK == 0);
+	CHECK(fade_start + 2 * BLOCK < samples.size());
+	for (size_t i = 0; i < BLOCK && fade_start + BLOCK + i < samples.size(); i++) {
+		CHECK_NEAR(samples[fade_start + i], device_switch::fade_out_gain(i, BLOCK), 1e-6);
+		CHECK_NEAR(samples[fade_start + BLOCK + i], 2.0f * device_switch::fade_in_gain(i, BLOCK), 1e-6);
+	}
+	for (size_t i = fade_start + 2 * BLOCK; i < samples.size(); i++) {
+		CHECK_EQ(samples[i], 2.0f);
+	}
+}
+
+// The equal-power ramps keep the summed power of two unrelated signals constant through the fade.
+TEST(device_switch, fades_are_equal_power) {
+	for (size_t i = 0; i < BLOCK; i++) {
+		const float out = device_switch::fade_out_gain(i, BLOCK);
+		const float in = device_switch::fade_in_gain(i, BLOCK);
+		CHECK_NEAR(out * out + in * in, 1.0, 1e-6);
+	}
+	CHECK(device_switch::fade_out_gain(0, BLOCK) > 0.999f);
+	CHECK(device_switch::fade_in_gain(BLOCK - 1, BLOCK) > 0.999f);
+}
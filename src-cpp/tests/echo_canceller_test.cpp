@@ -0,0 +1,152 @@
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "echo_canceller.h"
+#include "echo_reference.h"
+#include "test.h"
+
+namespace {
+	constexpr int SAMPLE_RATE = 48000;
+	constexpr size_t BLOCK_SIZE = 480;
+	constexpr int TAIL_MS = 200;
+
+	// A room-like echo path: 6ms of direct delay and 30dB of loss, then decaying reflections out to 50ms.
+	std::vector<float> make_echo_path(std::mt19937& rng) {
+		std::normal_distribution<float> reflection(0.0f, 1.0f);
+		std::vector<float> path(SAMPLE_RATE * 50 / 1000, 0.0f);
+		const size_t direct = SAMPLE_RATE * 6 / 1000;
+		path[direct] = 0.03f;
+		for (size_t i = direct + 1; i < path.size(); i++) {
+			path[i] = 0.01f * reflection(rng) * std::exp(-static_cast<float>(i - direct) / (SAMPLE_RATE * 0.01f));
+		}
+		return path;
+	}
+
+	// Far-end speech stand-in: noise shaped by a slow syllable-rate envelope.
+	std::vector<float> make_far_end(std::mt19937& rng, size_t length) {
+		std::normal_distribution<float> noise(0.0f, 0.2f);
+		std::vector<float> far(length);
+		for (size_t i = 0; i < length; i++) {
+			const float envelope = 0.6f + 0.4f * std::sin(2.0f * 3.14159265f * 4.0f * static_cast<float>(i) / SAMPLE_RATE);
+			far[i] = noise(rng) * envelope;
+		}
+		return far;
+	}
+
+	std::vector<float> convolve(const std::vector<float>& signal, const std::vector<float>& path) {
+		std::vector<float> out(signal.size(), 0.0f);
+		for (size_t i = 0; i < signal.size(); i++) {
+			double sum = 0.0;
+			for (size_t k = 0; k < path.size() && k <= i; k++) {
+				sum += static_cast<double>(path[k]) * signal[i - k];
+			}
+			out[i] = static_cast<float>(sum);
+		}
+		return out;
+	}
+
+	double energy(const std::vector<float>& signal, size_t from, size_t to) {
+		double sum = 0.0;
+		for (size_t i = from; i < to; i++) {
+			sum += static_cast<double>(signal[i]) * signal[i];
+		}
+		return sum;
+	}
+}
+
+// Offline near/far run: far end through a synthetic room into the microphone with a little sensor noise.
+// Once converged, the echo must sit well below the raw microphone level.
+TEST(echo_canceller, converges_on_far_end_only) {
+	std::mt19937 rng(21);
+	const size_t length = SAMPLE_RATE * 6;
+	const std::vector<float> far = make_far_end(rng, length);
+	std::vector<float> near = convolve(far, make_echo_path(rng));
+	std::normal_distribution<float> sensor(0.0f, 1e-4f);
+	for (float& sample : near) {
+		sample += sensor(rng);
+	}
+
+	const std::vector<float> microphone = near;
+	EchoCanceller canceller(SAMPLE_RATE, BLOCK_SIZE, TAIL_MS);
+	for (size_t offset = 0; offset + BLOCK_SIZE <= length; offset += BLOCK_SIZE) {
+		canceller.process(near.data() + offset, far.data() + offset);
+	}
+
+	// The last three seconds, well after convergence.
+	const size_t from = length - SAMPLE_RATE * 3;
+	const double erle = 10.0 * std::log10(energy(microphone, from, length) / energy(near, from, length));
+	CHECK(erle >= 30.0);
+	CHECK(canceller.get_stats().erle_db >= 30.0);
+	CHECK(canceller.get_stats().far_end_active);
+	CHECK_EQ(canceller.get_stats().resets, uint64_t{ 0 });
+}
+
+// Local speech with a silent far end must pass through untouched.
+TEST(echo_canceller, passes_near_end_without_far_end) {
+	std::mt19937 rng(22);
+	const size_t length = SAMPLE_RATE * 2;
+	std::vector<float> near = make_far_end(rng, length);
+	const std::vector<float> microphone = near;
+	const std::vector<float> far(length, 0.0f);
+
+	EchoCanceller canceller(SAMPLE_RATE, BLOCK_SIZE, TAIL_MS);
+	for (size_t offset = 0; offset + BLOCK_SIZE <= length; offset += BLOCK_SIZE) {
+		canceller.process(near.data() + offset, far.data() + offset);
+	}
+
+	double difference = 0.0;
+	for (size_t i = 0; i < length; i++) {
+		difference += (near[i] - microphone[i]) * (near[i] - microphone[i]);
+	}
+	CHECK(difference <= energy(microphone, 0, length) * 1e-6);
+}
+
+// The output stream renders sample n at dac0 + n / rate. A microphone block stamped on the same steady
+// clock gets the far end that was playing at its own capture time, however far apart the two streams'
+// callbacks run.
+TEST(echo_canceller, reference_aligns_on_steady_clock) {
+	constexpr int64_t dac0_ns = 5'000'000'000;
+	constexpr size_t BLOCKS = 10;
+	EchoReference reference(SAMPLE_RATE, 8192);
+
+	std::vector<float> block(BLOCK_SIZE);
+	for (size_t b = 0; b < BLOCKS; b++) {
+		for (size_t i = 0; i < BLOCK_SIZE; i++) {
+			block[i] = static_cast<float>(b * BLOCK_SIZE + i);
+		}
+		reference.push(block.data(), BLOCK_SIZE, dac0_ns + static_cast<int64_t>(b * BLOCK_SIZE * 1'000'000'000ull / SAMPLE_RATE));
+	}
+
+	// Captured 40ms after the first rendered sample was heard: the first 1920 samples are stale.
+	std::vector<float> pulled(BLOCK_SIZE);
+	reference.pull(pulled.data(), BLOCK_SIZE, dac0_ns + 40'000'000);
+	CHECK_EQ(pulled[0], 1920.0f);
+	CHECK_EQ(pulled[BLOCK_SIZE - 1], 1920.0f + BLOCK_SIZE - 1);
+	CHECK_EQ(reference.realignments(), uint64_t{ 1 });
+
+	// The next block follows on without another jump.
+	reference.pull(pulled.data(), BLOCK_SIZE, dac0_ns + 50'000'000);
+	CHECK_EQ(pulled[0], 2400.0f);
+	CHECK_EQ(reference.realignments(), uint64_t{ 1 });
+
+	// Unstamped blocks are read in order without realigning.
+	reference.pull(pulled.data(), BLOCK_SIZE, 0);
+	CHECK_EQ(pulled[0], 2880.0f);
+	CHECK_EQ(reference.realignments(), uint64_t{ 1 });
+}
+
+// A capture block from before anything queued was heard leads with silence.
+TEST(echo_canceller, reference_leads_with_silence_when_early) {
+	constexpr int64_t dac0_ns = 5'000'000'000;
+	EchoReference reference(SAMPLE_RATE, 8192);
+	std::vector<float> block(BLOCK_SIZE, 1.0f);
+	reference.push(block.data(), BLOCK_SIZE, dac0_ns);
+
+	// 5ms early: 240 samples of silence, then the reference.
+	std::vector<float> pulled(BLOCK_SIZE);
+	reference.pull(pulled.data(), BLOCK_SIZE, dac0_ns - 5'000'000);
+	CHECK_EQ(pulled[239], 0.0f);
+	CHECK_EQ(pulled[240], 1.0f);
+}
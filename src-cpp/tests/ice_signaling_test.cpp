@@ -0,0 +1,267 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ice_signaling.h"
+#include "test.h"
+
+namespace {
+	struct Message {
+		std::string type;
+		std::string data;
+	};
+
+	// A one-way websocket: messages arrive in order on the receiving side's own thread.
+	class Channel {
+	public:
+		explicit Channel(std::function<void(const Message&)> receive) : receive(std::move(receive)), thread([this]() { run(); }) {}
+
+		~Channel() {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				closing = true;
+			}
+			cv.notify_one();
+			thread.join();
+		}
+
+		void send(Message message) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				queue.push_back(std::move(message));
+			}
+			cv.notify_one();
+		}
+
+	private:
+		void run() {
+			std::unique_lock<std::mutex> lock(mutex);
+			while (true) {
+				cv.wait(lock, [&]() { return closing || !queue.empty(); });
+				if (queue.empty()) {
+					return;
+				}
+				Message message = std::move(queue.front());
+				queue.pop_front();
+				lock.unlock();
+				receive(message);
+				lock.lock();
+			}
+		}
+
+		const std::function<void(const Message&)> receive;
+		std::mutex mutex;
+		std::condition_variable cv;
+		std::deque<Message> queue;
+		bool closing = false;
+		std::thread thread;
+	};
+
+	// What the peer connection was given, and whether it would have accepted each candidate.
+	struct FakePeer {
+		std::mutex mutex;
+		bool description_set = false;
+		std::vector<std::string> applied;
+		int applied_early = 0;
+
+		void set_description() {
+			std::lock_guard<std::mutex> lock(mutex);
+			description_set = true;
+		}
+
+		void add_candidate(const ice_signaling::Candidate& candidate) {
+			std::lock_guard<std::mutex> lock(mutex);
+			applied_early += description_set ? 0 : 1;
+			applied.push_back(candidate.candidate);
+		}
+	};
+
+	// The client's handling of signaling messages, as in voicechat and webrtc.
+	struct Client {
+		FakePeer peer;
+		ice_signaling::RemoteCandidateQueue remote_candidates;
+		// Read by the test while the channel thread delivers.
+		std::atomic<int> end_of_candidates{ 0 };
+		int invalid = 0;
+
+		void receive(const Message& message) {
+			auto apply = [this](const ice_signaling::Candidate& candidate) { peer.add_candidate(candidate); };
+			if (message.type == "sdpAnswer") {
+				peer.set_description();
+				remote_candidates.description_applied(apply);
+				return;
+			}
+
+			ice_signaling::Candidate candidate;
+			switch (ice_signaling::decode(message.data, candidate)) {
+			case ice_signaling::MessageKind::INVALID:
+				invalid++;
+				return;
+			case ice_signaling::MessageKind::END_OF_CANDIDATES:
+				end_of_candidates += remote_candidates.end_received() ? 1 : 0;
+				return;
+			case ice_signaling::MessageKind::CANDIDATE:
+				remote_candidates.add(std::move(candidate), apply);
+				return;
+			}
+		}
+	};
+
+	std::string host_candidate(int port) {
+		return "a=candidate:1 1 UDP 2122317823 192.168.1." + std::to_string(port % 250) + " " + std::to_string(port) + " typ host";
+	}
+
+	ice_signaling::Candidate candidate_with(const std::string& text) {
+		ice_signaling::Candidate candidate;
+		candidate.candidate = text;
+		candidate.mid = "0";
+		return candidate;
+	}
+}
+
+TEST(ice_signaling, candidates_round_trip_through_messages) {
+	ice_signaling::Candidate decoded;
+	const ice_signaling::Candidate sent = candidate_with(host_candidate(50000));
+	CHECK(ice_signaling::decode(ice_signaling::encode_candidate(sent), decoded) == ice_signaling::MessageKind::CANDIDATE);
+	CHECK(decoded.candidate == sent.candidate);
+	CHECK(decoded.mid == "0");
+
+	// The browser's shape without a mid.
+	CHECK(ice_signaling::decode(R"({"candidate":"a=candidate:2 1 UDP 1 10.0.0.1 9 typ host"})", decoded) == ice_signaling::MessageKind::CANDIDATE);
+	CHECK(decoded.mid.empty());
+
+	CHECK(ice_signaling::decode(ice_signaling::encode_end_of_candidates(), decoded) == ice_signaling::MessageKind::END_OF_CANDIDATES);
+	CHECK(ice_signaling::decode(R"({"candidate":"","sdpMid":"0"})", decoded) == ice_signaling::MessageKind::END_OF_CANDIDATES);
+
+	CHECK(ice_signaling::decode("not json", decoded) == ice_signaling::MessageKind::INVALID);
+	CHECK(ice_signaling::decode("{}", decoded) == ice_signaling::MessageKind::INVALID);
+	CHECK(ice_signaling::decode(R"({"candidate":7})", decoded) == ice_signaling::MessageKind::INVALID);
+	CHECK(ice_signaling::decode("[]", decoded) == ice_signaling::MessageKind::INVALID);
+}
+
+TEST(ice_signaling, holds_candidates_until_the_answer) {
+	Client client;
+	for (int i = 0; i < 3; i++) {
+		client.receive(Message{ "iceCandidate", ice_signaling::encode_candidate(candidate_with(host_candidate(50000 + i))) });
+	}
+	CHECK_EQ(client.remote_candidates.held(), size_t{ 3 });
+	CHECK(client.peer.applied.empty());
+
+	client.receive(Message{ "sdpAnswer", "v=0" });
+	CHECK_EQ(client.remote_candidates.held(), size_t{ 0 });
+	client.receive(Message{ "iceCandidate", ice_signaling::encode_candidate(candidate_with(host_candidate(50003))) });
+
+	CHECK_EQ(client.peer.applied.size(), size_t{ 4 });
+	CHECK_EQ(client.peer.applied_early, 0);
+	for (int i = 0; i < 4 && i < static_cast<int>(client.peer.applied.size()); i++) {
+		CHECK(client.peer.applied[i] == host_candidate(50000 + i));
+	}
+
+	// A new peer connection starts over.
+	client.remote_candidates.reset();
+	client.remote_candidates.add(candidate_with(host_candidate(1)), [&](const ice_signaling::Candidate& candidate) { client.peer.add_candidate(candidate); });
+	CHECK_EQ(client.remote_candidates.held(), size_t{ 1 });
+}
+
+TEST(ice_signaling, end_of_candidates_is_reported_once) {
+	Client client;
+	client.receive(Message{ "iceCandidate", ice_signaling::encode_end_of_candidates() });
+	CHECK_EQ(client.end_of_candidates.load(), 1);
+	// Nothing is held or applied for the marker, even ahead of the answer.
+	CHECK_EQ(client.remote_candidates.held(), size_t{ 0 });
+
+	client.receive(Message{ "iceCandidate", ice_signaling::encode_end_of_candidates() });
+	CHECK_EQ(client.end_of_candidates.load(), 1);
+	client.receive(Message{ "sdpAnswer", "v=0" });
+	CHECK(client.peer.applied.empty());
+	CHECK_EQ(client.invalid, 0);
+}
+
+// Full trickle against a stand-in for the signaling server: the offer goes out at once and local candidates
+// follow it as they are gathered, while the server trickles its candidates back, some ahead of its answer,
+// each direction ending with the end-of-candidates marker.
+TEST(ice_signaling, trickles_both_ways_through_a_signaling_stand_in) {
+	constexpr int LOCAL_CANDIDATES = 6;
+	constexpr int EARLY_REMOTE_CANDIDATES = 4;
+	constexpr int LATE_REMOTE_CANDIDATES = 4;
+
+	Client client;
+	Channel to_client([&](const Message& message) { client.receive(message); });
+
+	// The server side: records what the client sent and replies to the offer.
+	std::mutex server_mutex;
+	std::condition_variable server_cv;
+	std::vector<std::string> server_received;
+	bool server_saw_end = false;
+	bool candidate_before_offer = false;
+	Channel to_server([&](const Message& message) {
+		if (message.type == "sdpOffer") {
+			// Candidates gathered on the server's side are ready before it has built the answer.
+			for (int i = 0; i < EARLY_REMOTE_CANDIDATES; i++) {
+				to_client.send(Message{ "iceCandidate", ice_signaling::encode_candidate(candidate_with(host_candidate(60000 + i))) });
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+			to_client.send(Message{ "sdpAnswer", "v=0" });
+			for (int i = EARLY_REMOTE_CANDIDATES; i < EARLY_REMOTE_CANDIDATES + LATE_REMOTE_CANDIDATES; i++) {
+				to_client.send(Message{ "iceCandidate", ice_signaling::encode_candidate(candidate_with(host_candidate(60000 + i))) });
+			}
+			to_client.send(Message{ "iceCandidate", ice_signaling::encode_end_of_candidates() });
+		}
+
+		std::lock_guard<std::mutex> lock(server_mutex);
+		if (message.type == "iceCandidate") {
+			ice_signaling::Candidate candidate;
+			const ice_signaling::MessageKind kind = ice_signaling::decode(message.data, candidate);
+			candidate_before_offer = candidate_before_offer || server_received.empty();
+			if (kind == ice_signaling::MessageKind::END_OF_CANDIDATES) {
+				server_saw_end = true;
+			}
+			else {
+				server_received.push_back(candidate.candidate);
+			}
+		}
+		else {
+			server_received.push_back(message.type);
+		}
+		server_cv.notify_all();
+	});
+
+	// The client: offer first, then candidates as gathering finds them.
+	to_server.send(Message{ "sdpOffer", "v=0" });
+	for (int i = 0; i < LOCAL_CANDIDATES; i++) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		to_server.send(Message{ "iceCandidate", ice_signaling::encode_candidate(candidate_with(host_candidate(50000 + i))) });
+	}
+	to_server.send(Message{ "iceCandidate", ice_signaling::encode_end_of_candidates() });
+
+	{
+		std::unique_lock<std::mutex> lock(server_mutex);
+		server_cv.wait_for(lock, std::chrono::seconds(5), [&]() { return server_saw_end; });
+		CHECK(server_saw_end);
+		CHECK(!candidate_before_offer);
+		CHECK_EQ(server_received.size(), size_t{ 1 + LOCAL_CANDIDATES });
+		for (int i = 0; i < LOCAL_CANDIDATES && i + 1 < static_cast<int>(server_received.size()); i++) {
+			CHECK(server_received[i + 1] == host_candidate(50000 + i));
+		}
+	}
+
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while (client.end_of_candidates.load() == 0 && std::chrono::steady_clock::now() < deadline) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	// Every remote candidate reached the peer once, in order, and none before the answer.
+	std::lock_guard<std::mutex> lock(client.peer.mutex);
+	CHECK_EQ(client.end_of_candidates.load(), 1);
+	CHECK_EQ(client.peer.applied_early, 0);
+	CHECK_EQ(client.peer.applied.size(), size_t{ EARLY_REMOTE_CANDIDATES + LATE_REMOTE_CANDIDATES });
+	for (int i = 0; i < EARLY_REMOTE_CANDIDATES + LATE_REMOTE_CANDIDATES && i < static_cast<int>(client.peer.applied.size()); i++) {
+		CHECK(client.peer.applied[i] == host_candidate(60000 + i));
+	}
+}
@@ -0,0 +1,150 @@
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "jitter_buffer.h"
+#include "test.h"
+
+namespace {
+	constexpr int SAMPLE_RATE = 48000;
+	// 10 ms packets.
+	constexpr uint32_t DURATION = 480;
+
+	const std::chrono::steady_clock::time_point START{};
+
+	std::chrono::steady_clock::time_point at_ms(double ms) {
+		return START + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(ms));
+	}
+
+	// A packet whose payload is its own sequence number, so what comes out can be told apart.
+	bool insert(JitterBuffer& buffer, uint16_t sequence, uint32_t timestamp, std::chrono::steady_clock::time_point arrival) {
+		const unsigned char payload[2] = { static_cast<unsigned char>(sequence >> 8), static_cast<unsigned char>(sequence & 0xff) };
+		return buffer.insert(sequence, timestamp, DURATION, 0, payload, sizeof(payload), arrival);
+	}
+
+	// Pops until the buffer stops returning packets; the sequence of each PACKET, with payloads checked.
+	std::vector<uint16_t> drain(JitterBuffer& buffer) {
+		std::vector<uint16_t> played;
+		JitterBufferPacket packet;
+		while (buffer.pop(packet) == JitterBufferResult::PACKET) {
+			CHECK_EQ(packet.size, size_t{ 2 });
+			CHECK_EQ(static_cast<uint16_t>(packet.data[0] << 8 | packet.data[1]), packet.sequence);
+			played.push_back(packet.sequence);
+		}
+		return played;
+	}
+}
+
+TEST(jitter_buffer, plays_reordered_packets_in_sequence) {
+	JitterBuffer buffer(SAMPLE_RATE);
+	const uint16_t arrival_order[] = { 0, 2, 1, 3 };
+	for (size_t i = 0; i < 4; i++) {
+		CHECK(insert(buffer, arrival_order[i], arrival_order[i] * DURATION, at_ms(10.0 * i)));
+	}
+	// The same packet twice is refused.
+	CHECK(!insert(buffer, 2, 2 * DURATION, at_ms(40.0)));
+
+	const std::vector<uint16_t> played = drain(buffer);
+	CHECK(played == (std::vector<uint16_t>{ 0, 1, 2, 3 }));
+
+	const JitterBufferStats stats = buffer.get_stats();
+	CHECK_EQ(stats.received, uint64_t{ 4 });
+	CHECK_EQ(stats.lost, uint64_t{ 0 });
+	CHECK_EQ(stats.dropped, uint64_t{ 0 });
+}
+
+TEST(jitter_buffer, sequence_wraps_from_65535_to_0) {
+	JitterBuffer buffer(SAMPLE_RATE);
+	const uint16_t sequences[] = { 65534, 0, 65535, 1 };
+	for (size_t i = 0; i < 4; i++) {
+		const uint32_t timestamp = static_cast<uint16_t>(sequences[i] + 2) * DURATION;
+		CHECK(insert(buffer, sequences[i], timestamp, at_ms(10.0 * i)));
+	}
+
+	const std::vector<uint16_t> played = drain(buffer);
+	CHECK(played == (std::vector<uint16_t>{ 65534, 65535, 0, 1 }));
+	CHECK_EQ(buffer.get_stats().lost, uint64_t{ 0 });
+
+	// Play carries on past the wrap.
+	CHECK(insert(buffer, 2, 4 * DURATION, at_ms(40.0)));
+	CHECK(insert(buffer, 3, 5 * DURATION, at_ms(50.0)));
+	CHECK(drain(buffer) == (std::vector<uint16_t>{ 2, 3 }));
+}
+
+TEST(jitter_buffer, late_packets_are_counted_and_dropped) {
+	JitterBuffer buffer(SAMPLE_RATE);
+	for (uint16_t sequence = 0; sequence < 4; sequence++) {
+		if (sequence != 1) {
+			CHECK(insert(buffer, sequence, sequence * DURATION, at_ms(10.0 * sequence)));
+		}
+	}
+
+	// Sequence 1 never came in time and is reported missing in its slot.
+	JitterBufferPacket packet;
+	CHECK(buffer.pop(packet) == JitterBufferResult::PACKET);
+	CHECK(buffer.pop(packet) == JitterBufferResult::MISSING);
+	CHECK_EQ(packet.sequence, uint16_t{ 1 });
+	CHECK_EQ(packet.duration, DURATION);
+
+	// Once its slot has been played, it is refused, and so is anything older.
+	CHECK(!insert(buffer, 1, DURATION, at_ms(45.0)));
+	CHECK(!insert(buffer, 0, 0, at_ms(46.0)));
+	CHECK(drain(buffer) == (std::vector<uint16_t>{ 2, 3 }));
+
+	const JitterBufferStats stats = buffer.get_stats();
+	CHECK_EQ(stats.late, uint64_t{ 2 });
+	CHECK_EQ(stats.lost, uint64_t{ 1 });
+	CHECK_EQ(stats.received, uint64_t{ 3 });
+}
+
+// The target is one packet plus three times the RFC 3550 jitter, kept between 20 and 200 ms.
+TEST(jitter_buffer, target_follows_arrival_jitter_within_bounds) {
+	auto run = [](double deviation_ms) {
+		JitterBuffer buffer(SAMPLE_RATE);
+		for (uint16_t sequence = 0; sequence < 200; sequence++) {
+			// Every other packet is held up by deviation_ms, so every arrival spacing is off by that much.
+			const double delay = sequence % 2 == 1 ? deviation_ms : 0.0;
+			insert(buffer, sequence, sequence * DURATION, at_ms(10.0 * sequence + delay));
+		}
+		return buffer.get_stats();
+	};
+
+	const JitterBufferStats steady = run(0.0);
+	CHECK_NEAR(steady.jitter_ms, 0.0, 1e-6);
+	CHECK_NEAR(steady.target_delay_ms, 20.0, 1e-6);
+
+	// 8 ms of jitter: 10 + 3 * 8 ms.
+	const JitterBufferStats jittery = run(8.0);
+	CHECK_NEAR(jittery.jitter_ms, 8.0, 0.01);
+	CHECK_NEAR(jittery.target_delay_ms, 34.0, 0.05);
+
+	const JitterBufferStats wild = run(120.0);
+	CHECK(wild.jitter_ms > 100.0);
+	CHECK_NEAR(wild.target_delay_ms, 200.0, 1e-6);
+}
+
+// A burst that fills the buffer far past its target is worked off one packet per pop, oldest first, until
+// the depth is back within two packets of the target.
+TEST(jitter_buffer, sheds_packets_when_over_target) {
+	JitterBuffer buffer(SAMPLE_RATE);
+	for (uint16_t sequence = 0; sequence < 10; sequence++) {
+		CHECK(insert(buffer, sequence, sequence * DURATION, at_ms(10.0 * sequence)));
+	}
+	CHECK_NEAR(buffer.get_stats().target_delay_ms, 20.0, 1e-6);
+	CHECK_NEAR(buffer.get_stats().current_delay_ms, 100.0, 1e-6);
+
+	// 100 ms buffered against a 20 ms target: each pop skips one packet while more than the target plus two
+	// packets, 40 ms, is buffered.
+	JitterBufferPacket packet;
+	std::vector<uint16_t> played;
+	for (int i = 0; i < 4; i++) {
+		CHECK(buffer.pop(packet) == JitterBufferResult::PACKET);
+		played.push_back(packet.sequence);
+	}
+	CHECK(played == (std::vector<uint16_t>{ 1, 3, 5, 6 }));
+	CHECK(drain(buffer) == (std::vector<uint16_t>{ 7, 8, 9 }));
+
+	const JitterBufferStats stats = buffer.get_stats();
+	CHECK_EQ(stats.dropped, uint64_t{ 3 });
+	CHECK_EQ(stats.lost, uint64_t{ 0 });
+}
@@ -0,0 +1,142 @@
+#include <cstdint>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "latency_histogram.h"
+#include "test.h"
+
+namespace {
+	// Largest value the bucket holding value covers, as reported for it.
+	int64_t bound_of(int64_t value) {
+		LatencyHistogram histogram;
+		histogram.record(value);
+		return histogram.buckets().front().upper_us;
+	}
+
+	// Largest value the histogram resolves; anything above shares the top bucket.
+	constexpr int64_t TOP_BOUND = (int64_t{ 2 } * LatencyHistogram::SUB_BUCKETS << (LatencyHistogram::MAGNITUDES - 1)) - 1;
+
+	void check_bound(int64_t value) {
+		const int64_t bound = bound_of(value);
+		CHECK(bound >= value);
+		// Within one bucket width, which is at most 1/SUB_BUCKETS of the value.
+		CHECK(bound - value <= value / static_cast<int64_t>(LatencyHistogram::SUB_BUCKETS));
+		// The bound is the last value of its bucket: it lands in the same bucket and the next one does not.
+		CHECK_EQ(bound_of(bound), bound);
+		CHECK(bound_of(bound + 1) > bound);
+	}
+}
+
+TEST(latency_histogram, counts_small_values_exactly) {
+	for (int64_t value = 0; value < static_cast<int64_t>(LatencyHistogram::SUB_BUCKETS); value++) {
+		CHECK_EQ(bound_of(value), value);
+	}
+	CHECK_EQ(bound_of(-5), int64_t{ 0 });
+}
+
+TEST(latency_histogram, buckets_tile_the_range) {
+	for (int64_t value = 0; value < 4096; value++) {
+		check_bound(value);
+	}
+
+	std::mt19937_64 random(42);
+	std::uniform_int_distribution<int> bits(12, 24);
+	for (int i = 0; i < 2000; i++) {
+		const int64_t value = static_cast<int64_t>(random() >> (64 - bits(random)));
+		check_bound(value);
+	}
+
+	// First bucket of every magnitude.
+	for (size_t magnitude = 0; magnitude < LatencyHistogram::MAGNITUDES; magnitude++) {
+		const int64_t start = static_cast<int64_t>(LatencyHistogram::SUB_BUCKETS) << magnitude;
+		CHECK_EQ(bound_of(start), start + (int64_t{ 1 } << magnitude) - 1);
+		CHECK_EQ(bound_of(start - 1), start - 1);
+	}
+}
+
+TEST(latency_histogram, top_bucket_takes_everything_larger) {
+	CHECK_EQ(bound_of(TOP_BOUND), TOP_BOUND);
+	CHECK_EQ(bound_of(TOP_BOUND + 1), TOP_BOUND);
+	CHECK_EQ(bound_of(int64_t{ 1 } << 40), TOP_BOUND);
+
+	// The top bucket is open-ended, so its percentiles report the exact maximum.
+	LatencyHistogram histogram;
+	histogram.record(100);
+	histogram.record(int64_t{ 1 } << 40);
+	CHECK_EQ(histogram.percentile_us(100.0), int64_t{ 1 } << 40);
+	CHECK_EQ(histogram.max_us(), int64_t{ 1 } << 40);
+}
+
+TEST(latency_histogram, percentiles_of_a_uniform_spread) {
+	LatencyHistogram histogram;
+	CHECK_EQ(histogram.percentile_us(50.0), int64_t{ 0 });
+
+	for (int64_t value = 1; value <= 1000; value++) {
+		histogram.record(value);
+	}
+	CHECK_EQ(histogram.count(), uint64_t{ 1000 });
+	CHECK_NEAR(histogram.mean_us(), 500.5, 1e-9);
+	CHECK_EQ(histogram.max_us(), int64_t{ 1000 });
+
+	// Each percentile is the bound of the bucket holding the value at that rank.
+	CHECK_EQ(histogram.percentile_us(0.0), int64_t{ 1 });
+	CHECK_EQ(histogram.percentile_us(50.0), bound_of(500));
+	CHECK_EQ(histogram.percentile_us(90.0), bound_of(900));
+	CHECK_EQ(histogram.percentile_us(99.0), bound_of(990));
+	// Capped at the largest value recorded rather than its bucket's bound.
+	CHECK_EQ(histogram.percentile_us(100.0), int64_t{ 1000 });
+	CHECK_EQ(histogram.percentile_us(250.0), int64_t{ 1000 });
+	for (double percentile = 1.0; percentile <= 100.0; percentile += 1.0) {
+		// Rounding the rank may step one value past the exact one.
+		const double exact = percentile * 10.0;
+		CHECK(histogram.percentile_us(percentile) >= exact);
+		CHECK(histogram.percentile_us(percentile) <= (exact + 1.0) * (1.0 + 1.0 / LatencyHistogram::SUB_BUCKETS));
+	}
+}
+
+TEST(latency_histogram, percentiles_find_the_tail) {
+	LatencyHistogram histogram;
+	for (int i = 0; i < 990; i++) {
+		histogram.record(100);
+	}
+	for (int i = 0; i < 10; i++) {
+		histogram.record(50000);
+	}
+	CHECK_EQ(histogram.percentile_us(50.0), bound_of(100));
+	CHECK_EQ(histogram.percentile_us(99.0), bound_of(100));
+	CHECK_EQ(histogram.percentile_us(99.9), int64_t{ 50000 });
+
+	const std::vector<LatencyHistogram::Bucket> buckets = histogram.buckets();
+	CHECK_EQ(buckets.size(), size_t{ 2 });
+	CHECK_EQ(buckets[0].count, uint64_t{ 990 });
+	CHECK_EQ(buckets[1].count, uint64_t{ 10 });
+
+	histogram.reset();
+	CHECK_EQ(histogram.count(), uint64_t{ 0 });
+	CHECK(histogram.buckets().empty());
+	CHECK_EQ(histogram.max_us(), int64_t{ 0 });
+}
+
+TEST(latency_histogram, records_from_many_threads) {
+	LatencyHistogram histogram;
+	std::vector<std::thread> threads;
+	for (int t = 0; t < 4; t++) {
+		threads.emplace_back([&histogram, t]() {
+			for (int i = 0; i < 10000; i++) {
+				histogram.record(t * 1000 + i % 1000);
+			}
+		});
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+
+	uint64_t bucketed = 0;
+	for (const auto& bucket : histogram.buckets()) {
+		bucketed += bucket.count;
+	}
+	CHECK_EQ(histogram.count(), uint64_t{ 40000 });
+	CHECK_EQ(bucketed, uint64_t{ 40000 });
+	CHECK_EQ(histogram.max_us(), int64_t{ 3999 });
+}
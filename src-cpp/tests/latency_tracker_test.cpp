@@ -0,0 +1,183 @@
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "latency_tracker.h"
+#include "test.h"
+#include "voip_packet.h"
+
+namespace {
+	constexpr uint32_t LOCAL_SPEAKER = 0x1234;
+	constexpr int64_t MS = 1000000;
+
+	// Stands in for the server in loopback mode: every packet it is sent comes back to the sender after
+	// a fixed delay, in order, on the server's own thread.
+	class LoopbackServer {
+	public:
+		LoopbackServer(std::chrono::milliseconds delay, std::function<void(const std::vector<unsigned char>&)> deliver)
+			: delay(delay), deliver(std::move(deliver)), thread([this]() { run(); }) {}
+
+		~LoopbackServer() {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+			cv.notify_one();
+			thread.join();
+		}
+
+		void send(const unsigned char* data, size_t size) {
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				queue.push_back({ std::chrono::steady_clock::now() + delay, std::vector<unsigned char>(data, data + size) });
+			}
+			cv.notify_one();
+		}
+
+	private:
+		struct InFlight {
+			std::chrono::steady_clock::time_point due;
+			std::vector<unsigned char> packet;
+		};
+
+		void run() {
+			std::unique_lock<std::mutex> lock(mutex);
+			while (true) {
+				cv.wait(lock, [&]() { return stopping || !queue.empty(); });
+				if (queue.empty()) {
+					return;
+				}
+				const auto due = queue.front().due;
+				lock.unlock();
+				std::this_thread::sleep_until(due);
+				lock.lock();
+				InFlight in_flight = std::move(queue.front());
+				queue.pop_front();
+				lock.unlock();
+				deliver(in_flight.packet);
+				lock.lock();
+			}
+		}
+
+		const std::chrono::milliseconds delay;
+		const std::function<void(const std::vector<unsigned char>&)> deliver;
+		std::mutex mutex;
+		std::condition_variable cv;
+		std::deque<InFlight> queue;
+		bool stopping = false;
+		std::thread thread;
+	};
+}
+
+// Packets go out through the send path's bookkeeping, round a loopback server and back through the
+// receive path's, and the stages only loopback can measure come out at the delays put in.
+TEST(latency, loopback_round_trip) {
+	constexpr int PACKETS = 100;
+	constexpr int64_t CAPTURE_TO_SEND_NS = 5 * MS;
+	constexpr int64_t ARRIVAL_TO_DAC_NS = 20 * MS;
+	constexpr int64_t SERVER_DELAY_NS = 10 * MS;
+	latency::reset();
+
+	std::mutex received_mutex;
+	int returned = 0;
+	int unmatched = 0;
+	LoopbackServer server(std::chrono::milliseconds(SERVER_DELAY_NS / MS), [&](const std::vector<unsigned char>& data) {
+		VoipPacketView view;
+		CHECK(parse_voip_packet(data.data(), data.size(), view));
+		const int64_t arrival_ns = latency::now_ns();
+		if (view.header.speaker_id != LOCAL_SPEAKER || !latency::loopback_arrived(view.header.sequence, arrival_ns)) {
+			std::lock_guard<std::mutex> lock(received_mutex);
+			unmatched++;
+			return;
+		}
+
+		// What the playout path does once the packet's first sample reaches the DAC.
+		int64_t capture_ns;
+		int64_t sent_ns;
+		CHECK(latency::find_sent(view.header.sequence, capture_ns, sent_ns));
+		latency::record(latency::Stage::MOUTH_TO_EAR, arrival_ns + ARRIVAL_TO_DAC_NS - capture_ns);
+		std::lock_guard<std::mutex> lock(received_mutex);
+		returned++;
+	});
+
+	unsigned char packet[VOIP_HEADER_SIZE + 4] = {};
+	for (int i = 0; i < PACKETS; i++) {
+		const uint16_t sequence = static_cast<uint16_t>(65500 + i);
+		const int64_t sent_ns = latency::now_ns();
+		latency::packet_sent(sequence, sent_ns - CAPTURE_TO_SEND_NS, sent_ns);
+		write_voip_header(packet, VoipPacketHeader{ VOIP_PACKET_VERSION, 0, sequence, static_cast<uint32_t>(i * 480), LOCAL_SPEAKER });
+		server.send(packet, sizeof(packet));
+
+		// Another speaker's packet with the same sequence number is not ours.
+		if (i % 10 == 0) {
+			write_voip_header(packet, VoipPacketHeader{ VOIP_PACKET_VERSION, 0, sequence, 0, LOCAL_SPEAKER + 1 });
+			server.send(packet, sizeof(packet));
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+	}
+
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while (std::chrono::steady_clock::now() < deadline) {
+		{
+			std::lock_guard<std::mutex> lock(received_mutex);
+			if (returned + unmatched == PACKETS + PACKETS / 10) {
+				break;
+			}
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	}
+	{
+		std::lock_guard<std::mutex> lock(received_mutex);
+		CHECK_EQ(returned, PACKETS);
+		CHECK_EQ(unmatched, PACKETS / 10);
+	}
+
+	// Scheduling only ever adds delay; allow generously for a loaded machine above the injected one.
+	const std::vector<latency::StageSummary> summary = latency::get_summary();
+	const latency::StageSummary& network = summary[static_cast<size_t>(latency::Stage::NETWORK)];
+	const latency::StageSummary& mouth_to_ear = summary[static_cast<size_t>(latency::Stage::MOUTH_TO_EAR)];
+	CHECK_EQ(network.count, uint64_t{ PACKETS });
+	CHECK(network.p50_ms >= 10.0 && network.p50_ms < 40.0);
+	CHECK(network.max_ms >= network.p50_ms);
+	CHECK_EQ(mouth_to_ear.count, uint64_t{ PACKETS });
+	CHECK(mouth_to_ear.p50_ms >= 35.0 && mouth_to_ear.p50_ms < 65.0);
+	CHECK_NEAR(mouth_to_ear.mean_ms - network.mean_ms, (CAPTURE_TO_SEND_NS + ARRIVAL_TO_DAC_NS) / 1e6, 0.01);
+
+	// The JSON dump carries the same stages with their buckets.
+	const nlohmann::json dump = nlohmann::json::parse(latency::to_json());
+	const nlohmann::json& network_json = dump["stages"]["network"];
+	CHECK_EQ(network_json["count"].get<uint64_t>(), uint64_t{ PACKETS });
+	uint64_t bucketed = 0;
+	for (const auto& bucket : network_json["buckets"]) {
+		bucketed += bucket[1].get<uint64_t>();
+	}
+	CHECK_EQ(bucketed, uint64_t{ PACKETS });
+	CHECK_EQ(dump["stages"]["jitter"]["count"].get<uint64_t>(), uint64_t{ 0 });
+	latency::reset();
+}
+
+// A remembered packet is forgotten once its slot is taken by a later sequence number.
+TEST(latency, forgets_packets_after_their_slot_is_reused) {
+	latency::reset();
+	latency::packet_sent(7, 100, 200);
+	int64_t capture_ns = 0;
+	int64_t sent_ns = 0;
+	CHECK(latency::find_sent(7, capture_ns, sent_ns));
+	CHECK_EQ(capture_ns, int64_t{ 100 });
+	CHECK_EQ(sent_ns, int64_t{ 200 });
+
+	latency::packet_sent(7 + 256, 300, 400);
+	CHECK(!latency::find_sent(7, capture_ns, sent_ns));
+	CHECK(!latency::loopback_arrived(7, 1000));
+	CHECK(latency::loopback_arrived(7 + 256, 400 + 3 * MS));
+	const latency::StageSummary network = latency::get_summary()[static_cast<size_t>(latency::Stage::NETWORK)];
+	CHECK_EQ(network.count, uint64_t{ 1 });
+	CHECK_NEAR(network.max_ms, 3.0, 1e-9);
+	latency::reset();
+}
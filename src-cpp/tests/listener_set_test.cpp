@@ -0,0 +1,71 @@
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "listener_set.h"
+#include "test.h"
+
+namespace {
+	using Listener = std::function<void(const float* samples, size_t count)>;
+}
+
+TEST(listener_set, calls_attached_listeners_in_order) {
+	ListenerSet<Listener> listeners;
+	std::vector<int> calls;
+	auto first = std::make_shared<Listener>([&](const float*, size_t count) { calls.push_back(static_cast<int>(count)); });
+	auto second = std::make_shared<Listener>([&](const float*, size_t count) { calls.push_back(-static_cast<int>(count)); });
+	auto empty = std::make_shared<Listener>();
+
+	const float samples[4] = {};
+	listeners.attach(first);
+	listeners.attach(empty);
+	listeners.attach(second);
+	listeners.notify(samples, size_t{ 4 });
+	CHECK_EQ(calls.size(), size_t{ 2 });
+	CHECK_EQ(calls[0], 4);
+	CHECK_EQ(calls[1], -4);
+
+	// Every attachment of a listener goes.
+	listeners.attach(first);
+	listeners.detach(first);
+	calls.clear();
+	listeners.notify(samples, size_t{ 2 });
+	CHECK_EQ(calls.size(), size_t{ 1 });
+	CHECK_EQ(calls[0], -2);
+}
+
+// The audio thread keeps notifying while another thread attaches and detaches; the sanitizer build catches
+// any use of a freed list.
+TEST(listener_set, edits_while_notifying) {
+	ListenerSet<Listener> listeners;
+	std::atomic<size_t> calls{ 0 };
+	auto counter = std::make_shared<Listener>([&](const float*, size_t) { calls.fetch_add(1, std::memory_order_relaxed); });
+	listeners.attach(counter);
+
+	std::atomic<bool> running{ true };
+	std::thread audio([&]() {
+		const float samples[8] = {};
+		while (running.load()) {
+			listeners.notify(samples, size_t{ 8 });
+		}
+	});
+
+	// Edits keep going until the audio thread has been notifying through plenty of them.
+	size_t edits = 0;
+	while (edits < 2000 || calls.load() < 1000) {
+		auto extra = std::make_shared<Listener>([](const float*, size_t) {});
+		listeners.attach(extra);
+		listeners.detach(extra);
+		edits++;
+	}
+	running.store(false);
+	audio.join();
+
+	// The listener that stayed attached was never skipped over by a swap.
+	const size_t before = calls.load();
+	const float samples[8] = {};
+	listeners.notify(samples, size_t{ 8 });
+	CHECK_EQ(calls.load(), before + 1);
+}
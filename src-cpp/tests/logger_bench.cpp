@@ -0,0 +1,68 @@
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#include "bench.h"
+#include "logger.h"
+
+namespace {
+	// Half the logger's queue, so a burst never drops; the flusher drains it between bursts.
+	constexpr size_t BURST = 1024;
+	constexpr size_t BURSTS = 2000;
+
+	// What the calling thread pays per message: calls are timed a burst at a time and the flush that
+	// follows each burst, which happens on the logger's own thread in the app, is left out.
+	template <typename Fn>
+	void measure_calls(const char* label, Fn&& fn) {
+		logger::Logger& log = logger::Logger::get_instance();
+		size_t bursts = static_cast<size_t>(static_cast<double>(BURSTS) * bench::scale());
+		if (bursts == 0) {
+			bursts = 1;
+		}
+
+		double best_ns = 0.0;
+		for (int run = 0; run < 3; run++) {
+			double total_ns = 0.0;
+			for (size_t burst = 0; burst < bursts; burst++) {
+				const auto start = std::chrono::steady_clock::now();
+				for (size_t i = 0; i < BURST; i++) {
+					fn(i);
+				}
+				total_ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+				log.flush();
+			}
+			if (run == 0 || total_ns < best_ns) {
+				best_ns = total_ns;
+			}
+		}
+		std::printf("  %-44s %10.1f ns/call\n", label, best_ns / static_cast<double>(bursts * BURST));
+	}
+}
+
+// Cost of a log call on the calling thread, for the shapes hot paths use. Formatting and I/O happen
+// later on the flusher thread and are not counted.
+BENCHMARK(logger) {
+	logger::Logger& log = logger::Logger::get_instance();
+	log.set_console_output(false);
+	log.set_level(logger::LogLevel::L_INFO);
+
+	measure_calls("literal text", [&](size_t) {
+		log.log(logger::LogLevel::L_INFO, "Voip send buffer drained, resuming");
+	});
+	measure_calls("literal format, 3 numbers", [&](size_t i) {
+		log.log(logger::LogLevel::L_INFO, "Speaker %u joined after %.1f ms, slot %d", static_cast<unsigned>(i), 12.5, 3);
+	});
+	measure_calls("literal format, 10 numbers + 2 StaticText", [&](size_t i) {
+		log.log(logger::LogLevel::L_INFO,
+			"Bitrate controller: bitrate %d -> %d, loss%% %d -> %d, complexity %d -> %d, frame %dms -> %dms (loss %.1f%%, rtt %dms%s%s)",
+			64000, 44800, 2, 5, 9, 8, 20, 40, 3.5, static_cast<int>(i), logger::StaticText(", congested"), logger::StaticText(""));
+	});
+	measure_calls("std::string concatenation", [&](size_t i) {
+		log.log(logger::LogLevel::L_INFO, "Speaker joined: " + std::to_string(i));
+	});
+	measure_calls("filtered out at runtime", [&](size_t i) {
+		SPEAKLY_LOG(logger::LogLevel::L_DEBUG, "Speaker joined: %u", static_cast<unsigned>(i));
+	});
+
+	log.set_console_output(true);
+}
@@ -0,0 +1,75 @@
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "logger.h"
+#include "test.h"
+
+namespace {
+	// Logs through fn into a fresh file and returns what was written, one message per line.
+	template <typename Fn>
+	std::string logged(Fn&& fn) {
+		const std::string path = "speakly_logger_test.log";
+		std::remove(path.c_str());
+
+		logger::Logger& log = logger::Logger::get_instance();
+		log.set_console_output(false);
+		log.set_log_file(path);
+		fn(log);
+		log.close_log_file();
+		log.set_console_output(true);
+
+		std::ifstream file(path);
+		std::stringstream text;
+		text << file.rdbuf();
+		file.close();
+		std::remove(path.c_str());
+		return text.str();
+	}
+
+	bool contains(const std::string& text, const std::string& part) {
+		return text.find(part) != std::string::npos;
+	}
+}
+
+TEST(logger, formats_packed_arguments_on_the_flusher) {
+	const std::string text = logged([](logger::Logger& log) {
+		log.log(logger::LogLevel::L_INFO, "bitrate %d -> %d, loss %.1f%%, buffered %zuB%s", 64000, 44800, 3.5, size_t{ 1500 },
+			logger::StaticText(", congested"));
+		log.log(logger::LogLevel::L_WARNING, "Speaker %u left", 42u);
+	});
+	CHECK(contains(text, "[INFO] bitrate 64000 -> 44800, loss 3.5%, buffered 1500B, congested\n"));
+	CHECK(contains(text, "[WARNING] Speaker 42 left\n"));
+}
+
+TEST(logger, copies_text_and_strings) {
+	std::string message = "Creating data channel: voip";
+	const std::string text = logged([&](logger::Logger& log) {
+		log.log(logger::LogLevel::L_INFO, "Closing peer connection");
+		log.log(logger::LogLevel::L_INFO, message);
+		// The string was copied when logged.
+		message.assign(message.size(), 'x');
+	});
+	CHECK(contains(text, "[INFO] Closing peer connection\n"));
+	CHECK(contains(text, "[INFO] Creating data channel: voip\n"));
+}
+
+TEST(logger, drops_messages_below_the_level) {
+	const std::string text = logged([](logger::Logger& log) {
+		log.set_level(logger::LogLevel::L_WARNING);
+		log.log(logger::LogLevel::L_INFO, "hidden %d", 1);
+		SPEAKLY_LOG(logger::LogLevel::L_INFO, "hidden too");
+		log.log(logger::LogLevel::L_WARNING, "shown %d", 2);
+		log.set_level(logger::LogLevel::L_INFO);
+	});
+	CHECK(!contains(text, "hidden"));
+	CHECK(contains(text, "[WARNING] shown 2\n"));
+}
+
+TEST(logger, marks_truncated_messages) {
+	const std::string text = logged([](logger::Logger& log) {
+		log.log(logger::LogLevel::L_INFO, std::string(2 * logger::LogRecord::PAYLOAD_SIZE, 'a'));
+	});
+	CHECK(contains(text, std::string(logger::LogRecord::PAYLOAD_SIZE - 3, 'a') + "...\n"));
+}
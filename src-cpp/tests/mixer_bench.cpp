@@ -0,0 +1,39 @@
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "mixer.h"
+
+namespace {
+	constexpr size_t FRAME_SIZE = 480;
+	constexpr size_t ITERATIONS = 20000;
+	constexpr size_t SPEAKER_COUNTS[] = { 1, 8, 32, 64 };
+}
+
+// The summing half of SpeakerMixer::mix: one 10 ms frame of already decoded audio per speaker added into
+// the output, then the soft limiter. Each speaker sits at -12 dBFS so larger rooms push the limiter hard.
+BENCHMARK(mixer) {
+	std::mt19937 rng(4);
+	std::uniform_real_distribution<float> sample(-0.25f, 0.25f);
+	std::vector<std::vector<float>> speakers(SPEAKER_COUNTS[3], std::vector<float>(FRAME_SIZE));
+	for (std::vector<float>& pcm : speakers) {
+		for (float& value : pcm) {
+			value = sample(rng);
+		}
+	}
+	std::vector<float> output(FRAME_SIZE);
+
+	for (size_t count : SPEAKER_COUNTS) {
+		const std::string label = std::to_string(count) + (count == 1 ? " speaker" : " speakers");
+		bench::measure(label.c_str(), ITERATIONS, FRAME_SIZE * count, [&]() {
+			std::fill(output.begin(), output.end(), 0.0f);
+			for (size_t i = 0; i < count; i++) {
+				mixer::accumulate(output.data(), speakers[i].data(), FRAME_SIZE);
+			}
+			mixer::soft_limit(output.data(), FRAME_SIZE);
+			bench::keep(output.back());
+		});
+	}
+}
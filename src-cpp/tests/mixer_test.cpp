@@ -0,0 +1,83 @@
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "mixer.h"
+#include "test.h"
+
+namespace {
+	std::vector<float> random_samples(std::mt19937& rng, size_t count, float amplitude) {
+		std::uniform_real_distribution<float> sample(-amplitude, amplitude);
+		std::vector<float> samples(count);
+		for (float& value : samples) {
+			value = sample(rng);
+		}
+		return samples;
+	}
+}
+
+// Every length up to a few vector widths, from every alignment, so the AVX, SSE and scalar tails each run
+// and none writes past count.
+TEST(mixer, accumulate_matches_a_scalar_sum) {
+	std::mt19937 rng(5);
+	constexpr size_t PADDING = 8;
+	for (size_t offset = 0; offset < 4; offset++) {
+		for (size_t count = 0; count <= 37; count++) {
+			const std::vector<float> source = random_samples(rng, offset + count + PADDING, 1.0f);
+			std::vector<float> destination = random_samples(rng, offset + count + PADDING, 1.0f);
+
+			std::vector<float> expected = destination;
+			for (size_t i = offset; i < offset + count; i++) {
+				expected[i] += source[i];
+			}
+
+			mixer::accumulate(destination.data() + offset, source.data() + offset, count);
+			CHECK(destination == expected);
+		}
+	}
+}
+
+TEST(mixer, soft_limit_is_transparent_below_the_threshold) {
+	std::mt19937 rng(6);
+	for (size_t offset = 0; offset < 4; offset++) {
+		const std::vector<float> input = random_samples(rng, 203, 0.8f);
+		std::vector<float> output = input;
+		mixer::soft_limit(output.data() + offset, output.size() - offset);
+		CHECK(output == input);
+	}
+}
+
+// Above 0.8 every sample is bent below full scale, keeps its sign, and louder stays louder.
+TEST(mixer, soft_limit_bounds_loud_samples) {
+	std::vector<float> input;
+	for (float magnitude = 0.8f; magnitude <= 64.0f; magnitude *= 1.01f) {
+		input.push_back(magnitude);
+		input.push_back(-magnitude);
+	}
+	// Odd length so the scalar tail limits a sample too.
+	input.push_back(3.0f);
+
+	std::vector<float> output = input;
+	mixer::soft_limit(output.data(), output.size());
+	for (size_t i = 0; i < output.size(); i++) {
+		CHECK(std::fabs(output[i]) < 1.0f);
+		CHECK(std::fabs(output[i]) >= 0.8f);
+		CHECK(std::signbit(output[i]) == std::signbit(input[i]));
+		if (i >= 2 && i + 1 < output.size()) {
+			CHECK(std::fabs(output[i]) >= std::fabs(output[i - 2]));
+		}
+	}
+	// The vector lanes and the scalar tail both follow threshold + headroom * u / (1 + u).
+	for (size_t i = 0; i < output.size(); i++) {
+		const double excess = (std::fabs(input[i]) - 0.8) / 0.2;
+		CHECK_NEAR(std::fabs(output[i]), 0.8 + 0.2 * excess / (1.0 + excess), 1e-5);
+	}
+
+	// Continuous at the knee.
+	std::vector<float> knee{ 0.8f, 0.8001f, -0.8001f, 0.81f };
+	mixer::soft_limit(knee.data(), knee.size());
+	CHECK_EQ(knee[0], 0.8f);
+	CHECK_NEAR(knee[1], 0.8001f, 1e-5);
+	CHECK_NEAR(knee[2], -0.8001f, 1e-5);
+	CHECK_NEAR(knee[3], 0.81f, 1e-3);
+}
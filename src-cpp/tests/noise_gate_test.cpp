@@ -0,0 +1,177 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "plugins/noise_gate_plugin.h"
+#include "test.h"
+
+namespace {
+	constexpr int SAMPLE_RATE = 48000;
+	constexpr double PI = 3.14159265358979323846;
+	// The default -38dBFS threshold as a mean square.
+	const double OPEN_POWER = std::pow(10.0, -3.8);
+
+	// Quiet (0.1x the open power) until loud_start, loud (5x) until loud_end, quiet again after. Signs
+	// alternate so the input looks like audio rather than DC; the detector only sees squares.
+	std::vector<float> make_input(size_t length, size_t loud_start, size_t loud_end) {
+		const float quiet = static_cast<float>(std::sqrt(0.1 * OPEN_POWER));
+		const float loud = static_cast<float>(std::sqrt(5.0 * OPEN_POWER));
+		std::vector<float> input(length);
+		for (size_t i = 0; i < length; i++) {
+			const float level = i >= loud_start && i < loud_end ? loud : quiet;
+			input[i] = i % 2 == 0 ? level : -level;
+		}
+		return input;
+	}
+
+	std::vector<float> run(NoiseGatePlugin& gate, std::vector<float> signal, const std::vector<size_t>& blocks) {
+		size_t offset = 0;
+		for (size_t i = 0; offset < signal.size(); i++) {
+			const size_t length = std::min(blocks[i % blocks.size()], signal.size() - offset);
+			gate.process(signal.data() + offset, static_cast<int>(length));
+			offset += length;
+		}
+		return signal;
+	}
+
+	// The gate as the plain per-sample loop: slide a 48-sample window of squares, decide, ramp.
+	std::vector<float> reference_gate(std::vector<float> signal, double attack_ms, double hold_ms, double release_ms) {
+		const double open_energy = OPEN_POWER * 48.0;
+		const double close_energy = std::pow(10.0, -4.1) * 48.0;
+		const int hold_samples = static_cast<int>(hold_ms * SAMPLE_RATE / 1000.0);
+		const float attack_step = 1.0f / std::max(1.0f, static_cast<float>(attack_ms * SAMPLE_RATE / 1000.0));
+		const float release_step = 1.0f / std::max(1.0f, static_cast<float>(release_ms * SAMPLE_RATE / 1000.0));
+
+		std::vector<float> squares(48, 0.0f);
+		double energy = 0.0;
+		bool open = false;
+		int hold_remaining = 0;
+		float gain = 0.0f;
+		for (size_t i = 0; i < signal.size(); i++) {
+			const float square = signal[i] * signal[i];
+			energy += square - squares[i % 48];
+			squares[i % 48] = square;
+			if (energy >= open_energy || (open && energy >= close_energy)) {
+				open = true;
+				hold_remaining = hold_samples;
+			}
+			else if (open && --hold_remaining <= 0) {
+				open = false;
+			}
+			if (!open && gain == 0.0f) {
+				signal[i] = 0.0f;
+				continue;
+			}
+			gain = open ? std::min(1.0f, gain + attack_step) : std::max(0.0f, gain - release_step);
+			signal[i] *= gain * gain;
+		}
+		return signal;
+	}
+
+	// First sample that passes the gate and first sample after it that does not.
+	std::pair<size_t, size_t> open_span(const std::vector<float>& output) {
+		size_t first = 0;
+		while (first < output.size() && output[first] == 0.0f) {
+			first++;
+		}
+		size_t last = first;
+		while (last < output.size() && output[last] != 0.0f) {
+			last++;
+		}
+		return { first, last };
+	}
+}
+
+// With a 48-sample (1ms) window, loud samples from 1000 on lift the window mean to the threshold at the
+// ninth: (9 * 5 + 39 * 0.1) / 48 >= 1. After the loud part ends at 5000 the window stays above the close
+// threshold (-3dB) through sample 5043, and the gate closes one 10ms hold (480 samples) later.
+TEST(noise_gate, opens_and_closes_on_exact_samples) {
+	const std::vector<float> input = make_input(8000, 1000, 5000);
+
+	NoiseGatePlugin gate(SAMPLE_RATE);
+	gate.set_timing(0.0, 10.0, 0.0);
+	const auto [first, last] = open_span(run(gate, input, { 480 }));
+	CHECK_EQ(first, size_t{ 1008 });
+	CHECK_EQ(last, size_t{ 5043 + 480 });
+}
+
+TEST(noise_gate, block_size_does_not_move_the_edges) {
+	const std::vector<float> input = make_input(8000, 1000, 5000);
+
+	NoiseGatePlugin reference_gate(SAMPLE_RATE);
+	const std::vector<float> expected = run(reference_gate, input, { 480 });
+
+	std::mt19937 rng(9);
+	std::uniform_int_distribution<size_t> block(1, 600);
+	for (int trial = 0; trial < 5; trial++) {
+		std::vector<size_t> blocks(64);
+		for (size_t& size : blocks) {
+			size = block(rng);
+		}
+		NoiseGatePlugin gate(SAMPLE_RATE);
+		CHECK(run(gate, input, blocks) == expected);
+	}
+}
+
+TEST(noise_gate, attack_and_release_ramp_per_sample) {
+	const std::vector<float> input = make_input(8000, 1000, 5000);
+
+	// 1ms attack and release: 48 steps of 1/48 each way.
+	NoiseGatePlugin gate(SAMPLE_RATE);
+	gate.set_timing(1.0, 10.0, 1.0);
+	const std::vector<float> output = run(gate, input, { 480 });
+
+	float gain = 0.0f;
+	for (size_t i = 1008; i < 1008 + 60; i++) {
+		gain = std::min(1.0f, gain + 1.0f / 48.0f);
+		CHECK_NEAR(output[i], input[i] * gain * gain, 1e-7);
+	}
+
+	// The release starts on the sample the gate closes and is silent 48 samples later.
+	const size_t close = 5043 + 480;
+	CHECK_EQ(output[close - 1], input[close - 1]);
+	gain = 1.0f;
+	for (size_t i = close; i < close + 48; i++) {
+		gain = std::max(0.0f, gain - 1.0f / 48.0f);
+		CHECK_NEAR(output[i], input[i] * gain * gain, 1e-7);
+	}
+	CHECK_EQ(output[close + 48], 0.0f);
+}
+
+TEST(noise_gate, stays_shut_below_threshold) {
+	const std::vector<float> input = make_input(48000, 0, 0);
+	NoiseGatePlugin gate(SAMPLE_RATE);
+	const std::vector<float> output = run(gate, input, { 480 });
+	CHECK(std::all_of(output.begin(), output.end(), [](float sample) { return sample == 0.0f; }));
+	CHECK(gate.voice_activity() == VoiceActivity::SILENCE);
+}
+
+// Noise whose level drifts back and forth across both thresholds, so the window crosses them often and at
+// every offset into a block; the stretches the gate decides at once must agree with the per-sample loop.
+// Samples are whole multiples of 2^-12 below 2^-3, so every window sum is exact in either loop and a
+// rounding difference cannot tip a sample that sits right on a threshold.
+TEST(noise_gate, matches_the_per_sample_loop_near_the_thresholds) {
+	std::mt19937 rng(3);
+	std::normal_distribution<float> noise(0.0f, 1.0f);
+	std::vector<float> input(96000);
+	for (size_t i = 0; i < input.size(); i++) {
+		// Between 0.3x and 3x the open power, a cycle every 50ms.
+		const double power = OPEN_POWER * std::pow(10.0, 0.5 * std::sin(static_cast<double>(i) * 2.0 * PI / 2400.0));
+		const float sample = noise(rng) * static_cast<float>(std::sqrt(power));
+		input[i] = std::clamp(std::round(sample * 4096.0f), -511.0f, 511.0f) / 4096.0f;
+	}
+	const std::vector<float> expected = reference_gate(input, 1.0, 5.0, 2.0);
+
+	std::uniform_int_distribution<size_t> block(1, 600);
+	for (const std::vector<size_t>& blocks : { std::vector<size_t>{ 480 }, std::vector<size_t>{ 7, 100, 1, 13 }, std::vector<size_t>{ block(rng), block(rng), block(rng) } }) {
+		NoiseGatePlugin gate(SAMPLE_RATE);
+		gate.set_timing(1.0, 5.0, 2.0);
+		const std::vector<float> output = run(gate, input, blocks);
+		size_t mismatches = 0;
+		for (size_t i = 0; i < output.size(); i++) {
+			mismatches += output[i] == expected[i] ? 0 : 1;
+		}
+		CHECK_EQ(mismatches, size_t{ 0 });
+	}
+}
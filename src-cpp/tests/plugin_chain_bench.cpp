@@ -0,0 +1,89 @@
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "bench.h"
+#include "plugins/audio_processor.h"
+#include "plugins/high_pass_plugin.h"
+#include "plugins/noise_gate_plugin.h"
+#include "plugins/static_audio_chain.h"
+
+namespace {
+	constexpr int SAMPLE_RATE = 48000;
+	constexpr int FRAME_SIZE = 480;
+	constexpr size_t FRAMES = 100;
+	constexpr size_t ITERATIONS = 20000;
+
+	// One second of quiet noise with a loud burst every quarter second, so the gate keeps opening and closing.
+	std::vector<float> make_input() {
+		std::mt19937 rng(7);
+		std::normal_distribution<float> noise(0.0f, 0.003f);
+		std::vector<float> input(FRAMES * FRAME_SIZE);
+		for (size_t i = 0; i < input.size(); i++) {
+			const bool burst = (i / (SAMPLE_RATE / 8)) % 2 == 1;
+			input[i] = noise(rng) * (burst ? 60.0f : 1.0f);
+		}
+		return input;
+	}
+
+	// Runs one frame per call, cycling through the input so every call sees the gate in a realistic state.
+	template <typename Process>
+	void run(const char* label, const std::vector<float>& input, Process&& process) {
+		std::vector<float> frame(FRAME_SIZE);
+		size_t next = 0;
+		bench::measure(label, ITERATIONS, FRAME_SIZE, [&]() {
+			std::copy(input.begin() + next * FRAME_SIZE, input.begin() + (next + 1) * FRAME_SIZE, frame.begin());
+			process(frame.data());
+			bench::keep(frame[FRAME_SIZE - 1]);
+			next = (next + 1) % FRAMES;
+		});
+	}
+}
+
+// HighPass followed by NoiseGate on 10 ms frames, through each way the engine can hold a chain.
+BENCHMARK(high_pass_noise_gate) {
+	const std::vector<float> input = make_input();
+
+	StaticAudioChain<HighPassPlugin, NoiseGatePlugin> chain(HighPassPlugin(80.0f, SAMPLE_RATE), NoiseGatePlugin(SAMPLE_RATE));
+	run("StaticAudioChain, direct", input, [&chain](float* frame) {
+		chain.process(frame, FRAME_SIZE);
+	});
+
+	AudioProcessor wrapped;
+	wrapped.add_plugin(std::make_shared<StaticAudioChain<HighPassPlugin, NoiseGatePlugin>>(HighPassPlugin(80.0f, SAMPLE_RATE), NoiseGatePlugin(SAMPLE_RATE)));
+	run("StaticAudioChain inside AudioProcessor", input, [&wrapped](float* frame) {
+		wrapped.process_audio(frame, FRAME_SIZE);
+	});
+
+	AudioProcessor runtime;
+	runtime.add_plugin(std::make_shared<HighPassPlugin>(80.0f, SAMPLE_RATE));
+	runtime.add_plugin(std::make_shared<NoiseGatePlugin>(SAMPLE_RATE));
+	run("AudioProcessor, one plugin each", input, [&runtime](float* frame) {
+		runtime.process_audio(frame, FRAME_SIZE);
+	});
+}
+
+// The gate on its own, over the same input: quiet stretches, loud bursts and the edges between them.
+BENCHMARK(noise_gate) {
+	const std::vector<float> input = make_input();
+
+	NoiseGatePlugin gate(SAMPLE_RATE);
+	run("NoiseGatePlugin, opening and closing", input, [&gate](float* frame) {
+		gate.process(frame, FRAME_SIZE);
+	});
+
+	std::vector<float> quiet(input.size());
+	std::transform(input.begin(), input.end(), quiet.begin(), [](float sample) { return sample * 0.1f; });
+	NoiseGatePlugin closed(SAMPLE_RATE);
+	run("NoiseGatePlugin, closed", quiet, [&closed](float* frame) {
+		closed.process(frame, FRAME_SIZE);
+	});
+
+	std::vector<float> loud(input.size());
+	std::transform(input.begin(), input.end(), loud.begin(), [](float sample) { return sample * 60.0f; });
+	NoiseGatePlugin held_open(SAMPLE_RATE);
+	run("NoiseGatePlugin, held open", loud, [&held_open](float* frame) {
+		held_open.process(frame, FRAME_SIZE);
+	});
+}
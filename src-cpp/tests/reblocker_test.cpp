@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "reblocker.h"
+#include "test.h"
+
+namespace {
+	constexpr size_t FRAME_SIZE = 480;
+
+	// Feeds input to the reblocker in the given block sizes the way the capture path does: whole frames
+	// straight from the block while nothing is pending, the rest through the reblocker. Returns the
+	// concatenated frames.
+	std::vector<float> reblock(Reblocker& reblocker, const std::vector<float>& input, const std::vector<size_t>& blocks, size_t& direct_frames) {
+		std::vector<float> frames;
+		size_t position = 0;
+		for (size_t block : blocks) {
+			const float* data = input.data() + position;
+			size_t offset = 0;
+			while (offset < block) {
+				if (reblocker.empty() && block - offset >= FRAME_SIZE) {
+					frames.insert(frames.end(), data + offset, data + offset + FRAME_SIZE);
+					offset += FRAME_SIZE;
+					direct_frames++;
+					continue;
+				}
+
+				const size_t taken = reblocker.write(data + offset, block - offset);
+				CHECK(taken > 0);
+				offset += taken;
+				if (reblocker.full()) {
+					frames.insert(frames.end(), reblocker.frame(), reblocker.frame() + FRAME_SIZE);
+					reblocker.clear();
+				}
+			}
+			position += block;
+		}
+		return frames;
+	}
+}
+
+// Whatever the block sizes, the frames are exactly the input in order, nothing dropped or repeated, and
+// the remainder waits in the reblocker.
+TEST(reblocker, random_block_sizes_preserve_every_sample) {
+	std::mt19937 rng(41);
+	for (int trial = 0; trial < 200; trial++) {
+		// Mostly callback-sized blocks, with tiny and multi-frame ones mixed in.
+		std::uniform_int_distribution<size_t> size(trial % 2 == 0 ? 1 : 400, trial % 3 == 0 ? 4 * FRAME_SIZE : 1200);
+		std::vector<size_t> blocks(1 + rng() % 50);
+		size_t total = 0;
+		for (size_t& block : blocks) {
+			block = size(rng);
+			total += block;
+		}
+
+		std::vector<float> input(total);
+		for (size_t i = 0; i < total; i++) {
+			input[i] = static_cast<float>(i);
+		}
+
+		Reblocker reblocker(FRAME_SIZE);
+		size_t direct_frames = 0;
+		const std::vector<float> frames = reblock(reblocker, input, blocks, direct_frames);
+
+		CHECK_EQ(frames.size(), total / FRAME_SIZE * FRAME_SIZE);
+		CHECK(std::equal(frames.begin(), frames.end(), input.begin()));
+		CHECK_EQ(reblocker.pending(), total % FRAME_SIZE);
+		CHECK(std::equal(reblocker.frame(), reblocker.frame() + reblocker.pending(), input.begin() + frames.size()));
+	}
+}
+
+TEST(reblocker, aligned_blocks_skip_the_copy) {
+	std::vector<float> input(FRAME_SIZE * 10, 1.0f);
+	Reblocker reblocker(FRAME_SIZE);
+	size_t direct_frames = 0;
+	reblock(reblocker, input, std::vector<size_t>(5, 2 * FRAME_SIZE), direct_frames);
+	CHECK_EQ(direct_frames, size_t{ 10 });
+	CHECK(reblocker.empty());
+}
+
+TEST(reblocker, write_stops_at_the_frame_boundary) {
+	Reblocker reblocker(FRAME_SIZE);
+	std::vector<float> input(FRAME_SIZE + 100, 1.0f);
+	CHECK_EQ(reblocker.write(input.data(), 300), size_t{ 300 });
+	CHECK_EQ(reblocker.write(input.data(), input.size()), FRAME_SIZE - 300);
+	CHECK(reblocker.full());
+	CHECK_EQ(reblocker.write(input.data(), 1), size_t{ 0 });
+
+	reblocker.clear();
+	CHECK(reblocker.empty());
+}
+
+TEST(reblocker, silence_fills_in_step_with_samples) {
+	std::mt19937 rng(42);
+	std::uniform_int_distribution<size_t> size(1, 700);
+	Reblocker samples(FRAME_SIZE);
+	Reblocker silence(FRAME_SIZE);
+	std::vector<float> block(700, 0.5f);
+
+	// The reference reblocker follows the capture one sample for sample, with silence standing in.
+	for (int i = 0; i < 1000; i++) {
+		size_t remaining = size(rng);
+		while (remaining > 0) {
+			const size_t taken = samples.write(block.data(), remaining);
+			CHECK_EQ(silence.write_silence(taken), taken);
+			remaining -= taken;
+			CHECK_EQ(silence.pending(), samples.pending());
+			if (samples.full()) {
+				CHECK(std::all_of(silence.frame(), silence.frame() + FRAME_SIZE, [](float sample) { return sample == 0.0f; }));
+				samples.clear();
+				silence.clear();
+			}
+		}
+	}
+}
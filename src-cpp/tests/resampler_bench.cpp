@@ -0,0 +1,71 @@
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "resampler.h"
+
+namespace {
+	constexpr double PI = 3.14159265358979323846;
+	constexpr size_t ITERATIONS = 20000;
+
+	// THD+N of a 1kHz tone: everything left after a least-squares fit of a sine at the test frequency,
+	// relative to the fitted tone. Independent of the reported latency.
+	double thd_n_db(int input_rate, int output_rate) {
+		constexpr double frequency = 1000.0;
+		Resampler resampler(input_rate, output_rate);
+		std::vector<float> input(static_cast<size_t>(input_rate));
+		for (size_t i = 0; i < input.size(); i++) {
+			input[i] = static_cast<float>(0.5 * std::sin(2.0 * PI * frequency * static_cast<double>(i) / input_rate));
+		}
+		std::vector<float> output(resampler.max_output(input.size()));
+		output.resize(resampler.process(input.data(), input.size(), output.data()));
+
+		const size_t first = static_cast<size_t>(output_rate) / 10;
+		const size_t last = output.size() - static_cast<size_t>(output_rate) / 10;
+		double ss = 0.0, sc = 0.0, cc = 0.0, ys = 0.0, yc = 0.0;
+		for (size_t j = first; j < last; j++) {
+			const double phase = 2.0 * PI * frequency * static_cast<double>(j) / output_rate;
+			const double s = std::sin(phase), c = std::cos(phase);
+			ss += s * s;
+			sc += s * c;
+			cc += c * c;
+			ys += output[j] * s;
+			yc += output[j] * c;
+		}
+		const double determinant = ss * cc - sc * sc;
+		const double a = (ys * cc - yc * sc) / determinant;
+		const double b = (yc * ss - ys * sc) / determinant;
+
+		double tone = 0.0, residual = 0.0;
+		for (size_t j = first; j < last; j++) {
+			const double phase = 2.0 * PI * frequency * static_cast<double>(j) / output_rate;
+			const double fitted = a * std::sin(phase) + b * std::cos(phase);
+			tone += fitted * fitted;
+			residual += (output[j] - fitted) * (output[j] - fitted);
+		}
+		return 10.0 * std::log10(residual / tone);
+	}
+}
+
+// 10ms of input per call at each rate pair the devices commonly need, plus the quality of a 1kHz tone.
+BENCHMARK(resampler) {
+	const int rate_pairs[][2] = { { 44100, 48000 }, { 48000, 44100 }, { 16000, 48000 }, { 48000, 16000 } };
+	for (const auto& rates : rate_pairs) {
+		Resampler resampler(rates[0], rates[1]);
+		const size_t block = static_cast<size_t>(rates[0]) / 100;
+		std::vector<float> input(block);
+		for (size_t i = 0; i < block; i++) {
+			input[i] = static_cast<float>(std::sin(0.05 * static_cast<double>(i)));
+		}
+		std::vector<float> output(resampler.max_output(block));
+
+		const std::string label = std::to_string(rates[0]) + " -> " + std::to_string(rates[1]);
+		bench::measure(label.c_str(), ITERATIONS, block, [&]() {
+			const size_t produced = resampler.process(input.data(), block, output.data());
+			bench::keep(output[produced - 1]);
+		});
+		std::printf("  %-44s %10.1f dB THD+N at 1kHz, %.2f ms latency\n", label.c_str(), thd_n_db(rates[0], rates[1]), resampler.latency_seconds() * 1e3);
+	}
+}
@@ -0,0 +1,73 @@
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+#include <opus/opus.h>
+
+#include "bench.h"
+#include "logger.h"
+#include "speaker_mixer.h"
+
+namespace {
+	constexpr int SAMPLE_RATE = 48000;
+	constexpr size_t FRAME_SIZE = 480;
+	constexpr size_t ITERATIONS = 2000;
+	constexpr size_t PACKETS = 100;
+	constexpr double PI = 3.14159265358979323846;
+	constexpr size_t SPEAKER_COUNTS[] = { 1, 8, 32, 64 };
+
+	// One second of 10 ms packets of a tone per speaker, each speaker at its own pitch.
+	std::vector<std::vector<std::vector<unsigned char>>> encode_speakers(size_t count) {
+		int error = 0;
+		OpusEncoder* encoder = opus_encoder_create(SAMPLE_RATE, 1, OPUS_APPLICATION_VOIP, &error);
+		std::vector<std::vector<std::vector<unsigned char>>> speakers(count);
+		std::vector<float> pcm(FRAME_SIZE);
+		unsigned char packet[MAX_JITTER_PACKET_SIZE];
+		for (size_t speaker = 0; speaker < count; speaker++) {
+			opus_encoder_ctl(encoder, OPUS_RESET_STATE);
+			const double frequency = 150.0 + 10.0 * static_cast<double>(speaker);
+			for (size_t k = 0; k < PACKETS; k++) {
+				for (size_t i = 0; i < FRAME_SIZE; i++) {
+					pcm[i] = 0.1f * static_cast<float>(std::sin(2.0 * PI * frequency * static_cast<double>(k * FRAME_SIZE + i) / SAMPLE_RATE));
+				}
+				const opus_int32 size = opus_encode_float(encoder, pcm.data(), static_cast<int>(FRAME_SIZE), packet, static_cast<opus_int32>(sizeof(packet)));
+				speakers[speaker].emplace_back(packet, packet + (size > 0 ? size : 0));
+			}
+		}
+		opus_encoder_destroy(encoder);
+		return speakers;
+	}
+}
+
+// A device period of the receive path with every speaker talking: one packet queued per speaker, as the
+// network thread would, then one SpeakerMixer::mix, which decodes and sums them all.
+BENCHMARK(speaker_mixer) {
+	const auto speakers = encode_speakers(SPEAKER_COUNTS[3]);
+	std::vector<float> output(FRAME_SIZE);
+	// Speakers joining would otherwise print between the results.
+	logger::Logger::get_instance().set_console_output(false);
+
+	for (size_t count : SPEAKER_COUNTS) {
+		auto mixer = std::make_unique<SpeakerMixer>(SAMPLE_RATE, 1, FRAME_SIZE);
+		auto arrival = std::chrono::steady_clock::now();
+		uint16_t sequence = 0;
+		uint32_t timestamp = 0;
+
+		const std::string label = std::to_string(count) + (count == 1 ? " speaker" : " speakers");
+		bench::measure(label.c_str(), ITERATIONS, FRAME_SIZE * count, [&]() {
+			const size_t k = sequence % PACKETS;
+			for (size_t speaker = 0; speaker < count; speaker++) {
+				const std::vector<unsigned char>& packet = speakers[speaker][k];
+				mixer->queue_packet(static_cast<uint32_t>(speaker + 1), sequence, timestamp, 0, packet.data(), packet.size(), arrival);
+			}
+			mixer->mix(output.data());
+			bench::keep(output.back());
+			sequence++;
+			timestamp += FRAME_SIZE;
+			arrival += std::chrono::milliseconds(10);
+		});
+	}
+	logger::Logger::get_instance().flush();
+	logger::Logger::get_instance().set_console_output(true);
+}
@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <set>
+#include <vector>
+#include <opus/opus.h>
+
+#include "logger.h"
+#include "speaker_mixer.h"
+#include "test.h"
+#include "voip_packet.h"
+
+namespace {
+	constexpr int SAMPLE_RATE = 48000;
+	constexpr size_t FRAME_SIZE = 480;
+	// 20 ms packets, two mix() calls each.
+	constexpr int PACKET_SAMPLES = 960;
+	constexpr uint32_t SPEAKER_ID = 7;
+	constexpr double PI = 3.14159265358979323846;
+
+	struct Packet {
+		uint16_t sequence;
+		uint32_t timestamp;
+		std::vector<unsigned char> data;
+	};
+
+	// count packets of a voiced, slowly modulated tone from an encoder set up like ours, with in-band FEC on.
+	// Timestamps run on from each other; tests move them to make gaps.
+	std::vector<Packet> encode_stream(size_t count) {
+		int error = 0;
+		OpusEncoder* encoder = opus_encoder_create(SAMPLE_RATE, 1, OPUS_APPLICATION_VOIP, &error);
+		CHECK_EQ(error, OPUS_OK);
+		opus_encoder_ctl(encoder, OPUS_SET_BITRATE(24000));
+		opus_encoder_ctl(encoder, OPUS_SET_SIGNAL(OPUS_SIGNAL_VOICE));
+		opus_encoder_ctl(encoder, OPUS_SET_INBAND_FEC(1));
+		opus_encoder_ctl(encoder, OPUS_SET_PACKET_LOSS_PERC(20));
+
+		std::vector<Packet> packets;
+		std::vector<float> pcm(PACKET_SAMPLES);
+		unsigned char data[MAX_JITTER_PACKET_SIZE];
+		for (size_t k = 0; k < count; k++) {
+			for (int i = 0; i < PACKET_SAMPLES; i++) {
+				const double t = static_cast<double>(k * PACKET_SAMPLES + i) / SAMPLE_RATE;
+				const double envelope = 0.6 + 0.4 * std::sin(2.0 * PI * 3.0 * t);
+				pcm[i] = static_cast<float>(0.2 * envelope * (std::sin(2.0 * PI * 180.0 * t) + 0.5 * std::sin(2.0 * PI * 360.0 * t)));
+			}
+			const opus_int32 size = opus_encode_float(encoder, pcm.data(), PACKET_SAMPLES, data, static_cast<opus_int32>(sizeof(data)));
+			CHECK(size > 0);
+			packets.push_back(Packet{ static_cast<uint16_t>(k), static_cast<uint32_t>(k * PACKET_SAMPLES), std::vector<unsigned char>(data, data + std::max(size, 0)) });
+		}
+		opus_encoder_destroy(encoder);
+		return packets;
+	}
+
+	struct Playout {
+		// The mix() call each packet started playing on.
+		std::map<uint16_t, size_t> started;
+		std::vector<std::vector<float>> frames;
+		SpeakerStats stats;
+	};
+
+	// One speaker through a SpeakerMixer, a mix() call per 10 ms. Each packet is queued two packets ahead of
+	// playout, as a steady network would deliver it, unless it is in dropped.
+	Playout play(const std::vector<Packet>& packets, const std::set<uint16_t>& dropped, size_t calls) {
+		logger::Logger::get_instance().set_console_output(false);
+		SpeakerMixer mixer(SAMPLE_RATE, 1, FRAME_SIZE);
+		mixer.set_tracked_speaker(SPEAKER_ID);
+
+		Playout playout;
+		const auto start = std::chrono::steady_clock::now();
+		size_t next = 0;
+		for (size_t call = 0; call < calls; call++) {
+			const auto now = start + std::chrono::milliseconds(10 * call);
+			const uint32_t position = static_cast<uint32_t>(call * FRAME_SIZE);
+			for (; next < packets.size() && packets[next].timestamp < position + 3 * PACKET_SAMPLES; next++) {
+				const Packet& packet = packets[next];
+				if (dropped.count(packet.sequence) == 0) {
+					CHECK(mixer.queue_packet(SPEAKER_ID, packet.sequence, packet.timestamp, VOIP_FLAG_VAD, packet.data.data(), packet.data.size(), now));
+				}
+			}
+
+			std::vector<float> frame(FRAME_SIZE);
+			mixer.mix(frame.data());
+			playout.frames.push_back(frame);
+			uint16_t sequence = 0;
+			if (mixer.take_tracked_packet(sequence)) {
+				playout.started[sequence] = call;
+			}
+		}
+
+		const std::vector<SpeakerStats> stats = mixer.get_stats();
+		CHECK_EQ(stats.size(), size_t{ 1 });
+		playout.stats = stats.empty() ? SpeakerStats{} : stats[0];
+		logger::Logger::get_instance().flush();
+		logger::Logger::get_instance().set_console_output(true);
+		return playout;
+	}
+
+	bool silent(const std::vector<float>& frame) {
+		return std::all_of(frame.begin(), frame.end(), [](float sample) { return sample == 0.0f; });
+	}
+}
+
+// The lost packet is rebuilt from the FEC in its successor, for exactly one packet's duration: the packets
+// around it still start two mix() calls apart.
+TEST(speaker_mixer, recovers_a_lost_packet_from_fec) {
+	const Playout playout = play(encode_stream(12), { 5 }, 30);
+
+	CHECK_EQ(playout.stats.fec_recovered, uint64_t{ 1 });
+	CHECK_EQ(playout.stats.concealed, uint64_t{ 0 });
+	CHECK_EQ(playout.stats.jitter.lost, uint64_t{ 1 });
+	CHECK(playout.started.count(4) == 1 && playout.started.count(6) == 1);
+	CHECK(playout.started.count(5) == 0);
+	if (playout.started.count(4) == 1 && playout.started.count(6) == 1) {
+		const size_t lost_call = playout.started.at(4) + 2;
+		CHECK_EQ(playout.started.at(6), lost_call + 2);
+		CHECK(!silent(playout.frames[lost_call]));
+		CHECK(!silent(playout.frames[lost_call + 1]));
+	}
+}
+
+// With its successor missing as well there is no FEC to use, so the first loss is concealed; the second is
+// rebuilt from the packet after it.
+TEST(speaker_mixer, conceals_a_loss_without_a_successor) {
+	const Playout playout = play(encode_stream(12), { 5, 6 }, 30);
+
+	CHECK_EQ(playout.stats.concealed, uint64_t{ 1 });
+	CHECK_EQ(playout.stats.fec_recovered, uint64_t{ 1 });
+	CHECK_EQ(playout.stats.jitter.lost, uint64_t{ 2 });
+	CHECK(playout.started.count(4) == 1 && playout.started.count(7) == 1);
+	if (playout.started.count(4) == 1 && playout.started.count(7) == 1) {
+		CHECK_EQ(playout.started.at(7), playout.started.at(4) + 6);
+	}
+}
+
+// Contiguous sequence numbers with a 40 ms timestamp jump: the sender stopped for that long (DTX). The gap
+// plays as exact silence and the decoder is never asked to conceal it.
+TEST(speaker_mixer, timestamp_gap_plays_silence_without_concealment) {
+	std::vector<Packet> packets = encode_stream(12);
+	for (Packet& packet : packets) {
+		packet.timestamp += packet.sequence >= 6 ? 2 * PACKET_SAMPLES : 0;
+	}
+	const Playout playout = play(packets, {}, 34);
+
+	CHECK_EQ(playout.stats.concealed, uint64_t{ 0 });
+	CHECK_EQ(playout.stats.fec_recovered, uint64_t{ 0 });
+	CHECK_EQ(playout.stats.jitter.lost, uint64_t{ 0 });
+	CHECK(playout.started.count(5) == 1 && playout.started.count(6) == 1);
+	if (playout.started.count(5) == 1 && playout.started.count(6) == 1) {
+		const size_t gap_call = playout.started.at(5) + 2;
+		CHECK_EQ(playout.started.at(6), gap_call + 4);
+		for (size_t call = gap_call; call < gap_call + 4; call++) {
+			CHECK(silent(playout.frames[call]));
+		}
+		CHECK(!silent(playout.frames[gap_call - 1]));
+		CHECK(!silent(playout.frames[gap_call + 4]));
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+// Minimal self-registering test cases. speakly_tests runs the suites named on its command line, or all of
+// them; CTest runs one suite per entry. A failed check is reported and the case carries on.
+namespace test {
+	struct TestCase {
+		const char* suite;
+		const char* name;
+		void (*run)();
+	};
+
+	std::vector<TestCase>& registry();
+	void fail(const char* file, int line, const std::string& message);
+
+	struct Registrar {
+		Registrar(const char* suite, const char* name, void (*run)()) {
+			registry().push_back(TestCase{ suite, name, run });
+		}
+	};
+}
+
+#define TEST(suite, name) \
+	static void suite##_##name(); \
+	static test::Registrar suite##_##name##_registrar(#suite, #name, suite##_##name); \
+	static void suite##_##name()
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			test::fail(__FILE__, __LINE__, #condition); \
+		} \
+	} while (0)
+
+#define CHECK_EQ(actual, expected) \
+	do { \
+		const auto actual_value = (actual); \
+		const auto expected_value = (expected); \
+		if (!(actual_value == expected_value)) { \
+			test::fail(__FILE__, __LINE__, std::string(#actual " == " #expected ", got ") + std::to_string(actual_value) + " vs " + std::to_string(expected_value)); \
+		} \
+	} while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance) \
+	do { \
+		const double actual_value = static_cast<double>(actual); \
+		const double expected_value = static_cast<double>(expected); \
+		if (!(std::fabs(actual_value - expected_value) <= (tolerance))) { \
+			test::fail(__FILE__, __LINE__, std::string(#actual " ~= " #expected ", got ") + std::to_string(actual_value) + " vs " + std::to_string(expected_value)); \
+		} \
+	} while (0)
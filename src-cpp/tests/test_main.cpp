@@ -0,0 +1,43 @@
+#include <cstdio>
+#include <cstring>
+
+#include "test.h"
+
+namespace test {
+	int failures = 0;
+
+	std::vector<TestCase>& registry() {
+		static std::vector<TestCase> cases;
+		return cases;
+	}
+
+	void fail(const char* file, int line, const std::string& message) {
+		failures++;
+		std::printf("  %s:%d: check failed: %s\n", file, line, message.c_str());
+	}
+}
+
+int main(int argc, char** argv) {
+	int ran = 0;
+	for (const test::TestCase& test_case : test::registry()) {
+		bool selected = argc < 2;
+		for (int i = 1; i < argc; i++) {
+			selected = selected || std::strcmp(argv[i], test_case.suite) == 0;
+		}
+		if (!selected) {
+			continue;
+		}
+
+		const int failures_before = test::failures;
+		test_case.run();
+		std::printf("%s %s.%s\n", test::failures == failures_before ? "[ ok ]" : "[FAIL]", test_case.suite, test_case.name);
+		ran++;
+	}
+
+	if (ran == 0) {
+		std::printf("no test cases selected\n");
+		return 1;
+	}
+	std::printf("%d test cases, %d failed checks\n", ran, test::failures);
+	return test::failures == 0 ? 0 : 1;
+}
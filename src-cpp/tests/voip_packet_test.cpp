@@ -0,0 +1,99 @@
+#include <random>
+#include <vector>
+
+#include "test.h"
+#include "voip_packet.h"
+
+namespace {
+	std::vector<unsigned char> build_packet(const VoipPacketHeader& header, size_t payload_size) {
+		std::vector<unsigned char> packet(VOIP_HEADER_SIZE + payload_size);
+		for (size_t i = 0; i < payload_size; i++) {
+			packet[VOIP_HEADER_SIZE + i] = static_cast<unsigned char>(i * 31 + 7);
+		}
+		write_voip_header(packet.data(), header);
+		return packet;
+	}
+}
+
+TEST(voip_packet, header_is_big_endian) {
+	const VoipPacketHeader header{ VOIP_PACKET_VERSION, VOIP_FLAG_VAD | VOIP_FLAG_FEC, 0x0102, 0x03040506, 0x0708090A };
+	const std::vector<unsigned char> packet = build_packet(header, 1);
+	const unsigned char expected[VOIP_HEADER_SIZE] = { 1, 3, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A };
+	for (size_t i = 0; i < VOIP_HEADER_SIZE; i++) {
+		CHECK_EQ(packet[i], expected[i]);
+	}
+}
+
+TEST(voip_packet, round_trips_random_headers) {
+	std::mt19937 random(1234);
+	for (int i = 0; i < 10000; i++) {
+		const VoipPacketHeader header{
+			VOIP_PACKET_VERSION,
+			static_cast<uint8_t>(random()),
+			static_cast<uint16_t>(random()),
+			static_cast<uint32_t>(random()),
+			static_cast<uint32_t>(random())
+		};
+		const size_t payload_size = 1 + random() % 400;
+		const std::vector<unsigned char> packet = build_packet(header, payload_size);
+
+		VoipPacketView view;
+		CHECK(parse_voip_packet(packet.data(), packet.size(), view));
+		CHECK_EQ(view.header.version, header.version);
+		CHECK_EQ(view.header.flags, header.flags);
+		CHECK_EQ(view.header.sequence, header.sequence);
+		CHECK_EQ(view.header.timestamp, header.timestamp);
+		CHECK_EQ(view.header.speaker_id, header.speaker_id);
+		CHECK(view.payload == packet.data() + VOIP_HEADER_SIZE);
+		CHECK_EQ(view.payload_size, payload_size);
+	}
+}
+
+TEST(voip_packet, rejects_truncated_packets) {
+	const VoipPacketHeader header{ VOIP_PACKET_VERSION, 0, 1, 2, 3 };
+	const std::vector<unsigned char> packet = build_packet(header, 20);
+
+	VoipPacketView view;
+	CHECK(!parse_voip_packet(nullptr, 0, view));
+	CHECK(!parse_voip_packet(nullptr, packet.size(), view));
+	// A header with no payload is truncated too.
+	for (size_t size = 0; size <= VOIP_HEADER_SIZE; size++) {
+		// Copied to an exactly sized buffer so a sanitizer build catches any read past the end.
+		const std::vector<unsigned char> truncated(packet.begin(), packet.begin() + size);
+		CHECK(!parse_voip_packet(truncated.data(), truncated.size(), view));
+	}
+}
+
+TEST(voip_packet, rejects_unknown_versions) {
+	VoipPacketView view;
+	for (int version = 0; version < 256; version++) {
+		if (version == VOIP_PACKET_VERSION) {
+			continue;
+		}
+		const VoipPacketHeader header{ static_cast<uint8_t>(version), 0, 1, 2, 3 };
+		const std::vector<unsigned char> packet = build_packet(header, 10);
+		CHECK(!parse_voip_packet(packet.data(), packet.size(), view));
+	}
+}
+
+TEST(voip_packet, survives_garbage) {
+	std::mt19937 random(99);
+	for (int i = 0; i < 100000; i++) {
+		std::vector<unsigned char> buffer(random() % 64);
+		for (auto& byte : buffer) {
+			byte = static_cast<unsigned char>(random());
+		}
+		// Give a share of the buffers a valid version so the rest of the parser gets exercised as well.
+		if (!buffer.empty() && random() % 2 == 0) {
+			buffer[0] = VOIP_PACKET_VERSION;
+		}
+
+		VoipPacketView view;
+		if (parse_voip_packet(buffer.data(), buffer.size(), view)) {
+			CHECK_EQ(view.header.version, VOIP_PACKET_VERSION);
+			CHECK(buffer.size() > VOIP_HEADER_SIZE);
+			CHECK(view.payload == buffer.data() + VOIP_HEADER_SIZE);
+			CHECK_EQ(view.payload_size, buffer.size() - VOIP_HEADER_SIZE);
+		}
+	}
+}